@@ -0,0 +1,380 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <locale>
+#include <algorithm>
+#include <cstdio>
+#include <cmath>
+
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "GasLibrary.hh"
+
+namespace {
+
+const char* IndexFile = ".gasindex";
+const char* IndexTag = "# GasLibrary index 2";
+
+bool EndsWith(const std::string& s, const std::string& suffix) {
+  return s.size() >= suffix.size() &&
+         s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+std::vector<std::string> Split(const std::string& line, const char sep) {
+  std::vector<std::string> fields;
+  size_t start = 0;
+  while (true) {
+    const size_t pos = line.find(sep, start);
+    if (pos == std::string::npos) {
+      fields.push_back(line.substr(start));
+      break;
+    }
+    fields.push_back(line.substr(start, pos - start));
+    start = pos + 1;
+  }
+  return fields;
+}
+
+// Text fields of the index are escaped, since tabs and newlines
+// separate the fields and records.
+std::string Escape(const std::string& field) {
+  std::string s;
+  const unsigned int n = field.size();
+  for (unsigned int i = 0; i < n; ++i) {
+    switch (field[i]) {
+      case '\\':
+        s += "\\\\";
+        break;
+      case '\t':
+        s += "\\t";
+        break;
+      case '\n':
+        s += "\\n";
+        break;
+      case '\r':
+        s += "\\r";
+        break;
+      default:
+        s += field[i];
+    }
+  }
+  return s;
+}
+
+std::string Unescape(const std::string& field) {
+  std::string s;
+  const unsigned int n = field.size();
+  for (unsigned int i = 0; i < n; ++i) {
+    if (field[i] != '\\' || i + 1 == n) {
+      s += field[i];
+      continue;
+    }
+    ++i;
+    switch (field[i]) {
+      case 't':
+        s += '\t';
+        break;
+      case 'n':
+        s += '\n';
+        break;
+      case 'r':
+        s += '\r';
+        break;
+      default:
+        s += field[i];
+    }
+  }
+  return s;
+}
+
+// Locale-independent conversion of a field.
+template <class T>
+bool Convert(const std::string& field, T& value) {
+  std::istringstream data(field);
+  data.imbue(std::locale::classic());
+  return static_cast<bool>(data >> value);
+}
+
+struct PressureOrder {
+  PressureOrder(const std::vector<Garfield::GasLibrary::Entry>& entries)
+      : m_entries(entries) {}
+  bool operator()(const unsigned int a, const unsigned int b) const {
+    return m_entries[a].header.pressure < m_entries[b].header.pressure;
+  }
+  bool operator()(const unsigned int a, const double p) const {
+    return m_entries[a].header.pressure < p;
+  }
+  const std::vector<Garfield::GasLibrary::Entry>& m_entries;
+};
+
+bool FilenameOrder(const Garfield::GasLibrary::Entry& a,
+                   const Garfield::GasLibrary::Entry& b) {
+  return a.filename < b.filename;
+}
+}
+
+namespace Garfield {
+
+GasLibrary::GasLibrary()
+    : m_className("GasLibrary"),
+      m_directory(""),
+      m_pTolerance(1.e-3),
+      m_tTolerance(0.5),
+      m_debug(false) {}
+
+std::string GasLibrary::GetPath(const unsigned int i) const {
+
+  if (i >= m_entries.size()) return "";
+  return m_directory + "/" + m_entries[i].filename;
+}
+
+std::string GasLibrary::GetCompositionKey(const double* mixture) {
+
+  double sum = 0.;
+  for (unsigned int i = 0; i < GasTable::nMixture; ++i) {
+    if (mixture[i] > 0.) sum += mixture[i];
+  }
+  if (sum <= 0.) return "";
+  std::string key = "";
+  char buffer[64];
+  for (unsigned int i = 0; i < GasTable::nMixture; ++i) {
+    if (mixture[i] <= 0.) continue;
+    // Percentages are rounded to 0.01%.
+    const double f = floor(10000. * mixture[i] / sum + 0.5) / 100.;
+    snprintf(buffer, sizeof(buffer), "%s%u:%.2f", key.empty() ? "" : "/",
+             i + 1, f);
+    key += buffer;
+  }
+  // The decimal point may depend on the locale.
+  std::replace(key.begin(), key.end(), ',', '.');
+  return key;
+}
+
+bool GasLibrary::Scan(const std::string& directory, const bool updateIndex) {
+
+  DIR* dir = opendir(directory.c_str());
+  if (!dir) {
+    std::cerr << m_className << "::Scan:\n"
+              << "    Cannot open directory " << directory << ".\n";
+    return false;
+  }
+  m_directory = directory;
+  m_entries.clear();
+  m_index.clear();
+
+  // Entries of the previous scan.
+  std::map<std::string, Entry> cache;
+  const std::string indexfile = m_directory + "/" + IndexFile;
+  ReadIndex(indexfile, cache);
+
+  unsigned int nRead = 0;
+  struct dirent* item = NULL;
+  while ((item = readdir(dir)) != NULL) {
+    const std::string name = item->d_name;
+    if (name.empty() || name[0] == '.') continue;
+    const std::string path = m_directory + "/" + name;
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0 || !S_ISREG(info.st_mode)) continue;
+    Entry entry;
+    entry.filename = name;
+    entry.size = info.st_size;
+    entry.mtime = info.st_mtime;
+    std::map<std::string, Entry>::const_iterator it = cache.find(name);
+    if (it != cache.end() && it->second.size == entry.size &&
+        it->second.mtime == entry.mtime) {
+      m_entries.push_back(it->second);
+      continue;
+    }
+    // New or modified file.
+    if (!EndsWith(name, ".gas") && !GasTable::IsBinaryFile(path) &&
+        !GasTable::IsCompressedFile(path)) {
+      continue;
+    }
+    if (!GasTable::ReadHeader(path, entry.header)) {
+      if (m_debug) {
+        std::cerr << m_className << "::Scan:\n"
+                  << "    Skipping " << name << ".\n";
+      }
+      continue;
+    }
+    entry.composition = GetCompositionKey(entry.header.mixture);
+    m_entries.push_back(entry);
+    ++nRead;
+  }
+  closedir(dir);
+  std::sort(m_entries.begin(), m_entries.end(), FilenameOrder);
+  BuildIndex();
+
+  if (m_debug) {
+    std::cout << m_className << "::Scan:\n"
+              << "    " << m_entries.size() << " gas tables in " << directory
+              << ", " << nRead << " (re-)read.\n";
+  }
+  const bool changed = nRead > 0 || cache.size() != m_entries.size();
+  if (updateIndex && changed && !WriteIndex(indexfile) && m_debug) {
+    std::cerr << m_className << "::Scan:\n"
+              << "    Could not write the index file " << indexfile << ".\n";
+  }
+  return true;
+}
+
+void GasLibrary::BuildIndex() {
+
+  m_index.clear();
+  const unsigned int n = m_entries.size();
+  for (unsigned int i = 0; i < n; ++i) {
+    if (m_entries[i].composition.empty()) continue;
+    m_index[m_entries[i].composition].push_back(i);
+  }
+  std::map<std::string, std::vector<unsigned int> >::iterator it;
+  for (it = m_index.begin(); it != m_index.end(); ++it) {
+    std::sort(it->second.begin(), it->second.end(), PressureOrder(m_entries));
+  }
+}
+
+int GasLibrary::Find(const std::vector<int>& gases,
+                     const std::vector<double>& fractions,
+                     const double pressure, const double temperature,
+                     const double emin, const double emax) const {
+
+  if (gases.size() != fractions.size() || pressure <= 0.) {
+    std::cerr << m_className << "::Find:\n"
+              << "    Invalid composition or pressure.\n";
+    return -1;
+  }
+  double mixture[GasTable::nMixture];
+  std::fill(mixture, mixture + GasTable::nMixture, 0.);
+  for (unsigned int i = 0; i < gases.size(); ++i) {
+    if (gases[i] < 1 || gases[i] > (int)GasTable::nMixture) {
+      std::cerr << m_className << "::Find:\n"
+                << "    Invalid gas number " << gases[i] << ".\n";
+      return -1;
+    }
+    mixture[gases[i] - 1] += fractions[i];
+  }
+  return Find(mixture, pressure, temperature, emin, emax);
+}
+
+int GasLibrary::Find(const double* mixture, const double pressure,
+                     const double temperature, const double emin,
+                     const double emax) const {
+
+  if (pressure <= 0.) {
+    std::cerr << m_className << "::Find:\n    Invalid pressure.\n";
+    return -1;
+  }
+  const std::string key = GetCompositionKey(mixture);
+  std::map<std::string, std::vector<unsigned int> >::const_iterator it =
+      m_index.find(key);
+  if (it == m_index.end()) return -1;
+
+  // Entries with pressure in the accepted range.
+  const std::vector<unsigned int>& list = it->second;
+  std::vector<unsigned int>::const_iterator first = std::lower_bound(
+      list.begin(), list.end(), pressure * (1. - m_pTolerance),
+      PressureOrder(m_entries));
+  int best = -1;
+  for (; first != list.end(); ++first) {
+    const GasTable::Header& header = m_entries[*first].header;
+    if (header.pressure > pressure * (1. + m_pTolerance)) break;
+    if (fabs(header.temperature - temperature) > m_tTolerance) continue;
+    // The gas file stores E / p.
+    const double tol = 1.e-6;
+    if (emin > 0. && header.eMin * header.pressure > emin * (1. + tol)) {
+      continue;
+    }
+    if (emax > 0. && header.eMax * header.pressure < emax * (1. - tol)) {
+      continue;
+    }
+    if (best < 0 || header.nE > m_entries[best].header.nE) best = *first;
+  }
+  return best;
+}
+
+bool GasLibrary::ReadIndex(const std::string& filename,
+                           std::map<std::string, Entry>& entries) const {
+
+  std::ifstream infile(filename.c_str());
+  if (!infile) return false;
+  std::string line;
+  if (!std::getline(infile, line) || line != IndexTag) return false;
+  while (std::getline(infile, line)) {
+    const std::vector<std::string> f = Split(line, '\t');
+    if (f.size() != 20) continue;
+    Entry entry;
+    GasTable::Header& h = entry.header;
+    int binary = 0, map3d = 0;
+    entry.filename = Unescape(f[0]);
+    bool ok = Convert(f[1], entry.size) && Convert(f[2], entry.mtime) &&
+              Convert(f[3], binary) && Convert(f[4], h.version) &&
+              Convert(f[5], map3d) && Convert(f[6], h.nE) &&
+              Convert(f[7], h.nAngles) && Convert(f[8], h.nB) &&
+              Convert(f[9], h.eMin) && Convert(f[10], h.eMax) &&
+              Convert(f[11], h.aMin) && Convert(f[12], h.aMax) &&
+              Convert(f[13], h.bMin) && Convert(f[14], h.bMax) &&
+              Convert(f[15], h.pressure) && Convert(f[16], h.temperature);
+    if (!ok) continue;
+    h.binary = binary != 0;
+    h.map3d = map3d != 0;
+    h.gasBits = Unescape(f[17]);
+    std::fill(h.mixture, h.mixture + GasTable::nMixture, 0.);
+    const std::vector<std::string> components = Split(f[18], ',');
+    for (unsigned int i = 0; i < components.size(); ++i) {
+      const size_t pos = components[i].find(':');
+      unsigned int k = 0;
+      double value = 0.;
+      if (pos == std::string::npos ||
+          !Convert(components[i].substr(0, pos), k) ||
+          !Convert(components[i].substr(pos + 1), value) ||
+          k >= GasTable::nMixture) {
+        continue;
+      }
+      h.mixture[k] = value;
+    }
+    h.identifier = Unescape(f[19]);
+    entry.composition = GetCompositionKey(h.mixture);
+    entries[entry.filename] = entry;
+  }
+  return true;
+}
+
+bool GasLibrary::WriteIndex(const std::string& filename) const {
+
+  // Write to a temporary file first, so that other processes
+  // never read a partially written index.
+  std::ostringstream tmpname;
+  tmpname << filename << "." << getpid() << ".tmp";
+  std::ofstream outfile(tmpname.str().c_str());
+  if (!outfile) return false;
+  outfile.imbue(std::locale::classic());
+  outfile.precision(17);
+  outfile << IndexTag << "\n";
+  const unsigned int n = m_entries.size();
+  for (unsigned int i = 0; i < n; ++i) {
+    const Entry& e = m_entries[i];
+    const GasTable::Header& h = e.header;
+    outfile << Escape(e.filename) << "\t" << e.size << "\t" << e.mtime << "\t"
+            << h.binary << "\t" << h.version << "\t" << h.map3d << "\t"
+            << h.nE << "\t" << h.nAngles << "\t" << h.nB << "\t" << h.eMin
+            << "\t" << h.eMax << "\t" << h.aMin << "\t" << h.aMax << "\t"
+            << h.bMin << "\t" << h.bMax << "\t" << h.pressure << "\t"
+            << h.temperature << "\t" << Escape(h.gasBits) << "\t";
+    bool first = true;
+    for (unsigned int k = 0; k < GasTable::nMixture; ++k) {
+      if (h.mixture[k] == 0.) continue;
+      if (!first) outfile << ",";
+      outfile << k << ":" << h.mixture[k];
+      first = false;
+    }
+    outfile << "\t" << Escape(h.identifier) << "\n";
+  }
+  outfile.close();
+  if (!outfile || rename(tmpname.str().c_str(), filename.c_str()) != 0) {
+    remove(tmpname.str().c_str());
+    return false;
+  }
+  return true;
+}
+}
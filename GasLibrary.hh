@@ -0,0 +1,95 @@
+#ifndef G_GAS_LIBRARY_H
+#define G_GAS_LIBRARY_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <stdint.h>
+
+#include "GasTable.hh"
+
+namespace Garfield {
+
+/// Searchable index of a directory of gas files.
+///
+/// The directory is scanned once; for each gas file (text or binary)
+/// the header and gas parameters are read and kept in a persistent index
+/// file (".gasindex" in the same directory), so later scans only open
+/// files that are new or have changed. Tables can then be looked up by
+/// composition, pressure, temperature and required field range without
+/// opening the gas files.
+
+class GasLibrary {
+
+ public:
+  struct Entry {
+    // File name (relative to the directory)
+    std::string filename;
+    // Size [bytes] and modification time of the file when it was indexed
+    uint64_t size;
+    int64_t mtime;
+    GasTable::Header header;
+    // Normalised composition, e.g. "2:90.00/13:10.00"
+    // (gas file numbers and percentages)
+    std::string composition;
+  };
+
+  // Constructor
+  GasLibrary();
+  // Destructor
+  ~GasLibrary() {}
+
+  // Scan a directory and (optionally) update its index file.
+  bool Scan(const std::string& directory, const bool updateIndex = true);
+  const std::string& GetDirectory() const { return m_directory; }
+
+  unsigned int GetNumberOfEntries() const { return m_entries.size(); }
+  const Entry& GetEntry(const unsigned int i) const { return m_entries[i]; }
+  std::string GetPath(const unsigned int i) const;
+
+  // Tolerances for matching pressure (relative) and temperature [K].
+  void SetPressureTolerance(const double tol) { m_pTolerance = tol; }
+  void SetTemperatureTolerance(const double tol) { m_tTolerance = tol; }
+
+  // Find the table for a given composition (gas file numbers and
+  // fractions), pressure [Torr] and temperature [K] that covers the
+  // electric field range [emin, emax] [V/cm]. Among several matches
+  // the one with the finest E grid is returned. Returns the entry index,
+  // or -1 if there is no matching table.
+  int Find(const std::vector<int>& gases, const std::vector<double>& fractions,
+           const double pressure, const double temperature,
+           const double emin = 0., const double emax = 0.) const;
+  // Same, with the percentages indexed by gas file number - 1
+  // (as in the Mixture block of a gas file).
+  int Find(const double* mixture, const double pressure,
+           const double temperature, const double emin = 0.,
+           const double emax = 0.) const;
+
+  // Normalised composition string from percentages indexed by
+  // gas file number - 1 (as in the Mixture block of a gas file).
+  static std::string GetCompositionKey(const double* mixture);
+
+  void EnableDebugging() { m_debug = true; }
+  void DisableDebugging() { m_debug = false; }
+
+ private:
+  std::string m_className;
+
+  std::string m_directory;
+  std::vector<Entry> m_entries;
+  // Entries with the same composition, sorted by pressure
+  std::map<std::string, std::vector<unsigned int> > m_index;
+
+  double m_pTolerance;
+  double m_tTolerance;
+
+  bool m_debug;
+
+  bool ReadIndex(const std::string& filename,
+                 std::map<std::string, Entry>& entries) const;
+  bool WriteIndex(const std::string& filename) const;
+  void BuildIndex();
+};
+}
+
+#endif
@@ -0,0 +1,2279 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <locale>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <cmath>
+#include <ctime>
+#include <algorithm>
+#include <stdint.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#include "GasTable.hh"
+
+namespace {
+
+const char BinaryMagic[8] = {'G', 'A', 'R', 'F', 'G', 'A', 'S', '\0'};
+const uint32_t BinaryFormatVersion = 1;
+const uint32_t ByteOrderMark = 0x01020304;
+const char CompressedMagic[8] = {'G', 'A', 'R', 'F', 'G', 'A', 'Z', '\0'};
+// Size of the buffers used for (de)compression
+const size_t ChunkSize = 65536;
+
+// Layout of the tables in a text gas file: fields of 15 characters,
+// 8 per line (plus the newline).
+const size_t FieldWidth = 15;
+const size_t LineLength = 8 * FieldWidth + 1;
+
+const char* Ruler =
+    "*----.----1----.----2----.----3----.----4----.----5----.----6----.-"
+    "---7----.----8----.----9----.---10----.---11----.---12----.---13--";
+
+// Default trailer (cluster data, Heed and SRIM flags).
+const char* DefaultTail =
+    " CLSTYP    : NOT SET   \n"
+    " FCNCLS    :                                                        "
+    "                         \n"
+    " NCLS      :          0\n"
+    " Average   :  0.000000000000000000e+00\n"
+    "  Heed initialisation done: F\n"
+    "  SRIM initialisation done: F\n";
+
+std::string Trim(const std::string& s) {
+  const size_t i0 = s.find_first_not_of(" \t\r\n");
+  if (i0 == std::string::npos) return "";
+  const size_t i1 = s.find_last_not_of(" \t\r\n");
+  return s.substr(i0, i1 - i0 + 1);
+}
+
+// Text following the first colon of a line.
+std::string AfterColon(const std::string& line) {
+  const size_t i = line.find(':');
+  if (i == std::string::npos) return "";
+  return line.substr(i + 1);
+}
+
+bool StartsWith(const std::string& line, const char* key) {
+  return line.compare(0, strlen(key), key) == 0;
+}
+
+// Exactly representable powers of ten.
+const double PowersOfTen[23] = {1.e0,  1.e1,  1.e2,  1.e3,  1.e4,  1.e5,
+                                1.e6,  1.e7,  1.e8,  1.e9,  1.e10, 1.e11,
+                                1.e12, 1.e13, 1.e14, 1.e15, 1.e16, 1.e17,
+                                1.e18, 1.e19, 1.e20, 1.e21, 1.e22};
+
+bool IsBlank(const char c) {
+  return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+bool IsDigit(const char c) { return c >= '0' && c <= '9'; }
+
+// Decode a floating point number starting at p (after leading blanks)
+// and advance p to the first character following it. Unlike strtod and
+// stream extraction this does not depend on the locale, and fixed-width
+// fields written without separating blank ("1.0e+00-2.0e+00") are split
+// correctly. Mantissa and exponent are accumulated as integers; if both
+// are exactly representable (as for the 9 significant digits of the gas
+// file format), a single multiplication or division gives the correctly
+// rounded result; other numbers are rare and handed to a stream
+// in the classic locale.
+bool ParseNumber(const char*& p, const char* end, double& x) {
+  while (p < end && IsBlank(*p)) ++p;
+  const char* q = p;
+  bool negative = false;
+  if (q < end && (*q == '-' || *q == '+')) {
+    negative = *q == '-';
+    ++q;
+  }
+  uint64_t mantissa = 0;
+  int nDigits = 0;
+  int scale = 0;
+  bool found = false;
+  for (; q < end && IsDigit(*q); ++q) {
+    found = true;
+    if (nDigits < 19) {
+      mantissa = 10 * mantissa + (*q - '0');
+      if (mantissa > 0) ++nDigits;
+    } else {
+      ++scale;
+    }
+  }
+  if (q < end && *q == '.') {
+    for (++q; q < end && IsDigit(*q); ++q) {
+      found = true;
+      if (nDigits >= 19) continue;
+      mantissa = 10 * mantissa + (*q - '0');
+      if (mantissa > 0) ++nDigits;
+      --scale;
+    }
+  }
+  if (!found) return false;
+  if (q < end && (*q == 'e' || *q == 'E' || *q == 'd' || *q == 'D')) {
+    const char* r = q + 1;
+    int sign = 1;
+    if (r < end && (*r == '-' || *r == '+')) {
+      if (*r == '-') sign = -1;
+      ++r;
+    }
+    int exponent = 0;
+    bool hasExponent = false;
+    for (; r < end && IsDigit(*r); ++r) {
+      hasExponent = true;
+      if (exponent < 100000) exponent = 10 * exponent + (*r - '0');
+    }
+    if (hasExponent) {
+      scale += sign * exponent;
+      q = r;
+    }
+  }
+  double value = 0.;
+  if (mantissa == 0) {
+    value = 0.;
+  } else if (mantissa < (uint64_t(1) << 53) && scale >= -22 && scale <= 22) {
+    value = scale < 0 ? double(mantissa) / PowersOfTen[-scale]
+                      : double(mantissa) * PowersOfTen[scale];
+  } else {
+    // Rare case: let a stream in the classic locale do the rounding.
+    std::istringstream token(std::string(p, q));
+    token.imbue(std::locale::classic());
+    if (!(token >> value)) return false;
+    if (value < 0.) value = -value;
+  }
+  x = negative ? -value : value;
+  p = q;
+  return true;
+}
+
+// Read n numbers.
+bool ReadNumbers(const char*& p, const char* end, double* values,
+                 const unsigned int n) {
+  for (unsigned int i = 0; i < n; ++i) {
+    if (!ParseNumber(p, end, values[i])) return false;
+  }
+  return true;
+}
+
+// Extract the line starting at p and advance p to the next line.
+bool GetLine(const char*& p, const char* end, std::string& line) {
+  if (p >= end) return false;
+  const char* eol = static_cast<const char*>(memchr(p, '\n', end - p));
+  if (!eol) eol = end;
+  const char* last = eol;
+  if (last > p && *(last - 1) == '\r') --last;
+  line.assign(p, last);
+  p = eol < end ? eol + 1 : end;
+  return true;
+}
+
+// Skip the remainder of the current line and read the next non-empty one.
+bool NextLine(const char*& p, const char* end, std::string& line) {
+  while (GetLine(p, end, line)) {
+    if (!Trim(line).empty()) return true;
+  }
+  return false;
+}
+
+// Decode "KEY = value, KEY = value, ..." into consecutive values.
+unsigned int ReadAssignments(const std::string& line, double* values,
+                             const unsigned int n) {
+  unsigned int k = 0;
+  size_t pos = line.find('=');
+  const char* end = line.data() + line.size();
+  while (pos != std::string::npos && k < n) {
+    const char* p = line.data() + pos + 1;
+    if (ParseNumber(p, end, values[k])) ++k;
+    pos = line.find('=', pos + 1);
+  }
+  return k;
+}
+
+void ReadIntegers(const std::string& text, int* values, const unsigned int n) {
+  const char* p = text.c_str();
+  for (unsigned int i = 0; i < n; ++i) {
+    char* next = NULL;
+    const long value = strtol(p, &next, 10);
+    if (next == p) break;
+    values[i] = value;
+    p = next;
+  }
+}
+
+// Read a whole file into memory.
+bool ReadFile(const std::string& filename, std::string& buffer) {
+  FILE* f = fopen(filename.c_str(), "rb");
+  if (!f) return false;
+  bool ok = fseek(f, 0, SEEK_END) == 0;
+  const long size = ok ? ftell(f) : -1;
+  ok = size >= 0 && fseek(f, 0, SEEK_SET) == 0;
+  if (ok) {
+    buffer.resize(size);
+    ok = size == 0 || fread(&buffer[0], 1, size, f) == (size_t)size;
+  }
+  fclose(f);
+  return ok;
+}
+
+void WriteNumber(std::ostream& out, const double x) {
+  char buffer[32];
+  snprintf(buffer, sizeof(buffer), "%15.8e", x);
+  out << buffer;
+}
+
+// Write n numbers, nPerLine per line.
+void WriteNumbers(std::ostream& out, const double* values,
+                  const unsigned int n, const unsigned int nPerLine) {
+  for (unsigned int i = 0; i < n; ++i) {
+    WriteNumber(out, values[i]);
+    if ((i + 1) % nPerLine == 0 || i + 1 == n) out << "\n";
+  }
+}
+
+void WriteIntegers(std::ostream& out, const int* values, const unsigned int n,
+                   const int width) {
+  char buffer[32];
+  for (unsigned int i = 0; i < n; ++i) {
+    snprintf(buffer, sizeof(buffer), "%*d", width, values[i]);
+    out << buffer;
+  }
+  out << "\n";
+}
+
+void WriteString(std::ostream& out, const std::string& s) {
+  const uint32_t n = s.size();
+  out.write(reinterpret_cast<const char*>(&n), sizeof(n));
+  out.write(s.data(), n);
+}
+
+bool ReadString(const char*& p, const char* end, std::string& s) {
+  uint32_t n = 0;
+  if (p + sizeof(n) > end) return false;
+  memcpy(&n, p, sizeof(n));
+  p += sizeof(n);
+  if (p + n > end) return false;
+  s.assign(p, n);
+  p += n;
+  return true;
+}
+
+// Values read from text files have 9 significant digits. Before
+// compression, such values are replaced by their decimal exponent
+// (one byte) and mantissa (difference to the previous mantissa,
+// as variable-length integer). Other values are kept verbatim
+// (exponent code 0). The encoded block is preceded by its length.
+const int ExponentBias = 64;
+
+double DecimalValue(const int64_t m, const int scale) {
+  return scale < 0 ? double(m) / PowersOfTen[-scale]
+                   : double(m) * PowersOfTen[scale];
+}
+
+bool ToDecimal(const double x, int64_t& m, int& e) {
+  char buffer[32];
+  snprintf(buffer, sizeof(buffer), "%.8e", x);
+  const char* p = buffer;
+  const bool negative = *p == '-';
+  if (negative) ++p;
+  m = 0;
+  for (; IsDigit(*p) || *p == '.'; ++p) {
+    if (*p != '.') m = 10 * m + (*p - '0');
+  }
+  if (*p != 'e') return false;
+  e = atoi(p + 1);
+  if (negative) m = -m;
+  // Only use the decimal form if it gives back exactly the same bits.
+  if (e - 8 < -22 || e - 8 > 22) return false;
+  const double y = DecimalValue(m, e - 8);
+  return memcmp(&x, &y, sizeof(x)) == 0;
+}
+
+void EncodeBlock(const double* values, const size_t n,
+                 std::vector<unsigned char>& out) {
+  std::vector<unsigned char> mantissas;
+  std::vector<unsigned char> raw;
+  out.assign(4 + n, 0);
+  int64_t previous = 0;
+  for (size_t i = 0; i < n; ++i) {
+    int64_t m = 0;
+    int e = 0;
+    if (ToDecimal(values[i], m, e)) {
+      out[4 + i] = e + ExponentBias;
+      const int64_t d = m - previous;
+      previous = m;
+      uint64_t z = d < 0 ? (uint64_t(-d) << 1) - 1 : uint64_t(d) << 1;
+      for (; z >= 0x80; z >>= 7) mantissas.push_back((z & 0x7f) | 0x80);
+      mantissas.push_back(z);
+    } else {
+      uint64_t bits;
+      memcpy(&bits, values + i, sizeof(bits));
+      for (size_t b = 0; b < 8; ++b) raw.push_back((bits >> (8 * b)) & 0xff);
+    }
+  }
+  out.insert(out.end(), mantissas.begin(), mantissas.end());
+  out.insert(out.end(), raw.begin(), raw.end());
+  const uint32_t size = out.size() - 4;
+  for (size_t b = 0; b < 4; ++b) out[b] = (size >> (8 * b)) & 0xff;
+}
+
+// Inverse of EncodeBlock (without the length).
+bool DecodeBlock(const std::vector<unsigned char>& in, const size_t n,
+                 double* values) {
+  if (in.size() < n) return false;
+  size_t nRaw = 0;
+  for (size_t i = 0; i < n; ++i) {
+    if (in[i] == 0) ++nRaw;
+  }
+  if (in.size() < n + 8 * nRaw) return false;
+  size_t p = n;
+  size_t r = in.size() - 8 * nRaw;
+  const size_t end = r;
+  int64_t previous = 0;
+  for (size_t i = 0; i < n; ++i) {
+    if (in[i] == 0) {
+      uint64_t bits = 0;
+      for (size_t b = 0; b < 8; ++b) bits |= uint64_t(in[r++]) << (8 * b);
+      memcpy(values + i, &bits, sizeof(bits));
+      continue;
+    }
+    uint64_t z = 0;
+    for (unsigned int shift = 0;; shift += 7) {
+      if (p >= end || shift > 63) return false;
+      const unsigned char c = in[p++];
+      z |= uint64_t(c & 0x7f) << shift;
+      if (!(c & 0x80)) break;
+    }
+    const int64_t d = (z & 1) ? -int64_t((z + 1) >> 1) : int64_t(z >> 1);
+    previous += d;
+    values[i] = DecimalValue(previous, int(in[i]) - ExponentBias - 8);
+  }
+  return true;
+}
+
+// Compress a block of bytes and write the output.
+bool Deflate(z_stream& z, std::vector<unsigned char>& in, const int flush,
+             std::ostream& out, uint64_t& nOut) {
+  unsigned char buffer[ChunkSize];
+  z.next_in = in.empty() ? Z_NULL : &in[0];
+  z.avail_in = in.size();
+  do {
+    z.next_out = buffer;
+    z.avail_out = sizeof(buffer);
+    if (deflate(&z, flush) == Z_STREAM_ERROR) return false;
+    const size_t n = sizeof(buffer) - z.avail_out;
+    out.write(reinterpret_cast<const char*>(buffer), n);
+    nOut += n;
+  } while (z.avail_out == 0);
+  return !out.fail();
+}
+
+// Decompress the next n bytes of a stream, reading the input
+// (at most "remaining" bytes) chunk by chunk.
+bool Inflate(z_stream& z, std::istream& in, uint64_t& remaining,
+             std::vector<unsigned char>& chunk, unsigned char* out,
+             const size_t n) {
+  z.next_out = out;
+  z.avail_out = n;
+  while (z.avail_out > 0) {
+    if (z.avail_in == 0) {
+      if (remaining == 0) return false;
+      const size_t nRead = std::min(uint64_t(chunk.size()), remaining);
+      if (!in.read(reinterpret_cast<char*>(&chunk[0]), nRead)) return false;
+      remaining -= nRead;
+      z.next_in = &chunk[0];
+      z.avail_in = nRead;
+    }
+    const int status = inflate(&z, Z_NO_FLUSH);
+    if (status == Z_STREAM_END) return z.avail_out == 0;
+    if (status != Z_OK && status != Z_BUF_ERROR) return false;
+  }
+  return true;
+}
+
+// Decompress and decode the next block of n values.
+bool ReadBlock(z_stream& z, std::istream& in, uint64_t& remaining,
+               std::vector<unsigned char>& chunk,
+               std::vector<unsigned char>& block, const size_t n,
+               double* values) {
+  unsigned char length[4];
+  if (!Inflate(z, in, remaining, chunk, length, 4)) return false;
+  uint32_t size = 0;
+  for (size_t b = 0; b < 4; ++b) size |= uint32_t(length[b]) << (8 * b);
+  block.resize(size);
+  if (size > 0 && !Inflate(z, in, remaining, chunk, &block[0], size)) {
+    return false;
+  }
+  return DecodeBlock(block, n, values);
+}
+
+// Check if two values agree within a relative tolerance.
+bool SameValue(const double x, const double y) {
+  const double tol = 1.e-6;
+  return fabs(x - y) <= tol * std::max(fabs(x), fabs(y)) ||
+         (fabs(x) < 1.e-20 && fabs(y) < 1.e-20);
+}
+
+// Sorted union of two (sorted) grids.
+void MergeGrid(const double* a, const unsigned int na, const double* b,
+               const unsigned int nb, std::vector<double>& grid) {
+  grid.clear();
+  unsigned int i = 0, j = 0;
+  while (i < na || j < nb) {
+    if (j >= nb || (i < na && a[i] < b[j] && !SameValue(a[i], b[j]))) {
+      grid.push_back(a[i++]);
+    } else if (i >= na || (b[j] < a[i] && !SameValue(a[i], b[j]))) {
+      grid.push_back(b[j++]);
+    } else {
+      grid.push_back(a[i++]);
+      ++j;
+    }
+  }
+}
+
+// Index of each point of a grid in the merged grid.
+void MapGrid(const double* a, const unsigned int na,
+             const std::vector<double>& grid, std::vector<unsigned int>& map) {
+  map.assign(na, 0);
+  unsigned int k = 0;
+  for (unsigned int i = 0; i < na; ++i) {
+    while (k < grid.size() && !SameValue(grid[k], a[i])) ++k;
+    map[i] = k;
+  }
+}
+
+// Multiply the values of a column by a factor and add an offset.
+void ScaleColumn(double* col, const unsigned int n, const double scale,
+                 const double shift) {
+  if (!col || (scale == 1. && shift == 0.)) return;
+  for (unsigned int i = 0; i < n; ++i) col[i] = col[i] * scale + shift;
+}
+
+// Gases (gas file numbers and names) with three-body attachment.
+const unsigned int nThreeBodyAttachers = 1;
+const unsigned int ThreeBodyAttachers[nThreeBodyAttachers] = {15};
+const char* ThreeBodyAttacherNames[nThreeBodyAttachers] = {"O2"};
+
+// GASOK bit corresponding to a quantity.
+int GetGasBitIndex(const unsigned int q) {
+  using Garfield::GasTable;
+  switch (q) {
+    case GasTable::VelocityE:
+      return 0;
+    case GasTable::IonMobility:
+      return 1;
+    case GasTable::DiffLong:
+      return 2;
+    case GasTable::Townsend:
+    case GasTable::TownsendNoPenning:
+      return 3;
+    case GasTable::Attachment:
+      return 5;
+    case GasTable::LorentzAngle:
+      return 6;
+    case GasTable::DiffTrans:
+      return 7;
+    case GasTable::VelocityB:
+      return 8;
+    case GasTable::VelocityExB:
+      return 9;
+    case GasTable::IonDissociation:
+      return 11;
+    default:
+      break;
+  }
+  if (q < GasTable::ExcitationRates) return 10;
+  return -1;
+}
+}
+
+namespace Garfield {
+
+// Fixed-size header of the binary format.
+struct GasTable::BinaryHeader {
+  char magic[8];
+  uint32_t formatVersion;
+  uint32_t byteOrder;
+  uint32_t gasFileVersion;
+  uint32_t map3d;
+  uint32_t nE, nAngles, nB;
+  uint32_t nExc, nIon;
+  uint32_t nColumns;
+  char gasBits[24];
+  int32_t extrHigh[nExtrapolation];
+  int32_t extrLow[nExtrapolation];
+  int32_t interp[nExtrapolation];
+  int32_t thresholds[nThresholds];
+  // Offsets [bytes] from the start of the file and sizes.
+  uint64_t dataOffset, dataSize;
+  uint64_t textOffset, textSize;
+  uint64_t fileSize;
+};
+
+GasTable::GasTable()
+    : m_className("GasTable"),
+      m_map3d(false),
+      m_nE(0),
+      m_nAngles(0),
+      m_nB(0),
+      m_nExc(0),
+      m_nIon(0),
+      m_nColumns(0),
+      m_map(NULL),
+      m_mapSize(0),
+      m_data(NULL),
+      m_useLazyLoading(false),
+      m_text(NULL),
+      m_textSize(0),
+      m_debug(false) {
+
+  ResetHeader();
+}
+
+GasTable::~GasTable() { Clear(); }
+
+void GasTable::ResetHeader() {
+
+  m_version = 12;
+  m_gasBits.assign(nGasBits, 'F');
+  m_created = m_identifier = m_clusters = "";
+  m_headerExtra = m_tail = "";
+  for (unsigned int i = 0; i < nExtrapolation; ++i) {
+    m_extrHigh[i] = 1;
+    m_extrLow[i] = 0;
+    m_interp[i] = 2;
+  }
+  for (unsigned int i = 0; i < nThresholds; ++i) m_thresholds[i] = 0;
+}
+
+void GasTable::Clear() {
+
+  if (m_map) munmap(m_map, m_mapSize);
+  m_map = NULL;
+  m_mapSize = 0;
+  m_data = NULL;
+  std::vector<double>().swap(m_store);
+  ReleaseText();
+  ClearDiagnostics();
+  m_map3d = false;
+  m_nE = m_nAngles = m_nB = 0;
+  m_nExc = m_nIon = 0;
+  m_nColumns = 0;
+}
+
+unsigned int GasTable::GetDataSize() const {
+
+  return GetHeaderSize() + m_nColumns * GetNumberOfPoints();
+}
+
+void GasTable::Allocate() {
+
+  const unsigned int nq = ExcitationRates + m_nExc + m_nIon;
+  // In 1D tables each value except alpha0 is followed by a
+  // spline coefficient.
+  m_nColumns = m_map3d ? nq : 2 * nq - 1;
+  m_store.assign(GetDataSize(), 0.);
+  m_data = &m_store[0];
+}
+
+unsigned int GasTable::GetHeaderSize() const {
+
+  return m_nE + m_nAngles + m_nB + nMixture + NumberOfParameters;
+}
+
+void GasTable::ReleaseText() {
+
+  if (m_text) munmap(const_cast<char*>(m_text), m_textSize);
+  m_text = NULL;
+  m_textSize = 0;
+  std::vector<std::vector<double> >().swap(m_columns);
+  std::vector<size_t>().swap(m_blocks);
+}
+
+void GasTable::Materialise() {
+
+  if (!m_text) return;
+  // Decode the remaining columns and switch to contiguous storage.
+  std::vector<double> store(GetDataSize(), 0.);
+  std::copy(m_store.begin(), m_store.end(), store.begin());
+  const unsigned int np = GetNumberOfPoints();
+  for (unsigned int c = 0; c < m_nColumns; ++c) {
+    const double* col = GetColumn(c);
+    std::copy(col, col + np, store.begin() + GetHeaderSize() + c * np);
+  }
+  ReleaseText();
+  m_store.swap(store);
+  m_data = &m_store[0];
+}
+
+void GasTable::MakeWritable() {
+
+  Materialise();
+  if (!m_map) return;
+  m_store.assign(m_data, m_data + GetDataSize());
+  munmap(m_map, m_mapSize);
+  m_map = NULL;
+  m_mapSize = 0;
+  m_data = &m_store[0];
+}
+
+bool GasTable::Initialise(const bool map3d, const std::vector<double>& efields,
+                          const std::vector<double>& angles,
+                          const std::vector<double>& bfields,
+                          const unsigned int nExc, const unsigned int nIon) {
+
+  if (efields.empty() || angles.empty() || bfields.empty()) {
+    std::cerr << m_className << "::Initialise:\n"
+              << "    Empty field grid.\n";
+    return false;
+  }
+  Clear();
+  ResetHeader();
+  m_map3d = map3d;
+  m_nE = efields.size();
+  m_nAngles = angles.size();
+  m_nB = bfields.size();
+  m_nExc = nExc;
+  m_nIon = nIon;
+  Allocate();
+  std::copy(efields.begin(), efields.end(), m_store.begin());
+  std::copy(angles.begin(), angles.end(), m_store.begin() + m_nE);
+  std::copy(bfields.begin(), bfields.end(),
+            m_store.begin() + m_nE + m_nAngles);
+  // Logarithmic quantities default to "not available".
+  const unsigned int np = GetNumberOfPoints();
+  const unsigned int q[4] = {Townsend, TownsendNoPenning, Attachment,
+                             IonDissociation};
+  for (unsigned int i = 0; i < 4; ++i) {
+    double* col = GetWritableQuantity(q[i]);
+    std::fill(col, col + np, -30.);
+  }
+  SetParameter(Pressure, 760.);
+  SetParameter(Temperature, 293.15);
+  return true;
+}
+
+bool GasTable::Merge(const GasTable& other) {
+
+  if (!m_data || !other.m_data) {
+    std::cerr << m_className << "::Merge:\n"
+              << "    Table is empty.\n";
+    return false;
+  }
+  // The tables must describe the same gas.
+  std::string error = "";
+  if (m_map3d != other.m_map3d) {
+    error = "one table is 1D, the other 3D";
+  } else if (m_nExc != other.m_nExc || m_nIon != other.m_nIon ||
+             (!m_headerExtra.empty() && !other.m_headerExtra.empty() &&
+              m_headerExtra != other.m_headerExtra)) {
+    error = "different excitation or ionisation levels";
+  } else if (!SameValue(GetPressure(), other.GetPressure())) {
+    error = "different pressure";
+  } else if (!SameValue(GetTemperature(), other.GetTemperature())) {
+    error = "different temperature";
+  } else {
+    for (unsigned int i = 0; i < nMixture; ++i) {
+      if (SameValue(GetMixture()[i], other.GetMixture()[i])) continue;
+      error = "different gas mixture";
+      break;
+    }
+  }
+  if (!error.empty()) {
+    std::cerr << m_className << "::Merge:\n"
+              << "    Cannot merge tables: " << error << ".\n";
+    return false;
+  }
+
+  // Union of the grids.
+  std::vector<double> efields, angles, bfields;
+  MergeGrid(GetElectricFields(), m_nE, other.GetElectricFields(), other.m_nE,
+            efields);
+  MergeGrid(GetAngles(), m_nAngles, other.GetAngles(), other.m_nAngles,
+            angles);
+  MergeGrid(GetMagneticFields(), m_nB, other.GetMagneticFields(), other.m_nB,
+            bfields);
+  if (!m_map3d && (angles.size() > 1 || bfields.size() > 1)) {
+    std::cerr << m_className << "::Merge:\n"
+              << "    1D tables must have the same B field and angle.\n";
+    return false;
+  }
+  const unsigned int nE = efields.size();
+  const unsigned int nA = angles.size();
+  const unsigned int nB = bfields.size();
+  const unsigned int np = nE * nA * nB;
+
+  // Copy the values of both tables (this one takes precedence).
+  const unsigned int nHeader = nE + nA + nB + nMixture + NumberOfParameters;
+  std::vector<double> store(nHeader + m_nColumns * np, 0.);
+  std::vector<bool> filled(np, false);
+  unsigned int nOverlap = 0;
+  const GasTable* tables[2] = {this, &other};
+  for (unsigned int t = 0; t < 2; ++t) {
+    const GasTable& table = *tables[t];
+    std::vector<unsigned int> mapE, mapA, mapB;
+    MapGrid(table.GetElectricFields(), table.m_nE, efields, mapE);
+    MapGrid(table.GetAngles(), table.m_nAngles, angles, mapA);
+    MapGrid(table.GetMagneticFields(), table.m_nB, bfields, mapB);
+    std::vector<const double*> columns(m_nColumns);
+    for (unsigned int c = 0; c < m_nColumns; ++c) {
+      columns[c] = table.GetColumn(c);
+    }
+    for (unsigned int j = 0; j < table.m_nAngles; ++j) {
+      for (unsigned int k = 0; k < table.m_nB; ++k) {
+        for (unsigned int i = 0; i < table.m_nE; ++i) {
+          const unsigned int index = (mapA[j] * nB + mapB[k]) * nE + mapE[i];
+          if (filled[index]) {
+            ++nOverlap;
+            continue;
+          }
+          filled[index] = true;
+          const unsigned int source = table.GetIndex(i, j, k);
+          for (unsigned int c = 0; c < m_nColumns; ++c) {
+            store[nHeader + c * np + index] = columns[c][source];
+          }
+        }
+      }
+    }
+  }
+  const unsigned int nMissing = std::count(filled.begin(), filled.end(), false);
+  if (nMissing > 0) {
+    std::cerr << m_className << "::Merge:\n"
+              << "    The tables do not cover the combined grid ("
+              << nMissing << " of " << np << " points missing).\n";
+    return false;
+  }
+
+  // Thresholds: the highest field below which one of the tables
+  // has no valid values.
+  int thresholds[nThresholds];
+  for (unsigned int i = 0; i < nThresholds; ++i) {
+    double eThr = -1.;
+    for (unsigned int t = 0; t < 2; ++t) {
+      const int thr = tables[t]->m_thresholds[i];
+      if (thr <= 0 || thr >= (int)tables[t]->m_nE) continue;
+      eThr = std::max(eThr, tables[t]->GetElectricFields()[thr]);
+    }
+    thresholds[i] = 0;
+    while (thresholds[i] < (int)nE - 1 && efields[thresholds[i]] < eThr &&
+           !SameValue(efields[thresholds[i]], eThr)) {
+      ++thresholds[i];
+    }
+  }
+
+  // Grids, mixture and parameters.
+  std::copy(efields.begin(), efields.end(), store.begin());
+  std::copy(angles.begin(), angles.end(), store.begin() + nE);
+  std::copy(bfields.begin(), bfields.end(), store.begin() + nE + nA);
+  std::copy(GetMixture(), GetMixture() + nMixture + NumberOfParameters,
+            store.begin() + nE + nA + nB);
+  // Quantities missing in one of the tables are dropped.
+  for (unsigned int i = 0; i < nGasBits; ++i) {
+    if (GetGasBit(i) && !other.GetGasBit(i)) {
+      if (m_debug) {
+        std::cout << m_className << "::Merge:\n"
+                  << "    GASOK bit " << i + 1
+                  << " is not set in both tables.\n";
+      }
+      m_gasBits[i] = 'F';
+    }
+  }
+  if (m_headerExtra.empty()) m_headerExtra = other.m_headerExtra;
+  for (unsigned int i = 0; i < nThresholds; ++i) {
+    m_thresholds[i] = thresholds[i];
+  }
+
+  // Diagnostics refer to the grid of the original table.
+  ClearDiagnostics();
+  // Switch to the merged table.
+  if (m_map) munmap(m_map, m_mapSize);
+  m_map = NULL;
+  m_mapSize = 0;
+  ReleaseText();
+  m_nE = nE;
+  m_nAngles = nA;
+  m_nB = nB;
+  m_store.swap(store);
+  m_data = &m_store[0];
+  if (m_debug) {
+    std::cout << m_className << "::Merge:\n"
+              << "    Merged table has " << nE << " x " << nA << " x " << nB
+              << " grid points (" << nOverlap << " points in both).\n";
+  }
+  return true;
+}
+
+bool GasTable::Rescale(const double pressure, const double temperature) {
+
+  std::vector<std::string> warnings;
+  if (!Rescale(pressure, temperature, warnings)) return false;
+  if (warnings.empty()) return true;
+  std::cerr << m_className << "::Rescale:\n";
+  for (unsigned int i = 0; i < warnings.size(); ++i) {
+    std::cerr << "    Warning: " << warnings[i] << ".\n";
+  }
+  return true;
+}
+
+bool GasTable::Rescale(const double pressure, const double temperature,
+                       std::vector<std::string>& warnings) {
+
+  warnings.clear();
+  const double p0 = GetPressure();
+  const double t0 = GetTemperature();
+  if (!m_data || p0 <= 0. || t0 <= 0.) {
+    std::cerr << m_className << "::Rescale:\n"
+              << "    Table is empty or has no valid pressure/temperature.\n";
+    return false;
+  }
+  if (pressure <= 0. || temperature <= 0.) {
+    std::cerr << m_className << "::Rescale:\n"
+              << "    Pressure and temperature must be positive.\n";
+    return false;
+  }
+  // Ratio of the gas densities N (ideal gas), and factor between
+  // the values per unit pressure at the same E/N.
+  const double r = (pressure * t0) / (p0 * temperature);
+  const double g = t0 / temperature;
+
+  // Quantities not following the similarity laws.
+  std::ostringstream msg;
+  if (!SameValue(r, 1.)) {
+    if (HasQuantity(Attachment)) {
+      for (unsigned int i = 0; i < nThreeBodyAttachers; ++i) {
+        if (GetMixture()[ThreeBodyAttachers[i] - 1] <= 0.) continue;
+        msg.str("");
+        msg << "the attachment coefficient of " << ThreeBodyAttacherNames[i]
+            << " includes three-body attachment (eta / N proportional to N)"
+            << ", rescaled values are only valid near the original density";
+        warnings.push_back(msg.str());
+      }
+    }
+    if (HasQuantity(Townsend)) {
+      const double* alpha = GetQuantity(Townsend);
+      const double* alpha0 = GetQuantity(TownsendNoPenning);
+      const unsigned int np = GetNumberOfPoints();
+      for (unsigned int i = 0; i < np; ++i) {
+        if (SameValue(alpha[i], alpha0[i])) continue;
+        warnings.push_back(
+            "the Townsend coefficient includes Penning transfer, "
+            "the transfer probability depends on the pressure");
+        break;
+      }
+    }
+    if (m_nExc + m_nIon > 0) {
+      warnings.push_back(
+          "excitation and ionisation rates are scaled with the density");
+    }
+    if (m_nB > 1 || GetMagneticFields()[0] != 0.) {
+      msg.str("");
+      msg << "magnetic fields are scaled by " << r << " (constant B/N)";
+      warnings.push_back(msg.str());
+    }
+  }
+  if (!SameValue(g, 1.)) {
+    msg.str("");
+    msg << "the temperature changes from " << t0 << " to " << temperature
+        << " K, values at low E/N (near-thermal electrons) are approximate";
+    warnings.push_back(msg.str());
+  }
+
+  MakeWritable();
+  // Diagnostics refer to the original fields.
+  ClearDiagnostics();
+  // Reduced fields E/p at the same E/N, B fields at the same B/N.
+  ScaleColumn(const_cast<double*>(GetElectricFields()), m_nE, g, 0.);
+  ScaleColumn(const_cast<double*>(GetMagneticFields()), m_nB, r, 0.);
+
+  // Velocities and the Lorentz angle are functions of E/N and B/N,
+  // diffusion coefficients and mobilities scale like 1 / N,
+  // the Townsend, attachment and dissociation coefficients like N.
+  const unsigned int np = GetNumberOfPoints();
+  const unsigned int nq = GetNumberOfQuantities();
+  for (unsigned int q = 0; q < nq; ++q) {
+    double scale = 1.;
+    double shift = 0.;
+    switch (q) {
+      case VelocityE:
+      case VelocityB:
+      case VelocityExB:
+      case LorentzAngle:
+        continue;
+      case DiffLong:
+      case DiffTrans:
+        scale = 1. / sqrt(g);
+        break;
+      case Townsend:
+      case TownsendNoPenning:
+      case Attachment:
+      case IonDissociation:
+        shift = log(g);
+        break;
+      case IonMobility:
+        scale = 1. / r;
+        break;
+      default:
+        // Diffusion tensor (times p) and rates.
+        scale = q < ExcitationRates ? 1. / g : r;
+        break;
+    }
+    if (scale == 1. && shift == 0.) continue;
+    ScaleColumn(GetWritableQuantity(q), np, scale, shift);
+    // The spline coefficients of 1D tables (not used by Medium,
+    // written as zero by Garfield++) are no longer valid.
+    if (!m_map3d && q != TownsendNoPenning) {
+      double* spline = GetWritableColumn(GetColumnIndex(q) + 1);
+      std::fill(spline, spline + np, 0.);
+    }
+  }
+
+  // Gas parameters.
+  double* parameters = const_cast<double*>(GetMixture()) + nMixture;
+  const double sqrg = sqrt(g);
+  parameters[IonDiffLong] /= sqrg;
+  parameters[IonDiffTrans] /= sqrg;
+  parameters[ClusterMean] *= r;
+  parameters[Density] *= r;
+  parameters[Pressure] = pressure;
+  parameters[Temperature] = temperature;
+  if (m_debug) {
+    std::cout << m_className << "::Rescale:\n"
+              << "    p = " << p0 << " -> " << pressure << " Torr, T = " << t0
+              << " -> " << temperature << " K (density ratio " << r
+              << ").\n";
+  }
+  return true;
+}
+
+bool GasTable::Interpolate(const std::vector<const GasTable*>& tables,
+                           const unsigned int component,
+                           const double percentage, GasTable& result,
+                           GasTable& errors) {
+
+  const std::string hdr = result.m_className + "::Interpolate:\n";
+  const unsigned int n = tables.size();
+  if (n < 2 || component >= nMixture) {
+    std::cerr << hdr << "    Need at least two tables and a valid gas.\n";
+    return false;
+  }
+  for (unsigned int t = 0; t < n; ++t) {
+    if (tables[t] && tables[t]->m_data) continue;
+    std::cerr << hdr << "    Table " << t << " is empty.\n";
+    return false;
+  }
+  // Proportions of the other gases.
+  const GasTable& first = *tables[0];
+  std::vector<double> proportions(nMixture, 0.);
+  double rest = 0.;
+  for (unsigned int i = 0; i < nMixture; ++i) {
+    if (i != component) rest += first.GetMixture()[i];
+  }
+  for (unsigned int i = 0; i < nMixture; ++i) {
+    if (i != component && rest > 0.) {
+      proportions[i] = first.GetMixture()[i] / rest;
+    }
+  }
+
+  // The tables must differ only in the fraction of the component.
+  std::vector<std::pair<double, unsigned int> > nodes;
+  for (unsigned int t = 0; t < n; ++t) {
+    const GasTable& table = *tables[t];
+    std::string error = "";
+    if (table.m_map3d != first.m_map3d || table.m_nE != first.m_nE ||
+        table.m_nAngles != first.m_nAngles || table.m_nB != first.m_nB) {
+      error = "different grid dimensions";
+    } else if (table.m_nExc != first.m_nExc || table.m_nIon != first.m_nIon ||
+               table.m_headerExtra != first.m_headerExtra) {
+      error = "different excitation or ionisation levels";
+    } else if (!SameValue(table.GetPressure(), first.GetPressure()) ||
+               !SameValue(table.GetTemperature(), first.GetTemperature())) {
+      error = "different pressure or temperature";
+    }
+    const unsigned int nGrid = first.m_nE + first.m_nAngles + first.m_nB;
+    for (unsigned int i = 0; i < nGrid && error.empty(); ++i) {
+      if (!SameValue(table.m_data[i], first.m_data[i])) {
+        error = "different field grid";
+      }
+    }
+    double other = 0.;
+    for (unsigned int i = 0; i < nMixture; ++i) {
+      if (i != component) other += table.GetMixture()[i];
+    }
+    for (unsigned int i = 0; i < nMixture && error.empty(); ++i) {
+      if (i == component) continue;
+      const double f = other > 0. ? table.GetMixture()[i] / other : 0.;
+      if (!SameValue(f, proportions[i])) {
+        error = "mixture differs in more than one gas";
+      }
+    }
+    const double x = table.GetMixture()[component];
+    for (unsigned int k = 0; k < nodes.size() && error.empty(); ++k) {
+      if (SameValue(nodes[k].first, x)) error = "same fraction as another";
+    }
+    if (!error.empty()) {
+      std::cerr << hdr << "    Table " << t << ": " << error << ".\n";
+      return false;
+    }
+    nodes.push_back(std::make_pair(x, t));
+  }
+  std::sort(nodes.begin(), nodes.end());
+  const double x = percentage;
+  if (x < nodes.front().first - 1.e-6 || x > nodes.back().first + 1.e-6) {
+    std::cerr << hdr << "    Fraction " << x << "% is outside the range of "
+              << "the tables (" << nodes.front().first << " - "
+              << nodes.back().first << "%).\n";
+    return false;
+  }
+
+  // Bracketing tables a, b and (if available) the nearest
+  // other one c for the quadratic term.
+  unsigned int j = 0;
+  while (j + 2 < n && x > nodes[j + 1].first) ++j;
+  int exact = -1;
+  if (SameValue(x, nodes[j].first)) exact = j;
+  if (SameValue(x, nodes[j + 1].first)) exact = j + 1;
+  int k = -1;
+  if (n > 2) {
+    if (j == 0) {
+      k = 2;
+    } else if (j + 2 >= n) {
+      k = j - 1;
+    } else {
+      k = x - nodes[j - 1].first < nodes[j + 2].first - x ? j - 1 : j + 2;
+    }
+  }
+  const GasTable& a = *tables[nodes[j].second];
+  const GasTable& b = *tables[nodes[j + 1].second];
+  const GasTable* c = k < 0 ? NULL : tables[nodes[k].second];
+  const double xa = nodes[j].first;
+  const double xb = nodes[j + 1].first;
+  const double xc = k < 0 ? 0. : nodes[k].first;
+  const double wb = (x - xa) / (xb - xa);
+  const double wa = 1. - wb;
+  // Level of log(alpha / p) etc. meaning "no value".
+  const double floor = -30. - log(first.GetPressure());
+
+  // Set up the tables (grid of the first one).
+  std::vector<double> efields(first.GetElectricFields(),
+                              first.GetElectricFields() + first.m_nE);
+  std::vector<double> angles(first.GetAngles(),
+                             first.GetAngles() + first.m_nAngles);
+  std::vector<double> bfields(first.GetMagneticFields(),
+                              first.GetMagneticFields() + first.m_nB);
+  if (!result.Initialise(first.m_map3d, efields, angles, bfields,
+                         first.m_nExc, first.m_nIon)) {
+    return false;
+  }
+  errors.Clear();
+  if (c && !errors.Initialise(first.m_map3d, efields, angles, bfields,
+                              first.m_nExc, first.m_nIon)) {
+    return false;
+  }
+  const unsigned int np = result.GetNumberOfPoints();
+  const unsigned int nq = result.GetNumberOfQuantities();
+  for (unsigned int q = 0; q < nq; ++q) {
+    const unsigned int col = result.GetColumnIndex(q);
+    double* y = result.GetWritableColumn(col);
+    double* e = c ? errors.GetWritableColumn(col) : NULL;
+    if (e) std::fill(e, e + np, 0.);
+    if (exact >= 0) {
+      const double* ye = tables[nodes[exact].second]->GetColumn(col);
+      std::copy(ye, ye + np, y);
+      continue;
+    }
+    const bool logarithmic = q == Townsend || q == TownsendNoPenning ||
+                             q == Attachment || q == IonDissociation;
+    const double* ya = a.GetColumn(col);
+    const double* yb = b.GetColumn(col);
+    const double* yc = c ? c->GetColumn(col) : NULL;
+    for (unsigned int i = 0; i < np; ++i) {
+      double va = ya[i], vb = yb[i];
+      double vc = yc ? yc[i] : 0.;
+      // Blend the coefficients rather than their logarithms
+      // where one of the tables has no value.
+      const bool linear = logarithmic &&
+          std::min(std::min(va, vb), yc ? vc : va) < floor + 1.e-3;
+      if (linear) {
+        va = exp(va);
+        vb = exp(vb);
+        vc = exp(vc);
+      }
+      const double v1 = wa * va + wb * vb;
+      double v2 = v1;
+      if (yc) {
+        // Second divided difference (Newton form).
+        const double dab = (vb - va) / (xb - xa);
+        const double d2 = k < (int)j
+            ? (dab - (va - vc) / (xa - xc)) / (xb - xc)
+            : ((vc - vb) / (xc - xb) - dab) / (xc - xa);
+        v2 += d2 * (x - xa) * (x - xb);
+      }
+      if (linear) {
+        const double y1 = log(std::max(v1, exp(floor)));
+        const double y2 = log(std::max(v2, exp(floor)));
+        // Keep the linear value if the quadratic term makes it negative.
+        y[i] = v2 > 0. ? y2 : y1;
+        if (e) e[i] = fabs(y2 - y1);
+      } else {
+        y[i] = v2;
+        if (e) e[i] = fabs(v2 - v1);
+      }
+    }
+  }
+
+  // Composition, parameters (linear) and settings.
+  for (unsigned int i = 0; i < nMixture; ++i) {
+    const double f = i == component ? x : proportions[i] * (100. - x);
+    result.SetMixture(i, f);
+    if (c) errors.SetMixture(i, f);
+  }
+  for (unsigned int i = 0; i < NumberOfParameters; ++i) {
+    double v = wa * a.GetParameter(i) + wb * b.GetParameter(i);
+    if (exact >= 0) v = tables[nodes[exact].second]->GetParameter(i);
+    result.SetParameter(i, v);
+    if (c) errors.SetParameter(i, i == Pressure || i == Temperature ? v : 0.);
+  }
+  GasTable* targets[2] = {&result, c ? &errors : NULL};
+  for (unsigned int t = 0; t < 2; ++t) {
+    if (!targets[t]) continue;
+    GasTable& target = *targets[t];
+    target.m_version = first.m_version;
+    target.m_headerExtra = first.m_headerExtra;
+    target.m_tail = first.m_tail;
+    target.m_clusters = first.m_clusters;
+    // Quantities are available if they are present in all tables.
+    for (unsigned int i = 0; i < nGasBits; ++i) {
+      bool on = true;
+      for (unsigned int m = 0; m < n; ++m) on = on && tables[m]->GetGasBit(i);
+      target.SetGasBit(i, on);
+    }
+    for (unsigned int i = 0; i < nExtrapolation; ++i) {
+      target.m_extrLow[i] = first.m_extrLow[i];
+      target.m_extrHigh[i] = first.m_extrHigh[i];
+      target.m_interp[i] = first.m_interp[i];
+    }
+    for (unsigned int i = 0; i < nThresholds; ++i) {
+      int thr = 0;
+      for (unsigned int m = 0; m < n; ++m) {
+        thr = std::max(thr, tables[m]->m_thresholds[i]);
+      }
+      target.m_thresholds[i] = thr;
+    }
+  }
+  std::ostringstream identifier;
+  identifier << "Interpolated between " << n << " tables, gas " << component + 1
+             << " at " << x << "%";
+  result.SetIdentifier(identifier.str());
+  if (c) errors.SetIdentifier("Error estimate, " + identifier.str());
+  return true;
+}
+
+unsigned int GasTable::GetColumnIndex(const unsigned int q) const {
+
+  if (m_map3d) return q;
+  if (q <= Townsend) return 2 * q;
+  if (q == TownsendNoPenning) return 2 * q;
+  return 2 * q - 1;
+}
+
+const double* GasTable::GetColumn(const unsigned int c) const {
+
+  if (!m_data || c >= m_nColumns) return NULL;
+  if (m_text) {
+    if (m_columns[c].empty()) DecodeColumn(c);
+    return &m_columns[c][0];
+  }
+  return GetMixture() + nMixture + NumberOfParameters +
+         c * GetNumberOfPoints();
+}
+
+double* GasTable::GetWritableColumn(const unsigned int c) {
+
+  if (!m_data || c >= m_nColumns) return NULL;
+  MakeWritable();
+  return const_cast<double*>(GetColumn(c));
+}
+
+double GasTable::GetValue(const unsigned int q, const unsigned int ie,
+                          const unsigned int ia, const unsigned int ib) const {
+
+  const double* col = GetQuantity(q);
+  if (!col || ie >= m_nE || ia >= m_nAngles || ib >= m_nB) return 0.;
+  return col[GetIndex(ie, ia, ib)];
+}
+
+bool GasTable::SetValue(const unsigned int q, const unsigned int ie,
+                        const unsigned int ia, const unsigned int ib,
+                        const double v) {
+
+  if (ie >= m_nE || ia >= m_nAngles || ib >= m_nB) return false;
+  double* col = GetWritableQuantity(q);
+  if (!col) return false;
+  col[GetIndex(ie, ia, ib)] = v;
+  return true;
+}
+
+void GasTable::SetMixture(const unsigned int i, const double f) {
+
+  if (!m_data || i >= nMixture) return;
+  MakeWritable();
+  const_cast<double*>(GetMixture())[i] = f;
+}
+
+void GasTable::SetParameter(const unsigned int i, const double value) {
+
+  if (!m_data || i >= NumberOfParameters) return;
+  MakeWritable();
+  const_cast<double*>(GetMixture())[nMixture + i] = value;
+}
+
+void GasTable::SetGasBit(const unsigned int i, const bool on) {
+
+  if (i < nGasBits) m_gasBits[i] = on ? 'T' : 'F';
+}
+
+bool GasTable::HasQuantity(const unsigned int q) const {
+
+  if (q >= GetNumberOfQuantities()) return false;
+  if (q >= ExcitationRates) {
+    return GetGasBit(q < ExcitationRates + m_nExc ? 14 : 15);
+  }
+  return GetGasBit(GetGasBitIndex(q));
+}
+
+void GasTable::SetQuantity(const unsigned int q, const bool on) {
+
+  if (q >= ExcitationRates) {
+    SetGasBit(q < ExcitationRates + m_nExc ? 14 : 15, on);
+    return;
+  }
+  SetGasBit(GetGasBitIndex(q), on);
+}
+
+void GasTable::SetExtrapolation(const unsigned int i, const int low,
+                                const int high) {
+
+  if (i >= nExtrapolation) return;
+  m_extrLow[i] = low;
+  m_extrHigh[i] = high;
+}
+
+void GasTable::SetInterpolation(const unsigned int i, const int n) {
+
+  if (i < nExtrapolation) m_interp[i] = n;
+}
+
+void GasTable::SetThreshold(const unsigned int i, const int ie) {
+
+  if (i < nThresholds) m_thresholds[i] = ie;
+}
+
+bool GasTable::SetDiagnostics(const std::vector<std::string>& names,
+                              const std::vector<double>& values) {
+
+  const unsigned int np = GetNumberOfPoints();
+  if (!m_data || names.empty() || values.size() != names.size() * np) {
+    std::cerr << m_className << "::SetDiagnostics:\n"
+              << "    Expected " << np << " values for each of the "
+              << names.size() << " quantities.\n";
+    return false;
+  }
+  for (unsigned int i = 0; i < names.size(); ++i) {
+    if (!names[i].empty() &&
+        names[i].find_first_of(" \t\r\n") == std::string::npos) {
+      continue;
+    }
+    std::cerr << m_className << "::SetDiagnostics:\n"
+              << "    Names must be non-empty and without blanks.\n";
+    return false;
+  }
+  m_diagNames = names;
+  m_diagValues = values;
+  return true;
+}
+
+void GasTable::ClearDiagnostics() {
+
+  std::vector<std::string>().swap(m_diagNames);
+  std::vector<double>().swap(m_diagValues);
+}
+
+const double* GasTable::GetDiagnostic(const std::string& name) const {
+
+  for (unsigned int i = 0; i < m_diagNames.size(); ++i) {
+    if (m_diagNames[i] == name) {
+      return &m_diagValues[i * GetNumberOfPoints()];
+    }
+  }
+  return NULL;
+}
+
+std::string GasTable::FormatDiagnostics() const {
+
+  if (m_diagNames.empty()) return "";
+  // Same record layout as the tables: one block per E point.
+  std::ostringstream out;
+  const unsigned int nd = m_diagNames.size();
+  out << " Diagnostics: " << nd << "\n";
+  for (unsigned int d = 0; d < nd; ++d) out << " " << m_diagNames[d];
+  out << "\n";
+  const unsigned int np = GetNumberOfPoints();
+  for (unsigned int i = 0; i < m_nE; ++i) {
+    unsigned int n = 0;
+    for (unsigned int j = 0; j < m_nAngles; ++j) {
+      for (unsigned int k = 0; k < m_nB; ++k) {
+        const unsigned int index = GetIndex(i, j, k);
+        for (unsigned int d = 0; d < nd; ++d) {
+          WriteNumber(out, m_diagValues[d * np + index]);
+          if (++n % 8 == 0) out << "\n";
+        }
+      }
+    }
+    if (n % 8 != 0) out << "\n";
+  }
+  return out.str();
+}
+
+void GasTable::ExtractDiagnostics() {
+
+  ClearDiagnostics();
+  const char* key = " Diagnostics:";
+  size_t pos = 0;
+  if (!StartsWith(m_tail, key)) {
+    pos = m_tail.find(std::string("\n") + key);
+    if (pos == std::string::npos) return;
+    ++pos;
+  }
+  const char* p = m_tail.data() + pos;
+  const char* end = m_tail.data() + m_tail.size();
+  std::string line, names;
+  int nd = 0;
+  if (!GetLine(p, end, line) || !GetLine(p, end, names)) return;
+  ReadIntegers(AfterColon(line), &nd, 1);
+  std::vector<std::string> labels;
+  std::istringstream data(names);
+  std::string label;
+  while (data >> label) labels.push_back(label);
+  if (nd <= 0 || (int)labels.size() != nd) return;
+  const unsigned int np = GetNumberOfPoints();
+  std::vector<double> values(nd * np, 0.);
+  for (unsigned int i = 0; i < m_nE; ++i) {
+    for (unsigned int j = 0; j < m_nAngles; ++j) {
+      for (unsigned int k = 0; k < m_nB; ++k) {
+        const unsigned int index = GetIndex(i, j, k);
+        for (int d = 0; d < nd; ++d) {
+          // Incomplete sections are kept in the trailer as they are.
+          if (!ParseNumber(p, end, values[d * np + index])) return;
+        }
+      }
+    }
+  }
+  GetLine(p, end, line);
+  m_tail.erase(pos, p - (m_tail.data() + pos));
+  m_diagNames.swap(labels);
+  m_diagValues.swap(values);
+}
+
+bool GasTable::IsBinaryFile(const std::string& filename) {
+
+  std::ifstream infile(filename.c_str(), std::ios::binary);
+  char magic[8];
+  if (!infile.read(magic, sizeof(magic))) return false;
+  return memcmp(magic, BinaryMagic, sizeof(magic)) == 0;
+}
+
+bool GasTable::IsCompressedFile(const std::string& filename) {
+
+  std::ifstream infile(filename.c_str(), std::ios::binary);
+  char magic[8];
+  if (!infile.read(magic, sizeof(magic))) return false;
+  return memcmp(magic, CompressedMagic, sizeof(magic)) == 0;
+}
+
+bool GasTable::IsThreeBodyAttacher(const std::string& gas) {
+
+  for (unsigned int i = 0; i < nThreeBodyAttachers; ++i) {
+    if (gas == ThreeBodyAttacherNames[i]) return true;
+  }
+  return false;
+}
+
+bool GasTable::Load(const std::string& filename) {
+
+  if (IsBinaryFile(filename)) return LoadBinary(filename);
+  if (IsCompressedFile(filename)) return LoadCompressed(filename);
+  return LoadText(filename);
+}
+
+bool GasTable::LoadText(const std::string& filename) {
+
+  // Read the file in one go (or map it, if the columns are to be
+  // decoded on demand) and decode it from memory.
+  std::string buffer;
+  const char* p = NULL;
+  const char* end = NULL;
+  if (m_useLazyLoading) {
+    Clear();
+    if (!MapText(filename)) {
+      std::cerr << m_className << "::LoadText:\n"
+                << "    Cannot map file " << filename << ".\n";
+      return false;
+    }
+    p = m_text;
+    end = m_text + m_textSize;
+  } else {
+    if (!ReadFile(filename, buffer)) {
+      std::cerr << m_className << "::LoadText:\n"
+                << "    Cannot open file " << filename << ".\n";
+      return false;
+    }
+    Clear();
+    p = buffer.data();
+    end = p + buffer.size();
+  }
+  if (!ParseHeader(p, end)) {
+    std::cerr << m_className << "::LoadText:\n"
+              << "    " << filename << " is not a valid gas file.\n";
+    Clear();
+    return false;
+  }
+  if (m_debug) {
+    std::cout << m_className << "::LoadText:\n"
+              << "    Version " << m_version << ", " << m_nE << " x "
+              << m_nAngles << " x " << m_nB << " grid points.\n";
+  }
+  Allocate();
+  if (!ParseGrid(p, end, &m_store[0])) {
+    std::cerr << m_className << "::LoadText:\n"
+              << "    Error reading the header of " << filename << ".\n";
+    Clear();
+    return false;
+  }
+  if (m_text && IndexTables(p, end)) {
+    // Keep only the grids and parameters, the columns are
+    // decoded from the mapped file when they are first requested.
+    std::vector<double>(m_store.begin(),
+                        m_store.begin() + GetHeaderSize()).swap(m_store);
+    m_data = &m_store[0];
+    m_columns.resize(m_nColumns);
+    ParseTrailer(p, end, &m_store[m_nE + m_nAngles + m_nB + nMixture]);
+    if (m_debug) {
+      std::cout << m_className << "::LoadText:\n"
+                << "    Columns will be decoded on demand.\n";
+    }
+    return true;
+  }
+  double* parameters = &m_store[m_nE + m_nAngles + m_nB + nMixture];
+  double* columns = parameters + NumberOfParameters;
+  unsigned int ie = 0;
+  if (!ParseTables(p, end, columns, ie)) {
+    std::cerr << m_className << "::LoadText:\n"
+              << "    Error reading the table at E point " << ie << " in "
+              << filename << ".\n";
+    Clear();
+    return false;
+  }
+  ParseTrailer(p, end, parameters);
+  // Not in fixed-width layout, everything has been decoded.
+  ReleaseText();
+  return true;
+}
+
+bool GasTable::MapText(const std::string& filename) {
+
+  const int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) return false;
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+    close(fd);
+    return false;
+  }
+  const size_t size = info.st_size;
+  void* map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) return false;
+  m_text = static_cast<const char*>(map);
+  m_textSize = size;
+  return true;
+}
+
+bool GasTable::IndexTables(const char*& p, const char* end) {
+
+  // Files written by Garfield have fixed-width fields (15 characters,
+  // 8 per line, one block of lines per E point). Record where each
+  // block starts and check that every line ends where expected;
+  // otherwise the file has to be decoded sequentially.
+  const size_t nPerBlock = m_nAngles * m_nB * m_nColumns;
+  const size_t nLines = nPerBlock / 8;
+  const size_t rest = nPerBlock % 8;
+  const size_t blockSize =
+      nLines * LineLength + (rest > 0 ? rest * FieldWidth + 1 : 0);
+  std::vector<size_t> blocks(m_nE);
+  size_t offset = p - m_text;
+  for (unsigned int i = 0; i < m_nE; ++i) {
+    const char* block = m_text + offset;
+    if (blockSize > size_t(end - block)) return false;
+    for (size_t j = 1; j <= nLines; ++j) {
+      if (block[j * LineLength - 1] != '\n') return false;
+    }
+    if (rest > 0 && block[blockSize - 1] != '\n') return false;
+    blocks[i] = offset;
+    offset += blockSize;
+  }
+  m_blocks.swap(blocks);
+  p = m_text + offset;
+  return true;
+}
+
+void GasTable::DecodeColumn(const unsigned int c) const {
+
+  const unsigned int np = GetNumberOfPoints();
+  std::vector<double>& column = m_columns[c];
+  column.assign(np, 0.);
+  for (unsigned int i = 0; i < m_nE; ++i) {
+    const char* block = m_text + m_blocks[i];
+    for (unsigned int j = 0; j < m_nAngles; ++j) {
+      for (unsigned int k = 0; k < m_nB; ++k) {
+        const size_t n = (j * m_nB + k) * m_nColumns + c;
+        const char* q = block + (n / 8) * LineLength + (n % 8) * FieldWidth;
+        if (!ParseNumber(q, q + FieldWidth, column[GetIndex(i, j, k)]) &&
+            m_debug) {
+          std::cerr << m_className << "::DecodeColumn:\n"
+                    << "    Cannot read column " << c << " at E point " << i
+                    << ".\n";
+        }
+      }
+    }
+  }
+}
+
+bool GasTable::ParseHeader(const char*& p, const char* end) {
+
+  ResetHeader();
+  m_map3d = false;
+  m_nE = m_nAngles = m_nB = m_nExc = m_nIon = 0;
+  std::string line;
+  bool hasDimension = false;
+  while (GetLine(p, end, line)) {
+    if (line.empty() || line[0] == '*') continue;
+    if (line[0] == '%') {
+      m_created = line;
+    } else if (StartsWith(line, " Version")) {
+      m_version = strtol(AfterColon(line).c_str(), NULL, 10);
+    } else if (StartsWith(line, " GASOK bits")) {
+      m_gasBits = Trim(AfterColon(line));
+      m_gasBits.resize(nGasBits, 'F');
+    } else if (StartsWith(line, " Identifier")) {
+      m_identifier = Trim(AfterColon(line));
+    } else if (StartsWith(line, " Clusters")) {
+      m_clusters = Trim(AfterColon(line));
+    } else if (StartsWith(line, " Dimension")) {
+      const std::string dimension = Trim(AfterColon(line));
+      m_map3d = !dimension.empty() && dimension[0] == 'T';
+      int n[5] = {0, 0, 0, 0, 0};
+      if (!dimension.empty()) ReadIntegers(dimension.substr(1), n, 5);
+      for (unsigned int i = 0; i < 5; ++i) n[i] = std::max(n[i], 0);
+      m_nE = n[0];
+      m_nAngles = n[1];
+      m_nB = n[2];
+      m_nExc = n[3];
+      m_nIon = n[4];
+      hasDimension = true;
+    } else if (StartsWith(line, " E fields")) {
+      return hasDimension && m_nE > 0 && m_nAngles > 0 && m_nB > 0;
+    } else if (hasDimension) {
+      m_headerExtra += line + "\n";
+    }
+  }
+  return false;
+}
+
+bool GasTable::ParseGrid(const char*& p, const char* end, double* grid) const {
+
+  // E fields, angles, B fields and mixture are stored consecutively.
+  std::string line;
+  bool ok = ReadNumbers(p, end, grid, m_nE);
+  ok = ok && NextLine(p, end, line) && StartsWith(line, " E-B angles");
+  ok = ok && ReadNumbers(p, end, grid + m_nE, m_nAngles);
+  ok = ok && NextLine(p, end, line) && StartsWith(line, " B fields");
+  ok = ok && ReadNumbers(p, end, grid + m_nE + m_nAngles, m_nB);
+  ok = ok && NextLine(p, end, line) && StartsWith(line, " Mixture");
+  ok = ok && ReadNumbers(p, end, grid + m_nE + m_nAngles + m_nB, nMixture);
+  ok = ok && NextLine(p, end, line) && StartsWith(line, " The gas tables");
+  return ok;
+}
+
+bool GasTable::ParseTables(const char*& p, const char* end, double* columns,
+                           unsigned int& ie) const {
+
+  // Records are ordered by E, angle, B.
+  const unsigned int np = GetNumberOfPoints();
+  for (ie = 0; ie < m_nE; ++ie) {
+    for (unsigned int j = 0; j < m_nAngles; ++j) {
+      for (unsigned int k = 0; k < m_nB; ++k) {
+        const unsigned int index = GetIndex(ie, j, k);
+        for (unsigned int c = 0; c < m_nColumns; ++c) {
+          if (!ParseNumber(p, end, columns[c * np + index])) return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+void GasTable::ParseTrailer(const char*& p, const char* end,
+                            double* parameters) {
+
+  parameters[Pressure] = 760.;
+  parameters[Temperature] = 293.15;
+  m_tail = "";
+  std::string line;
+  bool tail = false;
+  while (GetLine(p, end, line)) {
+    if (tail) {
+      m_tail += line + "\n";
+    } else if (StartsWith(line, " H Extr")) {
+      ReadIntegers(AfterColon(line), m_extrHigh, nExtrapolation);
+    } else if (StartsWith(line, " L Extr")) {
+      ReadIntegers(AfterColon(line), m_extrLow, nExtrapolation);
+    } else if (StartsWith(line, " Thresholds")) {
+      ReadIntegers(AfterColon(line), m_thresholds, nThresholds);
+    } else if (StartsWith(line, " Interp")) {
+      ReadIntegers(AfterColon(line), m_interp, nExtrapolation);
+    } else if (StartsWith(line, " A ")) {
+      ReadAssignments(line, parameters + AtomicWeight, 4);
+    } else if (StartsWith(line, " Ion diffusion")) {
+      const std::string values = AfterColon(line);
+      const char* q = values.data();
+      const char* last = q + values.size();
+      ParseNumber(q, last, parameters[IonDiffLong]);
+      ParseNumber(q, last, parameters[IonDiffTrans]);
+    } else if (StartsWith(line, " CMEAN")) {
+      ReadAssignments(line, parameters + ClusterMean, 4);
+      tail = true;
+    } else if (!Trim(line).empty()) {
+      m_tail += line + "\n";
+    }
+  }
+  ExtractDiagnostics();
+}
+
+bool GasTable::ReadHeader(const std::string& filename, Header& header) {
+
+  GasTable table;
+  std::vector<double> grid;
+  if (IsBinaryFile(filename) || IsCompressedFile(filename)) {
+    // Read the fixed header and the beginning of the data section.
+    std::ifstream infile(filename.c_str(), std::ios::binary);
+    BinaryHeader bh;
+    if (!infile.read(reinterpret_cast<char*>(&bh), sizeof(bh)) ||
+        bh.byteOrder != ByteOrderMark ||
+        bh.formatVersion != BinaryFormatVersion) {
+      return false;
+    }
+    const bool compressed =
+        memcmp(bh.magic, CompressedMagic, sizeof(bh.magic)) == 0;
+    header.binary = true;
+    table.m_version = bh.gasFileVersion;
+    table.m_gasBits.assign(bh.gasBits, nGasBits);
+    table.m_map3d = bh.map3d != 0;
+    table.m_nE = bh.nE;
+    table.m_nAngles = bh.nAngles;
+    table.m_nB = bh.nB;
+    grid.resize(bh.nE + bh.nAngles + bh.nB + nMixture + NumberOfParameters);
+    infile.seekg(bh.dataOffset);
+    if (compressed) {
+      // The grids are the first block of the compressed stream.
+      z_stream z;
+      memset(&z, 0, sizeof(z));
+      if (inflateInit(&z) != Z_OK) return false;
+      uint64_t remaining = bh.textOffset - bh.dataOffset;
+      std::vector<unsigned char> chunk(ChunkSize);
+      std::vector<unsigned char> block;
+      const bool ok = ReadBlock(z, infile, remaining, chunk, block,
+                                grid.size(), &grid[0]);
+      inflateEnd(&z);
+      if (!ok) return false;
+    } else if (!infile.read(reinterpret_cast<char*>(&grid[0]),
+                            grid.size() * sizeof(double))) {
+      return false;
+    }
+    // The identifier is the second string of the text section.
+    std::vector<char> text(bh.textSize);
+    infile.seekg(bh.textOffset);
+    if (bh.textSize > 0 && !infile.read(&text[0], bh.textSize)) return false;
+    const char* q = bh.textSize > 0 ? &text[0] : NULL;
+    const char* last = q + bh.textSize;
+    std::string created;
+    if (!ReadString(q, last, created) ||
+        !ReadString(q, last, table.m_identifier)) {
+      return false;
+    }
+  } else {
+    // Read the text up to the start of the tables ...
+    FILE* f = fopen(filename.c_str(), "rb");
+    if (!f) return false;
+    std::string buffer;
+    char block[16384];
+    size_t n = 0;
+    while ((n = fread(block, 1, sizeof(block), f)) > 0) {
+      buffer.append(block, n);
+      if (buffer.find("The gas tables follow") != std::string::npos) break;
+    }
+    const char* p = buffer.data();
+    const char* end = p + buffer.size();
+    header.binary = false;
+    bool ok = table.ParseHeader(p, end);
+    if (ok) {
+      grid.assign(table.m_nE + table.m_nAngles + table.m_nB + nMixture +
+                      NumberOfParameters, 0.);
+      ok = table.ParseGrid(p, end, &grid[0]);
+    }
+    // ... and the trailer from the end of the file.
+    if (ok && fseek(f, 0, SEEK_END) == 0) {
+      const long size = ftell(f);
+      const long start = std::max(0L, size - long(sizeof(block)));
+      fseek(f, start, SEEK_SET);
+      n = fread(block, 1, sizeof(block), f);
+      std::string tail(block, n);
+      if (tail.find("\n H Extr") == std::string::npos) {
+        // Long trailer (diagnostics section), search the whole file.
+        fseek(f, 0, SEEK_SET);
+        tail.clear();
+        while ((n = fread(block, 1, sizeof(block), f)) > 0) {
+          tail.append(block, n);
+        }
+      }
+      const size_t pos = tail.find("\n H Extr");
+      if (pos != std::string::npos) {
+        const char* q = tail.data() + pos + 1;
+        table.ParseTrailer(q, tail.data() + tail.size(),
+                           &grid[grid.size() - NumberOfParameters]);
+      } else {
+        ok = false;
+      }
+    }
+    fclose(f);
+    if (!ok) return false;
+  }
+
+  const unsigned int nE = table.m_nE;
+  const unsigned int nA = table.m_nAngles;
+  const unsigned int nB = table.m_nB;
+  if (nE == 0 || nA == 0 || nB == 0) return false;
+  header.version = table.m_version;
+  header.map3d = table.m_map3d;
+  header.gasBits = table.m_gasBits;
+  header.identifier = table.m_identifier;
+  header.nE = nE;
+  header.nAngles = nA;
+  header.nB = nB;
+  header.eMin = *std::min_element(grid.begin(), grid.begin() + nE);
+  header.eMax = *std::max_element(grid.begin(), grid.begin() + nE);
+  header.aMin = *std::min_element(grid.begin() + nE, grid.begin() + nE + nA);
+  header.aMax = *std::max_element(grid.begin() + nE, grid.begin() + nE + nA);
+  const std::vector<double>::const_iterator b0 = grid.begin() + nE + nA;
+  header.bMin = *std::min_element(b0, b0 + nB);
+  header.bMax = *std::max_element(b0, b0 + nB);
+  std::copy(b0 + nB, b0 + nB + nMixture, header.mixture);
+  header.pressure = *(b0 + nB + nMixture + Pressure);
+  header.temperature = *(b0 + nB + nMixture + Temperature);
+  return true;
+}
+
+bool GasTable::WriteText(const std::string& filename) const {
+
+  if (!m_data) {
+    std::cerr << m_className << "::WriteText:\n"
+              << "    Table is empty.\n";
+    return false;
+  }
+  std::ofstream outfile(filename.c_str(), std::ios::out);
+  if (!outfile) {
+    std::cerr << m_className << "::WriteText:\n"
+              << "    Cannot open file " << filename << ".\n";
+    return false;
+  }
+
+  char buffer[256];
+  outfile << Ruler << "\n";
+  if (m_created.empty()) {
+    const time_t now = time(NULL);
+    strftime(buffer, sizeof(buffer), "%d/%m/%y at %H.%M.%S", localtime(&now));
+    outfile << "% Created " << buffer << " < none > GAS      \"none"
+            << "                         \"\n";
+  } else {
+    outfile << m_created << "\n";
+  }
+  outfile << " Version   : " << m_version << "\n";
+  outfile << " GASOK bits: " << m_gasBits << "\n";
+  snprintf(buffer, sizeof(buffer), "%-80s", m_identifier.c_str());
+  outfile << " Identifier: " << buffer << "\n";
+  snprintf(buffer, sizeof(buffer), "%-80s", m_clusters.c_str());
+  outfile << " Clusters  : " << buffer << "\n";
+  snprintf(buffer, sizeof(buffer), "%10u%10u%10u%10u%10u", m_nE, m_nAngles,
+           m_nB, m_nExc, m_nIon);
+  outfile << " Dimension : " << (m_map3d ? "T" : "F") << buffer << "\n";
+  outfile << m_headerExtra;
+  outfile << " E fields   \n";
+  WriteNumbers(outfile, GetElectricFields(), m_nE, 5);
+  outfile << " E-B angles \n";
+  WriteNumbers(outfile, GetAngles(), m_nAngles, 5);
+  outfile << " B fields   \n";
+  WriteNumbers(outfile, GetMagneticFields(), m_nB, 5);
+  outfile << " Mixture:   \n";
+  WriteNumbers(outfile, GetMixture(), nMixture, 5);
+  outfile << " The gas tables follow:\n";
+
+  // One block of records per E point, 8 values per line.
+  std::vector<const double*> columns(m_nColumns);
+  for (unsigned int c = 0; c < m_nColumns; ++c) columns[c] = GetColumn(c);
+  for (unsigned int i = 0; i < m_nE; ++i) {
+    unsigned int n = 0;
+    for (unsigned int j = 0; j < m_nAngles; ++j) {
+      for (unsigned int k = 0; k < m_nB; ++k) {
+        const unsigned int index = GetIndex(i, j, k);
+        for (unsigned int c = 0; c < m_nColumns; ++c) {
+          WriteNumber(outfile, columns[c][index]);
+          if (++n % 8 == 0) outfile << "\n";
+        }
+      }
+    }
+    if (n % 8 != 0) outfile << "\n";
+  }
+
+  outfile << " H Extr: ";
+  WriteIntegers(outfile, m_extrHigh, nExtrapolation, 5);
+  outfile << " L Extr: ";
+  WriteIntegers(outfile, m_extrLow, nExtrapolation, 5);
+  outfile << " Thresholds: ";
+  WriteIntegers(outfile, m_thresholds, nThresholds, 10);
+  outfile << " Interp: ";
+  WriteIntegers(outfile, m_interp, nExtrapolation, 5);
+  const double* parameters = GetMixture() + nMixture;
+  outfile << " A     =";
+  WriteNumber(outfile, parameters[AtomicWeight]);
+  outfile << ", Z     =";
+  WriteNumber(outfile, parameters[AtomicNumber]);
+  outfile << ", EMPROB=";
+  WriteNumber(outfile, parameters[EmProb]);
+  outfile << ", EPAIR =";
+  WriteNumber(outfile, parameters[EPair]);
+  outfile << "\n Ion diffusion: ";
+  WriteNumber(outfile, parameters[IonDiffLong]);
+  WriteNumber(outfile, parameters[IonDiffTrans]);
+  outfile << "\n CMEAN =";
+  WriteNumber(outfile, parameters[ClusterMean]);
+  outfile << ", RHO   =";
+  WriteNumber(outfile, parameters[Density]);
+  outfile << ", PGAS  =";
+  WriteNumber(outfile, parameters[Pressure]);
+  outfile << ", TGAS  =";
+  WriteNumber(outfile, parameters[Temperature]);
+  outfile << "\n";
+  outfile << (m_tail.empty() ? DefaultTail : m_tail);
+  outfile << FormatDiagnostics();
+  outfile.close();
+  return true;
+}
+
+bool GasTable::WriteBinary(const std::string& filename) const {
+
+  if (!m_data) {
+    std::cerr << m_className << "::WriteBinary:\n"
+              << "    Table is empty.\n";
+    return false;
+  }
+  std::ofstream outfile(filename.c_str(), std::ios::out | std::ios::binary);
+  if (!outfile) {
+    std::cerr << m_className << "::WriteBinary:\n"
+              << "    Cannot open file " << filename << ".\n";
+    return false;
+  }
+
+  BinaryHeader header;
+  std::string text;
+  FillBinaryHeader(header, text);
+  outfile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  outfile.write(reinterpret_cast<const char*>(m_data),
+                GetHeaderSize() * sizeof(double));
+  const unsigned int np = GetNumberOfPoints();
+  for (unsigned int c = 0; c < m_nColumns; ++c) {
+    outfile.write(reinterpret_cast<const char*>(GetColumn(c)),
+                  np * sizeof(double));
+  }
+  outfile.write(text.data(), text.size());
+  if (!outfile) {
+    std::cerr << m_className << "::WriteBinary:\n"
+              << "    Error writing " << filename << ".\n";
+    return false;
+  }
+  outfile.close();
+  return true;
+}
+
+bool GasTable::WriteShared(const std::string& name) const {
+
+  if (!m_data) {
+    std::cerr << m_className << "::WriteShared:\n"
+              << "    Table is empty.\n";
+    return false;
+  }
+  BinaryHeader header;
+  std::string text;
+  FillBinaryHeader(header, text);
+  const size_t size = header.fileSize;
+
+  // Replace an existing segment by a new one; processes which have
+  // attached to the old segment keep their mapping.
+  shm_unlink(name.c_str());
+  const int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+  if (fd < 0) {
+    std::cerr << m_className << "::WriteShared:\n"
+              << "    Cannot create shared memory segment " << name << " ("
+              << strerror(errno) << ").\n";
+    return false;
+  }
+  void* map = MAP_FAILED;
+  if (ftruncate(fd, size) == 0) {
+    map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (map == MAP_FAILED) {
+    std::cerr << m_className << "::WriteShared:\n"
+              << "    Cannot allocate " << size << " bytes for segment "
+              << name << ".\n";
+    shm_unlink(name.c_str());
+    return false;
+  }
+  char* base = static_cast<char*>(map);
+  memcpy(base + header.dataOffset, m_data, GetHeaderSize() * sizeof(double));
+  const unsigned int np = GetNumberOfPoints();
+  char* columns = base + header.dataOffset + GetHeaderSize() * sizeof(double);
+  for (unsigned int c = 0; c < m_nColumns; ++c) {
+    memcpy(columns + c * np * sizeof(double), GetColumn(c),
+           np * sizeof(double));
+  }
+  memcpy(base + header.textOffset, text.data(), text.size());
+  // Write the header, and after a barrier the magic number (which a
+  // reader checks first), so a reader never accepts a partially filled
+  // segment. The new segment is zero-filled, i. e. has no magic number.
+  const size_t magicSize = sizeof(header.magic);
+  memcpy(base + magicSize, reinterpret_cast<const char*>(&header) + magicSize,
+         sizeof(header) - magicSize);
+  __sync_synchronize();
+  memcpy(base, header.magic, magicSize);
+  munmap(map, size);
+  if (m_debug) {
+    std::cout << m_className << "::WriteShared:\n"
+              << "    Published " << size << " bytes as " << name << ".\n";
+  }
+  return true;
+}
+
+bool GasTable::RemoveShared(const std::string& name) {
+
+  return shm_unlink(name.c_str()) == 0;
+}
+
+bool GasTable::WriteCompressed(const std::string& filename,
+                               const int level) const {
+
+  if (!m_data) {
+    std::cerr << m_className << "::WriteCompressed:\n"
+              << "    Table is empty.\n";
+    return false;
+  }
+  std::ofstream outfile(filename.c_str(), std::ios::out | std::ios::binary);
+  if (!outfile) {
+    std::cerr << m_className << "::WriteCompressed:\n"
+              << "    Cannot open file " << filename << ".\n";
+    return false;
+  }
+  z_stream z;
+  memset(&z, 0, sizeof(z));
+  if (deflateInit(&z, level) != Z_OK) {
+    std::cerr << m_className << "::WriteCompressed:\n"
+              << "    Cannot initialise compression (level " << level
+              << ").\n";
+    return false;
+  }
+
+  BinaryHeader header;
+  std::string text;
+  FillBinaryHeader(header, text);
+  memcpy(header.magic, CompressedMagic, sizeof(header.magic));
+  // The header is written again once the size of the data is known.
+  outfile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  // Grids and parameters, then one block per column.
+  uint64_t nBytes = 0;
+  std::vector<unsigned char> block;
+  bool ok = true;
+  for (unsigned int i = 0; ok && i <= m_nColumns; ++i) {
+    const double* values = i == 0 ? m_data : GetColumn(i - 1);
+    const size_t n = i == 0 ? GetHeaderSize() : GetNumberOfPoints();
+    EncodeBlock(values, n, block);
+    ok = Deflate(z, block, i == m_nColumns ? Z_FINISH : Z_NO_FLUSH, outfile,
+                 nBytes);
+  }
+  deflateEnd(&z);
+  header.textOffset = header.dataOffset + nBytes;
+  header.fileSize = header.textOffset + header.textSize;
+  outfile.write(text.data(), text.size());
+  outfile.seekp(0);
+  outfile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  if (!ok || !outfile) {
+    std::cerr << m_className << "::WriteCompressed:\n"
+              << "    Error writing " << filename << ".\n";
+    return false;
+  }
+  outfile.close();
+  if (m_debug) {
+    std::cout << m_className << "::WriteCompressed:\n"
+              << "    Compressed " << GetDataSize() * sizeof(double)
+              << " bytes of data to " << nBytes << ".\n";
+  }
+  return true;
+}
+
+bool GasTable::LoadCompressed(const std::string& filename) {
+
+  std::ifstream infile(filename.c_str(), std::ios::binary);
+  if (!infile) {
+    std::cerr << m_className << "::LoadCompressed:\n"
+              << "    Cannot open file " << filename << ".\n";
+    return false;
+  }
+  infile.seekg(0, std::ios::end);
+  const uint64_t size = infile.tellg();
+  infile.seekg(0, std::ios::beg);
+  BinaryHeader header;
+  std::string error = "";
+  if (!infile.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+    error = "too short";
+  } else {
+    error = ApplyBinaryHeader(header, size, true);
+  }
+  if (error.empty()) {
+    std::vector<char> text(header.textSize + 1);
+    infile.seekg(header.textOffset);
+    if (!infile.read(&text[0], header.textSize) ||
+        !ReadStrings(&text[0], &text[0] + header.textSize)) {
+      error = "corrupt string section";
+    }
+  }
+  if (error.empty()) {
+    // Decode the stream block by block into the table.
+    Allocate();
+    infile.seekg(header.dataOffset);
+    z_stream z;
+    memset(&z, 0, sizeof(z));
+    if (inflateInit(&z) != Z_OK) {
+      error = "cannot initialise decompression";
+    } else {
+      uint64_t remaining = header.textOffset - header.dataOffset;
+      std::vector<unsigned char> chunk(ChunkSize);
+      std::vector<unsigned char> block;
+      const unsigned int np = GetNumberOfPoints();
+      double* values = &m_store[0];
+      for (unsigned int i = 0; i <= m_nColumns; ++i) {
+        const size_t n = i == 0 ? GetHeaderSize() : np;
+        if (!ReadBlock(z, infile, remaining, chunk, block, n, values)) {
+          error = "corrupt data section";
+          break;
+        }
+        values += n;
+      }
+      inflateEnd(&z);
+    }
+  }
+  if (!error.empty()) {
+    std::cerr << m_className << "::LoadCompressed:\n"
+              << "    " << filename << ": " << error << ".\n";
+    Clear();
+    return false;
+  }
+  if (m_debug) {
+    std::cout << m_className << "::LoadCompressed:\n"
+              << "    Read " << size << " bytes, " << m_nE << " x "
+              << m_nAngles << " x " << m_nB << " grid points.\n";
+  }
+  return true;
+}
+
+void GasTable::FillBinaryHeader(BinaryHeader& header,
+                                std::string& text) const {
+
+  std::ostringstream strings;
+  WriteString(strings, m_created);
+  WriteString(strings, m_identifier);
+  WriteString(strings, m_clusters);
+  WriteString(strings, m_headerExtra);
+  WriteString(strings, m_tail + FormatDiagnostics());
+  text = strings.str();
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, BinaryMagic, sizeof(header.magic));
+  header.formatVersion = BinaryFormatVersion;
+  header.byteOrder = ByteOrderMark;
+  header.gasFileVersion = m_version;
+  header.map3d = m_map3d ? 1 : 0;
+  header.nE = m_nE;
+  header.nAngles = m_nAngles;
+  header.nB = m_nB;
+  header.nExc = m_nExc;
+  header.nIon = m_nIon;
+  header.nColumns = m_nColumns;
+  memcpy(header.gasBits, m_gasBits.data(), nGasBits);
+  for (unsigned int i = 0; i < nExtrapolation; ++i) {
+    header.extrHigh[i] = m_extrHigh[i];
+    header.extrLow[i] = m_extrLow[i];
+    header.interp[i] = m_interp[i];
+  }
+  for (unsigned int i = 0; i < nThresholds; ++i) {
+    header.thresholds[i] = m_thresholds[i];
+  }
+  header.dataOffset = sizeof(BinaryHeader);
+  header.dataSize = GetDataSize();
+  header.textOffset = header.dataOffset + header.dataSize * sizeof(double);
+  header.textSize = text.size();
+  header.fileSize = header.textOffset + header.textSize;
+}
+
+bool GasTable::LoadBinary(const std::string& filename) {
+
+  const int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    std::cerr << m_className << "::LoadBinary:\n"
+              << "    Cannot open file " << filename << ".\n";
+    return false;
+  }
+  return MapBinary(fd, filename, "LoadBinary");
+}
+
+bool GasTable::LoadShared(const std::string& name) {
+
+  const int fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd < 0) {
+    std::cerr << m_className << "::LoadShared:\n"
+              << "    Cannot open shared memory segment " << name << ".\n";
+    return false;
+  }
+  return MapBinary(fd, name, "LoadShared");
+}
+
+std::string GasTable::ApplyBinaryHeader(const BinaryHeader& header,
+                                        const uint64_t size,
+                                        const bool compressed) {
+
+  const char* magic = compressed ? CompressedMagic : BinaryMagic;
+  // The data section of compressed files ends where the text starts.
+  const uint64_t dataEnd =
+      compressed ? header.textOffset
+                 : header.dataOffset + header.dataSize * sizeof(double);
+  if (memcmp(header.magic, magic, sizeof(header.magic)) != 0) {
+    return compressed ? "not a compressed gas table" : "not a binary gas table";
+  } else if (header.byteOrder != ByteOrderMark) {
+    return "written with different byte order";
+  } else if (header.formatVersion != BinaryFormatVersion) {
+    return "unsupported format version";
+  } else if (header.fileSize != size ||
+             header.dataOffset % sizeof(double) != 0 ||
+             header.dataOffset > dataEnd || dataEnd > size ||
+             header.textOffset + header.textSize > size) {
+    return "truncated or corrupt";
+  }
+  Clear();
+  ResetHeader();
+  m_map3d = header.map3d != 0;
+  m_nE = header.nE;
+  m_nAngles = header.nAngles;
+  m_nB = header.nB;
+  m_nExc = header.nExc;
+  m_nIon = header.nIon;
+  const unsigned int nq = ExcitationRates + m_nExc + m_nIon;
+  m_nColumns = m_map3d ? nq : 2 * nq - 1;
+  if (header.nColumns != m_nColumns || header.dataSize != GetDataSize()) {
+    return "inconsistent table dimensions";
+  }
+  m_version = header.gasFileVersion;
+  m_gasBits.assign(header.gasBits, nGasBits);
+  for (unsigned int i = 0; i < nExtrapolation; ++i) {
+    m_extrHigh[i] = header.extrHigh[i];
+    m_extrLow[i] = header.extrLow[i];
+    m_interp[i] = header.interp[i];
+  }
+  for (unsigned int i = 0; i < nThresholds; ++i) {
+    m_thresholds[i] = header.thresholds[i];
+  }
+  return "";
+}
+
+bool GasTable::ReadStrings(const char* p, const char* end) {
+
+  if (!ReadString(p, end, m_created) || !ReadString(p, end, m_identifier) ||
+      !ReadString(p, end, m_clusters) ||
+      !ReadString(p, end, m_headerExtra) || !ReadString(p, end, m_tail)) {
+    return false;
+  }
+  ExtractDiagnostics();
+  return true;
+}
+
+bool GasTable::MapBinary(const int fd, const std::string& filename,
+                         const std::string& caller) {
+
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size < (off_t)sizeof(BinaryHeader)) {
+    std::cerr << m_className << "::" << caller << ":\n"
+              << "    " << filename << " is too short.\n";
+    close(fd);
+    return false;
+  }
+  const size_t size = info.st_size;
+  void* map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  // The mapping stays valid after closing the descriptor.
+  close(fd);
+  if (map == MAP_FAILED) {
+    std::cerr << m_className << "::" << caller << ":\n"
+              << "    Cannot map " << filename << ".\n";
+    return false;
+  }
+
+  const char* base = static_cast<const char*>(map);
+  BinaryHeader header;
+  memcpy(&header, base, sizeof(header));
+  // Pairs with the barrier in WriteShared: the data of a segment with
+  // a valid magic number are complete.
+  __sync_synchronize();
+  std::string error = ApplyBinaryHeader(header, size, false);
+  if (error.empty() &&
+      !ReadStrings(base + header.textOffset,
+                   base + header.textOffset + header.textSize)) {
+    error = "corrupt string section";
+  }
+  if (!error.empty()) {
+    std::cerr << m_className << "::" << caller << ":\n"
+              << "    " << filename << ": " << error << ".\n";
+    munmap(map, size);
+    Clear();
+    return false;
+  }
+
+  m_map = map;
+  m_mapSize = size;
+  m_data = reinterpret_cast<const double*>(base + header.dataOffset);
+  if (m_debug) {
+    std::cout << m_className << "::" << caller << ":\n"
+              << "    Mapped " << size << " bytes, " << m_nE << " x "
+              << m_nAngles << " x " << m_nB << " grid points.\n";
+  }
+  return true;
+}
+}
@@ -0,0 +1,376 @@
+#ifndef G_GAS_TABLE_H
+#define G_GAS_TABLE_H
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+
+namespace Garfield {
+
+/// Transport table of a gas file.
+///
+/// The values are kept in the (reduced) units of the gas file:
+/// E/p [V/(cm Torr)], B [0.01 T], velocities [cm/us], diffusion * sqrt(p),
+/// log(alpha / p), log(eta / p). Each column of the per-point record
+/// is stored contiguously, ordered [angle][B][E] like the tables in Medium.
+///
+/// Besides the (Garfield) text format, tables can be written to a
+/// versioned binary format. Binary files are memory-mapped read-only,
+/// so loading them costs no parsing and the pages are shared
+/// between all processes using the same file.
+///
+/// The compressed format has the same header and text section, the data
+/// section is a zlib stream of the grids/parameters block followed by one
+/// block per column. Before compression, values with 9 significant digits
+/// (as read from text files) are split into decimal exponent and
+/// mantissa, and the mantissas are delta-encoded along the column;
+/// other values are stored verbatim, so the format is lossless.
+///
+/// A table can also be published in a named POSIX shared-memory segment
+/// (same layout as the binary file), which other processes on the node
+/// map read-only instead of each reading its own copy. (Media attached
+/// to a segment still convert the columns they use to their own tables.)
+///
+/// With lazy loading enabled, text files are mapped as well: only the
+/// header, grids and trailer are decoded up front, and each column is
+/// decoded from the file when it is first requested.
+///
+/// Binary layout (native byte order, all offsets multiples of 8 bytes):
+///   header       magic "GARFGAS", format version, byte order mark,
+///                gas file version, grid dimensions, GASOK bits,
+///                extrapolation/interpolation flags, thresholds,
+///                offsets and sizes of the following sections
+///   data         E fields, angles, B fields, mixture (60 values),
+///                parameters (A, Z, EMPROB, EPAIR, ion diffusion,
+///                CMEAN, RHO, PGAS, TGAS), then one block of
+///                nE * nAngles * nB values per column
+///   text         header and trailer strings, each preceded by its length
+
+class GasTable {
+
+ public:
+  // Quantities stored per grid point (order of the 3D record).
+  enum Quantity {
+    VelocityE = 0,
+    VelocityB,
+    VelocityExB,
+    DiffLong,
+    DiffTrans,
+    Townsend,
+    TownsendNoPenning,
+    Attachment,
+    IonMobility,
+    LorentzAngle,
+    IonDissociation,
+    DiffTensor,
+    // Excitation rates and ionisation rates follow
+    // after the six tensor components.
+    ExcitationRates = DiffTensor + 6
+  };
+  // Scalar parameters in the trailer of the gas file.
+  enum Parameter {
+    AtomicWeight = 0,
+    AtomicNumber,
+    EmProb,
+    EPair,
+    IonDiffLong,
+    IonDiffTrans,
+    ClusterMean,
+    Density,
+    Pressure,
+    Temperature,
+    NumberOfParameters
+  };
+  static const unsigned int nMixture = 60;
+  static const unsigned int nGasBits = 20;
+  static const unsigned int nExtrapolation = 13;
+  static const unsigned int nThresholds = 3;
+
+  // Summary of a gas file (everything except the tables).
+  struct Header {
+    bool binary;
+    unsigned int version;
+    std::string gasBits;
+    std::string identifier;
+    bool map3d;
+    unsigned int nE, nAngles, nB;
+    // Range of the grid (reduced E field, angle, B field as in the file)
+    double eMin, eMax;
+    double aMin, aMax;
+    double bMin, bMax;
+    double mixture[nMixture];
+    // Pressure [Torr] and temperature [K]
+    double pressure, temperature;
+  };
+
+  // Constructor
+  GasTable();
+  // Destructor
+  ~GasTable();
+
+  // Read a table, the format (text or binary) is detected automatically.
+  bool Load(const std::string& filename);
+  // Read a table from a text gas file.
+  bool LoadText(const std::string& filename);
+  // Map a binary gas table.
+  bool LoadBinary(const std::string& filename);
+  // Write the table in text format.
+  bool WriteText(const std::string& filename) const;
+  // Write the table in binary format.
+  bool WriteBinary(const std::string& filename) const;
+  // Publish the table in a shared-memory segment (name like "/ar_co2"),
+  // replacing an existing segment of the same name.
+  bool WriteShared(const std::string& name) const;
+  // Map a table published by another process (read-only).
+  bool LoadShared(const std::string& name);
+  // Remove a segment (processes that have mapped it are not affected).
+  static bool RemoveShared(const std::string& name);
+  // Write the table in compressed format (zlib level 1 - 9).
+  bool WriteCompressed(const std::string& filename, const int level = 6) const;
+  // Read a compressed table (decoded while reading).
+  bool LoadCompressed(const std::string& filename);
+  // Check if a file starts with the binary magic number.
+  static bool IsBinaryFile(const std::string& filename);
+  static bool IsCompressedFile(const std::string& filename);
+  // Check if a gas has three-body attachment, i.e. an attachment rate
+  // growing with the square of the density (e.g. "O2").
+  static bool IsThreeBodyAttacher(const std::string& gas);
+  // Read only the header and the gas parameters of a file
+  // (the trailer of text files is read from the end of the file).
+  static bool ReadHeader(const std::string& filename, Header& header);
+
+  // Set up an empty table for the given grid.
+  bool Initialise(const bool map3d, const std::vector<double>& efields,
+                  const std::vector<double>& angles,
+                  const std::vector<double>& bfields,
+                  const unsigned int nExc = 0, const unsigned int nIon = 0);
+  // Add the grid points of another table of the same gas (same mixture,
+  // pressure, temperature and excitation/ionisation levels). The grids
+  // are combined and the values copied, points present in both tables
+  // are taken from this one. Fails if the combined grid is not covered.
+  bool Merge(const GasTable& other);
+  // Rescale the table to another pressure [Torr] and temperature [K],
+  // keeping E/N and B/N constant (similarity laws), without rerunning
+  // Magboltz. Quantities which do not follow these laws (three-body
+  // attachment, Penning transfer, thermal motion of the gas) are
+  // reported in the warnings (printed if not requested).
+  bool Rescale(const double pressure, const double temperature);
+  bool Rescale(const double pressure, const double temperature,
+               std::vector<std::string>& warnings);
+  // Interpolate between tables which differ only in the fraction of one
+  // gas (index in the mixture, i. e. gas number - 1; the other gases keep
+  // their proportions) at a given percentage of this gas. Grids, pressure
+  // and temperature must be the same. With three or more tables the
+  // values are interpolated quadratically (nearest tables) and the
+  // quadratic term is returned as error estimate in a table of the same
+  // layout (in the units of the table, i. e. relative errors for the
+  // logarithmic coefficients); with two tables the interpolation is
+  // linear and the error table is left empty.
+  static bool Interpolate(const std::vector<const GasTable*>& tables,
+                          const unsigned int component,
+                          const double percentage, GasTable& result,
+                          GasTable& errors);
+  // Release the table (and unmap the file or segment).
+  void Clear();
+
+  bool IsEmpty() const { return m_data == NULL; }
+  bool IsMapped() const { return m_map != NULL; }
+  // Columns of text files not yet decoded.
+  bool IsLazy() const { return m_text != NULL; }
+  bool Is3d() const { return m_map3d; }
+  unsigned int GetVersion() const { return m_version; }
+
+  // Grid
+  unsigned int GetNumberOfElectricFields() const { return m_nE; }
+  unsigned int GetNumberOfAngles() const { return m_nAngles; }
+  unsigned int GetNumberOfMagneticFields() const { return m_nB; }
+  unsigned int GetNumberOfPoints() const { return m_nE * m_nAngles * m_nB; }
+  // Reduced electric fields [V / (cm Torr)]
+  const double* GetElectricFields() const { return m_data; }
+  // Angles between E and B [rad]
+  const double* GetAngles() const { return m_data + m_nE; }
+  // Magnetic fields [0.01 T]
+  const double* GetMagneticFields() const { return GetAngles() + m_nAngles; }
+
+  // Gas composition (percentages, indexed by Magboltz gas number - 1)
+  const double* GetMixture() const { return GetMagneticFields() + m_nB; }
+  void SetMixture(const unsigned int i, const double f);
+  double GetParameter(const unsigned int i) const {
+    return m_data && i < NumberOfParameters ? GetMixture()[nMixture + i] : 0.;
+  }
+  void SetParameter(const unsigned int i, const double value);
+  // Pressure [Torr] and temperature [K] of the table
+  double GetPressure() const { return GetParameter(Pressure); }
+  double GetTemperature() const { return GetParameter(Temperature); }
+
+  // Number of excitation and ionisation rates per point
+  unsigned int GetNumberOfExcitations() const { return m_nExc; }
+  unsigned int GetNumberOfIonisations() const { return m_nIon; }
+  unsigned int GetNumberOfQuantities() const {
+    return ExcitationRates + m_nExc + m_nIon;
+  }
+  // Number of values per grid point in the file
+  // (includes the spline coefficients of 1D tables).
+  unsigned int GetNumberOfColumns() const { return m_nColumns; }
+  // Column holding a quantity.
+  unsigned int GetColumnIndex(const unsigned int q) const;
+  const double* GetColumn(const unsigned int c) const;
+  const double* GetQuantity(const unsigned int q) const {
+    return GetColumn(GetColumnIndex(q));
+  }
+  double GetValue(const unsigned int q, const unsigned int ie,
+                  const unsigned int ia, const unsigned int ib) const;
+  // Writable access (copies a mapped table to memory first).
+  double* GetWritableColumn(const unsigned int c);
+  double* GetWritableQuantity(const unsigned int q) {
+    return GetWritableColumn(GetColumnIndex(q));
+  }
+  bool SetValue(const unsigned int q, const unsigned int ie,
+                const unsigned int ia, const unsigned int ib, const double v);
+  // Position of a grid point in a column.
+  unsigned int GetIndex(const unsigned int ie, const unsigned int ia,
+                        const unsigned int ib) const {
+    return (ia * m_nB + ib) * m_nE + ie;
+  }
+
+  // GASOK bits (which quantities are present)
+  const std::string& GetGasBits() const { return m_gasBits; }
+  bool GetGasBit(const unsigned int i) const {
+    return i < nGasBits && m_gasBits[i] == 'T';
+  }
+  void SetGasBit(const unsigned int i, const bool on);
+  // Check whether a quantity is present in the table.
+  bool HasQuantity(const unsigned int q) const;
+  void SetQuantity(const unsigned int q, const bool on);
+
+  const std::string& GetIdentifier() const { return m_identifier; }
+  void SetIdentifier(const std::string& id) { m_identifier = id; }
+
+  // Extrapolation (0: constant, 1: linear, 2: exponential),
+  // interpolation order and threshold indices, indexed like the GASOK bits.
+  int GetExtrapolationLow(const unsigned int i) const {
+    return i < nExtrapolation ? m_extrLow[i] : 0;
+  }
+  int GetExtrapolationHigh(const unsigned int i) const {
+    return i < nExtrapolation ? m_extrHigh[i] : 0;
+  }
+  int GetInterpolation(const unsigned int i) const {
+    return i < nExtrapolation ? m_interp[i] : 0;
+  }
+  int GetThreshold(const unsigned int i) const {
+    return i < nThresholds ? m_thresholds[i] : 0;
+  }
+  void SetExtrapolation(const unsigned int i, const int low, const int high);
+  void SetInterpolation(const unsigned int i, const int n);
+  void SetThreshold(const unsigned int i, const int ie);
+
+  // Additional per-point quantities (e.g. Magboltz diagnostics), given
+  // per name in the order of the columns. They are written after the
+  // trailer of text files (section "Diagnostics", ignored by other
+  // readers) and with the strings of binary files, and are dropped when
+  // the grid or the conditions of the table are changed.
+  bool SetDiagnostics(const std::vector<std::string>& names,
+                      const std::vector<double>& values);
+  void ClearDiagnostics();
+  const std::vector<std::string>& GetDiagnosticNames() const {
+    return m_diagNames;
+  }
+  // Values of a quantity (NULL if not present).
+  const double* GetDiagnostic(const std::string& name) const;
+
+  // Decode the columns of text files only when they are requested.
+  void EnableLazyLoading() { m_useLazyLoading = true; }
+  void DisableLazyLoading() { m_useLazyLoading = false; }
+
+  void EnableDebugging() { m_debug = true; }
+  void DisableDebugging() { m_debug = false; }
+
+ private:
+  std::string m_className;
+
+  // Gas file version
+  unsigned int m_version;
+  std::string m_gasBits;
+  // Header lines (verbatim)
+  std::string m_created;
+  std::string m_identifier;
+  std::string m_clusters;
+  // Header lines between "Dimension" and the E fields (excitation and
+  // ionisation level descriptions).
+  std::string m_headerExtra;
+  // Trailer lines following the gas parameters (verbatim).
+  std::string m_tail;
+
+  bool m_map3d;
+  unsigned int m_nE, m_nAngles, m_nB;
+  unsigned int m_nExc, m_nIon;
+  unsigned int m_nColumns;
+
+  int m_extrHigh[nExtrapolation];
+  int m_extrLow[nExtrapolation];
+  int m_interp[nExtrapolation];
+  int m_thresholds[nThresholds];
+
+  // Grids, mixture, parameters and columns, in the layout of the
+  // data section of the binary format.
+  std::vector<double> m_store;
+  // Memory-mapped binary file
+  void* m_map;
+  size_t m_mapSize;
+  // Start of the data (either in m_store or in the mapped file)
+  const double* m_data;
+
+  bool m_useLazyLoading;
+  // Memory-mapped text file
+  const char* m_text;
+  size_t m_textSize;
+  // Start of the block of records for each E point in the text file
+  std::vector<size_t> m_blocks;
+  // Columns decoded so far
+  mutable std::vector<std::vector<double> > m_columns;
+
+  // Per-point diagnostics (one block of values per name)
+  std::vector<std::string> m_diagNames;
+  std::vector<double> m_diagValues;
+
+  bool m_debug;
+
+  // Header of the binary format
+  struct BinaryHeader;
+  void FillBinaryHeader(BinaryHeader& header, std::string& text) const;
+  // Check the header of a binary/compressed file and set up the table.
+  std::string ApplyBinaryHeader(const BinaryHeader& header,
+                                const uint64_t size, const bool compressed);
+  bool ReadStrings(const char* p, const char* end);
+  bool MapBinary(const int fd, const std::string& filename,
+                 const std::string& caller);
+
+  unsigned int GetHeaderSize() const;
+  unsigned int GetDataSize() const;
+  void Allocate();
+  void MakeWritable();
+  void Materialise();
+  // Lazy decoding of text files.
+  bool MapText(const std::string& filename);
+  bool IndexTables(const char*& p, const char* end);
+  void DecodeColumn(const unsigned int c) const;
+  void ReleaseText();
+  void ResetHeader();
+  // Steps of decoding a text file held in memory.
+  bool ParseHeader(const char*& p, const char* end);
+  bool ParseGrid(const char*& p, const char* end, double* grid) const;
+  bool ParseTables(const char*& p, const char* end, double* columns,
+                   unsigned int& ie) const;
+  void ParseTrailer(const char*& p, const char* end, double* parameters);
+  // Text of the diagnostics section, and extraction from the trailer.
+  std::string FormatDiagnostics() const;
+  void ExtractDiagnostics();
+
+  // Copying would duplicate the mapping.
+  GasTable(const GasTable&);
+  GasTable& operator=(const GasTable&);
+};
+}
+
+#endif
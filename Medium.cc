@@ -1,12 +1,164 @@
 #include <iostream>
 #include <iomanip>
 #include <cmath>
+#include <algorithm>
 
 #include "Medium.hh"
+#include "GasTable.hh"
+#include "GasLibrary.hh"
 #include "FundamentalConstants.hh"
 #include "GarfieldConstants.hh"
 #include "Random.hh"
-#include "Numerics.hh"
+
+namespace {
+
+// Quantities of a lazily loaded gas table needed by each transport parameter.
+const unsigned int PendingVelocity = (1u << Garfield::GasTable::VelocityE) |
+                                     (1u << Garfield::GasTable::VelocityB) |
+                                     (1u << Garfield::GasTable::VelocityExB);
+const unsigned int PendingDiffusion = (1u << Garfield::GasTable::DiffLong) |
+                                      (1u << Garfield::GasTable::DiffTrans) |
+                                      (1u << Garfield::GasTable::DiffTensor);
+const unsigned int PendingTownsend = 1u << Garfield::GasTable::Townsend;
+const unsigned int PendingAttachment = 1u << Garfield::GasTable::Attachment;
+const unsigned int PendingLorentzAngle = 1u << Garfield::GasTable::LorentzAngle;
+const unsigned int PendingMobility = 1u << Garfield::GasTable::IonMobility;
+const unsigned int PendingDissociation =
+    1u << Garfield::GasTable::IonDissociation;
+const unsigned int PendingAll = ~0u;
+
+// Lagrange weights of the quadratic through x[0], x[1], x[2] at x0.
+bool QuadraticWeights(const double* x, const double x0, double w[3]) {
+
+  if (x[0] == x[1] || x[0] == x[2] || x[1] == x[2]) return false;
+  w[0] = (x0 - x[1]) * (x0 - x[2]) / ((x[0] - x[1]) * (x[0] - x[2]));
+  w[1] = (x0 - x[0]) * (x0 - x[2]) / ((x[1] - x[0]) * (x[1] - x[2]));
+  w[2] = (x0 - x[0]) * (x0 - x[1]) / ((x[2] - x[0]) * (x[2] - x[1]));
+  return true;
+}
+
+// Shape functions (order 0 - 2) of BOXIN3 along one axis of the grid,
+// the nodes i0 to i1 contribute with weights w[0] to w[i1 - i0].
+bool BoxinWeights(const std::vector<double>& axis, const double x0,
+                  const unsigned int order, unsigned int& i0,
+                  unsigned int& i1, double w[4]) {
+
+  const unsigned int n = axis.size();
+  w[0] = w[1] = w[2] = w[3] = 0.;
+  if (n == 0) return false;
+  // Stay inside the grid.
+  const double x = std::max(std::min(axis[0], axis[n - 1]),
+                            std::min(std::max(axis[0], axis[n - 1]), x0));
+  if (order == 0 || n == 1) {
+    // Nearest node
+    i0 = 0;
+    for (unsigned int i = 1; i < n; ++i) {
+      if (fabs(x - axis[i]) < fabs(x - axis[i0])) i0 = i;
+    }
+    i1 = i0;
+    w[0] = 1.;
+    return true;
+  }
+  // Find the grid segment containing the point.
+  unsigned int k = 1;
+  for (unsigned int i = 1; i < n; ++i) {
+    if ((axis[i - 1] - x) * (x - axis[i]) >= 0.) k = i;
+  }
+  if (axis[k] == axis[k - 1]) return false;
+  const double u = (x - axis[k - 1]) / (axis[k] - axis[k - 1]);
+  if (order == 1 || n == 2) {
+    i0 = k - 1;
+    i1 = k;
+    w[0] = 1. - u;
+    w[1] = u;
+    return true;
+  }
+  if (k == 1 || k == n - 1) {
+    // Quadratic through the three nodes at the edge
+    i0 = k == 1 ? 0 : n - 3;
+    i1 = i0 + 2;
+    return QuadraticWeights(&axis[i0], x, w);
+  }
+  // Blend of the quadratics through the left and right neighbours
+  i0 = k - 2;
+  i1 = k + 1;
+  double wl[3], wr[3];
+  if (!QuadraticWeights(&axis[i0], x, wl) ||
+      !QuadraticWeights(&axis[k - 1], x, wr)) {
+    return false;
+  }
+  w[0] = (1. - u) * wl[0];
+  w[1] = (1. - u) * wl[1] + u * wr[0];
+  w[2] = (1. - u) * wl[2] + u * wr[1];
+  w[3] = u * wr[2];
+  return true;
+}
+
+// Newton interpolation of order m in a table f(a) (CERNLIB E105).
+template <class T>
+double Divdif(const T& f, const std::vector<double>& a, const int n,
+              const double x, const int mm) {
+
+  if (n < 2 || mm < 1) return n > 0 ? f[0] : 0.;
+  // Deal with the case that x is located at the first or last point.
+  const double tol = 1.e-6 * (fabs(a[0]) + fabs(a[n - 1]));
+  if (fabs(x - a[0]) < tol) return f[0];
+  if (fabs(x - a[n - 1]) < tol) return f[n - 1];
+  const int m = std::min(std::min(mm, 10), n - 1);
+  const int mplus = m + 1;
+  // Find the subscript ix of x in the array a.
+  int ix = 0;
+  int iy = n + 1;
+  const bool decreasing = a[0] > a[n - 1];
+  while (iy - ix > 1) {
+    const int mid = (ix + iy) / 2;
+    if (decreasing ? x > a[mid - 1] : x < a[mid - 1]) {
+      iy = mid;
+    } else {
+      ix = mid;
+    }
+  }
+  // Copy the reordered interpolation points into (t, d),
+  // using m + 2 points if available.
+  double t[12], d[12];
+  int npts = m + 2 - (m % 2);
+  int ip = 0;
+  int l = 0;
+  do {
+    const int isub = ix + l;
+    if (isub < 1 || isub > n) {
+      npts = mplus;
+    } else {
+      t[ip] = a[isub - 1];
+      d[ip] = f[isub - 1];
+      ++ip;
+    }
+    if (ip < npts) {
+      l = -l;
+      if (l >= 0) ++l;
+    }
+  } while (ip < npts);
+  const bool extra = npts != mplus;
+  // Replace d by the leading diagonal of a divided-difference table,
+  // supplemented by an extra line if needed.
+  for (int k = 1; k <= m; ++k) {
+    if (extra) {
+      d[m + 1] = (d[m + 1] - d[m - 1]) / (t[m + 1] - t[mplus - k - 1]);
+    }
+    int i = mplus;
+    for (int j = k; j <= m; ++j) {
+      d[i - 1] = (d[i - 1] - d[i - 2]) / (t[i - 1] - t[i - k - 1]);
+      --i;
+    }
+  }
+  // Evaluate the Newton interpolation formula at x, averaging two values
+  // of the last difference if needed.
+  double sum = d[mplus - 1];
+  if (extra) sum = 0.5 * (sum + d[m + 1]);
+  for (int j = m; j >= 1; --j) sum = d[j - 1] + (x - t[j - 1]) * sum;
+  return sum;
+}
+}
 
 namespace Garfield {
 
@@ -30,7 +182,11 @@ Medium::Medium()
       m_fano(0.),
       m_isChanged(true),
       m_debug(false),
-      m_map2d(false) {
+      m_map2d(false),
+      m_useLazyLoading(false),
+      m_gasTable(NULL),
+      m_pendingTables(0),
+      m_mappedTables(0) {
 
   // Initialise the transport tables.
   m_bFields.assign(1, 0.);
@@ -90,7 +246,7 @@ Medium::Medium()
   SetFieldGrid(100., 100000., 20, true, 0., 0., 1, 0., 0., 1);
 }
 
-Medium::~Medium() {}
+Medium::~Medium() { ReleaseGasTable(); }
 
 void Medium::SetTemperature(const double t) {
 
@@ -199,6 +355,7 @@ bool Medium::ElectronVelocity(const double ex, const double ey, const double ez,
   vx = vy = vz = 0.;
   // Make sure there is at least a table of velocities along E.
   if (!m_hasElectronVelocityE) return false;
+  FetchTables(PendingVelocity, true);
 
   // Compute the magnitude of the electric field.
   const double e = sqrt(ex * ex + ey * ey + ez * ez);
@@ -217,16 +374,17 @@ bool Medium::ElectronVelocity(const double ex, const double ey, const double ez,
     // Calculate the velocity along E.
     double ve = 0.;
     if (m_map2d) {
-      if (!Numerics::Boxin3(tabElectronVelocityE, m_bAngles, m_bFields, m_eFields,
-                            m_bAngles.size(), m_bFields.size(), m_eFields.size(), ebang, b, e0, ve,
-                            m_intpVelocity)) {
+      if (!Interpolate3D(View(tabElectronVelocityE, GasTable::VelocityE), ebang,
+                         b, e0, ve, m_intpVelocity)) {
         std::cerr << m_className << "::ElectronVelocity:\n";
         std::cerr << "    Interpolation of velocity along E failed.\n";
         return false;
       }
     } else {
-      ve = Interpolate1D(e0, tabElectronVelocityE[0][0], m_eFields, m_intpVelocity,
-                         m_extrLowVelocity, m_extrHighVelocity);
+      ve = Interpolate1D(
+               e0, View(tabElectronVelocityE, GasTable::VelocityE).Row(0, 0),
+               m_eFields, m_intpVelocity, m_extrLowVelocity,
+               m_extrHighVelocity);
     }
     const double q = -1.;
     const double mu = q * ve / e;
@@ -280,37 +438,38 @@ bool Medium::ElectronVelocity(const double ex, const double ey, const double ez,
     // Calculate the velocities in all directions.
     double ve = 0., vbt = 0., vexb = 0.;
     if (m_map2d) {
-      if (!Numerics::Boxin3(tabElectronVelocityE, m_bAngles, m_bFields, m_eFields,
-                            m_bAngles.size(), m_bFields.size(), m_eFields.size(), ebang, b, e0, ve,
-                            m_intpVelocity)) {
+      if (!Interpolate3D(View(tabElectronVelocityE, GasTable::VelocityE), ebang,
+                         b, e0, ve, m_intpVelocity)) {
         std::cerr << m_className << "::ElectronVelocity:\n";
         std::cerr << "    Interpolation of velocity along E failed.\n";
         return false;
       }
-      if (!Numerics::Boxin3(tabElectronVelocityExB, m_bAngles, m_bFields, m_eFields,
-                            m_bAngles.size(), m_bFields.size(), m_eFields.size(), ebang, b, e0, vexb,
-                            m_intpVelocity)) {
+      if (!Interpolate3D(View(tabElectronVelocityExB, GasTable::VelocityExB),
+                         ebang, b, e0, vexb, m_intpVelocity)) {
         std::cerr << m_className << "::ElectronVelocity:\n";
         std::cerr << "    Interpolation of velocity along ExB failed.\n";
         return false;
       }
-      if (!Numerics::Boxin3(tabElectronVelocityB, m_bAngles, m_bFields, m_eFields,
-                            m_bAngles.size(), m_bFields.size(), m_eFields.size(), ebang, b, e0, vbt,
-                            m_intpVelocity)) {
+      if (!Interpolate3D(View(tabElectronVelocityB, GasTable::VelocityB), ebang,
+                         b, e0, vbt, m_intpVelocity)) {
         std::cerr << m_className << "::ElectronVelocity:\n";
         std::cerr << "    Interpolation of velocity along Bt failed.\n";
         return false;
       }
     } else {
-      ve = Interpolate1D(e0, tabElectronVelocityE[0][0], m_eFields, 
-                         m_intpVelocity,
-                         m_extrLowVelocity, m_extrHighVelocity);
-      vbt = Interpolate1D(e0, tabElectronVelocityB[0][0], m_eFields, 
-                          m_intpVelocity,
-                          m_extrLowVelocity, m_extrHighVelocity);
-      vexb = Interpolate1D(e0, tabElectronVelocityExB[0][0], m_eFields,
-                           m_intpVelocity, 
-                           m_extrLowVelocity, m_extrHighVelocity);
+      ve = Interpolate1D(
+               e0, View(tabElectronVelocityE, GasTable::VelocityE).Row(0, 0),
+               m_eFields, m_intpVelocity, m_extrLowVelocity,
+               m_extrHighVelocity);
+      vbt = Interpolate1D(
+                e0, View(tabElectronVelocityB, GasTable::VelocityB).Row(0, 0),
+                m_eFields, m_intpVelocity, m_extrLowVelocity,
+                m_extrHighVelocity);
+      vexb = Interpolate1D(
+                 e0,
+                 View(tabElectronVelocityExB, GasTable::VelocityExB).Row(0, 0),
+                 m_eFields, m_intpVelocity, m_extrLowVelocity,
+                 m_extrHighVelocity);
     }
     const double q = -1.;
     if (ex * bx + ey * by + ez * bz > 0.) vbt = fabs(vbt);
@@ -325,17 +484,17 @@ bool Medium::ElectronVelocity(const double ex, const double ey, const double ez,
     // Calculate the velocity along E.
     double ve = 0.;
     if (m_map2d) {
-      if (!Numerics::Boxin3(tabElectronVelocityE, m_bAngles, m_bFields, m_eFields,
-                            m_bAngles.size(), m_bFields.size(), m_eFields.size(), ebang, b, e0, ve,
-                            m_intpVelocity)) {
+      if (!Interpolate3D(View(tabElectronVelocityE, GasTable::VelocityE), ebang,
+                         b, e0, ve, m_intpVelocity)) {
         std::cerr << m_className << "::ElectronVelocity:\n";
         std::cerr << "    Interpolation of velocity along E failed.\n";
         return false;
       }
     } else {
-      ve = Interpolate1D(e0, tabElectronVelocityE[0][0], m_eFields, 
-                         m_intpVelocity,
-                         m_extrLowVelocity, m_extrHighVelocity);
+      ve = Interpolate1D(
+               e0, View(tabElectronVelocityE, GasTable::VelocityE).Row(0, 0),
+               m_eFields, m_intpVelocity, m_extrLowVelocity,
+               m_extrHighVelocity);
     }
 
     const double q = -1.;
@@ -356,6 +515,7 @@ bool Medium::ElectronDiffusion(const double ex, const double ey,
                                double& dt) {
 
   dl = dt = 0.;
+  FetchTables(PendingDiffusion, true);
   // Compute the magnitude of the electric field.
   const double e = sqrt(ex * ex + ey * ey + ez * ez);
   const double e0 = ScaleElectricField(e);
@@ -369,29 +529,29 @@ bool Medium::ElectronDiffusion(const double ex, const double ey,
 
     // Interpolate.
     if (m_hasElectronDiffLong) {
-      if (!Numerics::Boxin3(tabElectronDiffLong, m_bAngles, m_bFields, m_eFields,
-                            m_bAngles.size(), m_bFields.size(), m_eFields.size(), ebang, b, e0, dl,
-                            m_intpDiffusion)) {
+      if (!Interpolate3D(View(tabElectronDiffLong, GasTable::DiffLong), ebang,
+                         b, e0, dl, m_intpDiffusion)) {
         dl = 0.;
       }
     }
     if (m_hasElectronDiffTrans) {
-      if (!Numerics::Boxin3(tabElectronDiffTrans, m_bAngles, m_bFields, m_eFields,
-                            m_bAngles.size(), m_bFields.size(), m_eFields.size(), ebang, b, e0, dt,
-                            m_intpDiffusion)) {
+      if (!Interpolate3D(View(tabElectronDiffTrans, GasTable::DiffTrans), ebang,
+                         b, e0, dt, m_intpDiffusion)) {
         dt = 0.;
       }
     }
   } else {
     if (m_hasElectronDiffLong) {
-      dl = Interpolate1D(e0, tabElectronDiffLong[0][0], m_eFields, 
-                         m_intpDiffusion,
-                         m_extrLowDiffusion, m_extrHighDiffusion);
+      dl = Interpolate1D(
+               e0, View(tabElectronDiffLong, GasTable::DiffLong).Row(0, 0),
+               m_eFields, m_intpDiffusion, m_extrLowDiffusion,
+               m_extrHighDiffusion);
     }
     if (m_hasElectronDiffTrans) {
-      dt = Interpolate1D(e0, tabElectronDiffTrans[0][0], m_eFields, 
-                         m_intpDiffusion,
-                         m_extrLowDiffusion, m_extrHighDiffusion);
+      dt = Interpolate1D(
+               e0, View(tabElectronDiffTrans, GasTable::DiffTrans).Row(0, 0),
+               m_eFields, m_intpDiffusion, m_extrLowDiffusion,
+               m_extrHighDiffusion);
     }
   }
 
@@ -422,6 +582,7 @@ bool Medium::ElectronDiffusion(const double ex, const double ey,
   cov[2][0] = cov[2][1] = cov[2][2] = 0.;
 
   if (!m_hasElectronDiffTens) return false;
+  FetchTables(PendingDiffusion, true);
 
   // Compute the magnitude of the electric field.
   const double e = sqrt(ex * ex + ey * ey + ez * ez);
@@ -437,9 +598,8 @@ bool Medium::ElectronDiffusion(const double ex, const double ey,
     // Interpolate.
     double diff = 0.;
     for (int l = 0; l < 6; ++l) {
-      if (!Numerics::Boxin3(tabElectronDiffTens[l], m_bAngles, m_bFields, m_eFields,
-                            m_bAngles.size(), m_bFields.size(), m_eFields.size(), ebang, b, e0, diff,
-                            m_intpDiffusion)) {
+      if (!Interpolate3D(DiffTensorView(l), ebang, b, e0, diff,
+                         m_intpDiffusion)) {
         diff = 0.;
       }
       // Apply scaling.
@@ -458,9 +618,9 @@ bool Medium::ElectronDiffusion(const double ex, const double ey,
     // Interpolate.
     for (int l = 0; l < 6; ++l) {
       double diff =
-          Interpolate1D(e0, tabElectronDiffTens[l][0][0], m_eFields,
-                        m_intpDiffusion, 
-                        m_extrLowDiffusion, m_extrHighDiffusion);
+          Interpolate1D(e0, DiffTensorView(l).Row(0, 0), m_eFields,
+                        m_intpDiffusion, m_extrLowDiffusion,
+                        m_extrHighDiffusion);
       // Apply scaling.
       diff = ScaleDiffusionTensor(diff);
       if (l < 3) {
@@ -483,7 +643,8 @@ bool Medium::ElectronTownsend(const double ex, const double ey, const double ez,
                               double& alpha) {
 
   alpha = 0.;
-  if (tabElectronTownsend.empty()) return false;
+  FetchTables(PendingTownsend, true);
+  if (View(tabElectronTownsend, GasTable::Townsend).IsEmpty()) return false;
   // Compute the magnitude of the electric field.
   const double e = sqrt(ex * ex + ey * ey + ez * ez);
   const double e0 = ScaleElectricField(e);
@@ -497,27 +658,27 @@ bool Medium::ElectronTownsend(const double ex, const double ey, const double ez,
 
     // Interpolate.
     if (e0 < m_eFields[thrElectronTownsend]) {
-      if (!Numerics::Boxin3(tabElectronTownsend, m_bAngles, m_bFields, m_eFields,
-                            m_bAngles.size(), m_bFields.size(), m_eFields.size(), ebang, b, e0, alpha,
-                            1)) {
+      if (!Interpolate3D(View(tabElectronTownsend, GasTable::Townsend), ebang,
+                         b, e0, alpha, 1)) {
         alpha = -30.;
       }
     } else {
-      if (!Numerics::Boxin3(tabElectronTownsend, m_bAngles, m_bFields, m_eFields,
-                            m_bAngles.size(), m_bFields.size(), m_eFields.size(), ebang, b, e0, alpha,
-                            m_intpTownsend)) {
+      if (!Interpolate3D(View(tabElectronTownsend, GasTable::Townsend), ebang,
+                         b, e0, alpha, m_intpTownsend)) {
         alpha = -30.;
       }
     }
   } else {
     // Interpolate.
     if (e0 < m_eFields[thrElectronTownsend]) {
-      alpha = Interpolate1D(e0, tabElectronTownsend[0][0], m_eFields, 1,
-                            m_extrLowTownsend, m_extrHighTownsend);
+      alpha = Interpolate1D(
+                  e0, View(tabElectronTownsend, GasTable::Townsend).Row(0, 0),
+                  m_eFields, 1, m_extrLowTownsend, m_extrHighTownsend);
     } else {
-      alpha = Interpolate1D(e0, tabElectronTownsend[0][0], m_eFields,
-                            m_intpTownsend, 
-                            m_extrLowTownsend, m_extrHighTownsend);
+      alpha = Interpolate1D(
+                  e0, View(tabElectronTownsend, GasTable::Townsend).Row(0, 0),
+                  m_eFields, m_intpTownsend, m_extrLowTownsend,
+                  m_extrHighTownsend);
     }
   }
 
@@ -538,6 +699,7 @@ bool Medium::ElectronAttachment(const double ex, const double ey,
 
   eta = 0.;
   if (!m_hasElectronAttachment) return false;
+  FetchTables(PendingAttachment, true);
   // Compute the magnitude of the electric field.
   const double e = sqrt(ex * ex + ey * ey + ez * ez);
   const double e0 = ScaleElectricField(e);
@@ -551,28 +713,28 @@ bool Medium::ElectronAttachment(const double ex, const double ey,
 
     // Interpolate.
     if (e0 < m_eFields[thrElectronAttachment]) {
-      if (!Numerics::Boxin3(tabElectronAttachment, m_bAngles, m_bFields, m_eFields,
-                            m_bAngles.size(), m_bFields.size(), m_eFields.size(), ebang, b, e0, eta,
-                            1)) {
+      if (!Interpolate3D(View(tabElectronAttachment, GasTable::Attachment),
+                         ebang, b, e0, eta, 1)) {
         eta = -30.;
       }
     } else {
-      if (!Numerics::Boxin3(tabElectronAttachment, m_bAngles, m_bFields, m_eFields,
-                            m_bAngles.size(), m_bFields.size(), m_eFields.size(), ebang, b, e0, eta,
-                            m_intpAttachment)) {
+      if (!Interpolate3D(View(tabElectronAttachment, GasTable::Attachment),
+                         ebang, b, e0, eta, m_intpAttachment)) {
         eta = -30.;
       }
     }
   } else {
     // Interpolate.
     if (e0 < m_eFields[thrElectronAttachment]) {
-      eta = Interpolate1D(e0, tabElectronAttachment[0][0], m_eFields, 1,
-                          m_extrLowAttachment, m_extrHighAttachment);
+      eta = Interpolate1D(
+                e0, View(tabElectronAttachment, GasTable::Attachment).Row(0, 0),
+                m_eFields, 1, m_extrLowAttachment, m_extrHighAttachment);
     } else {
       eta =
-          Interpolate1D(e0, tabElectronAttachment[0][0], m_eFields,
-                        m_intpAttachment, 
-                        m_extrLowAttachment, m_extrHighAttachment);
+          Interpolate1D(
+              e0, View(tabElectronAttachment, GasTable::Attachment).Row(0, 0),
+              m_eFields, m_intpAttachment, m_extrLowAttachment,
+              m_extrHighAttachment);
     }
   }
 
@@ -594,6 +756,7 @@ bool Medium::ElectronLorentzAngle(const double ex, const double ey,
 
   lor = 0.;
   if (!m_hasElectronLorentzAngle) return false;
+  FetchTables(PendingLorentzAngle, true);
   // Compute the magnitude of the electric field.
   const double e = sqrt(ex * ex + ey * ey + ez * ez);
   const double e0 = ScaleElectricField(e);
@@ -606,17 +769,17 @@ bool Medium::ElectronLorentzAngle(const double ex, const double ey,
     const double ebang = GetAngle(ex, ey, ez, bx, by, bz, e, b);
 
     // Interpolate.
-    if (!Numerics::Boxin3(tabElectronLorentzAngle, m_bAngles, m_bFields, m_eFields,
-                          m_bAngles.size(), m_bFields.size(), m_eFields.size(), ebang, b, e0, lor,
-                          m_intpLorentzAngle)) {
+    if (!Interpolate3D(View(tabElectronLorentzAngle, GasTable::LorentzAngle),
+                       ebang, b, e0, lor, m_intpLorentzAngle)) {
       lor = 0.;
     }
   } else {
     // Interpolate.
     lor =
-        Interpolate1D(e0, tabElectronLorentzAngle[0][0], m_eFields,
-                      m_intpLorentzAngle, 
-                      m_extrLowLorentzAngle, m_extrHighLorentzAngle);
+        Interpolate1D(
+            e0, View(tabElectronLorentzAngle, GasTable::LorentzAngle).Row(0, 0),
+            m_eFields, m_intpLorentzAngle, m_extrLowLorentzAngle,
+            m_extrHighLorentzAngle);
   }
   // Apply scaling.
   lor = ScaleLorentzAngle(lor);
@@ -743,9 +906,7 @@ bool Medium::HoleVelocity(const double ex, const double ey, const double ez,
     // Calculate the velocity along E.
     double ve = 0.;
     if (m_map2d) {
-      if (!Numerics::Boxin3(tabHoleVelocityE, m_bAngles, m_bFields, m_eFields,
-                            m_bAngles.size(), m_bFields.size(), m_eFields.size(), ebang, b, e0, ve,
-                            m_intpVelocity)) {
+      if (!Interpolate3D(tabHoleVelocityE, ebang, b, e0, ve, m_intpVelocity)) {
         std::cerr << m_className << "::HoleVelocity:\n";
         std::cerr << "    Interpolation of velocity along E failed.\n";
         return false;
@@ -795,23 +956,18 @@ bool Medium::HoleVelocity(const double ex, const double ey, const double ez,
     // Calculate the velocities in all directions.
     double ve = 0., vbt = 0., vexb = 0.;
     if (m_map2d) {
-      if (!Numerics::Boxin3(tabHoleVelocityE, m_bAngles, m_bFields, m_eFields,
-                            m_bAngles.size(), m_bFields.size(), m_eFields.size(), ebang, b, e0, ve,
-                            m_intpVelocity)) {
+      if (!Interpolate3D(tabHoleVelocityE, ebang, b, e0, ve, m_intpVelocity)) {
         std::cerr << m_className << "::HoleVelocity:\n";
         std::cerr << "    Interpolation of velocity along E failed.\n";
         return false;
       }
-      if (!Numerics::Boxin3(tabHoleVelocityExB, m_bAngles, m_bFields, m_eFields,
-                            m_bAngles.size(), m_bFields.size(), m_eFields.size(), ebang, b, e0, vexb,
-                            m_intpVelocity)) {
+      if (!Interpolate3D(tabHoleVelocityExB, ebang, b, e0, vexb,
+                         m_intpVelocity)) {
         std::cerr << m_className << "::HoleVelocity:\n";
         std::cerr << "    Interpolation of velocity along ExB failed.\n";
         return false;
       }
-      if (!Numerics::Boxin3(tabHoleVelocityB, m_bAngles, m_bFields, m_eFields,
-                            m_bAngles.size(), m_bFields.size(), m_eFields.size(), ebang, b, e0, vbt,
-                            m_intpVelocity)) {
+      if (!Interpolate3D(tabHoleVelocityB, ebang, b, e0, vbt, m_intpVelocity)) {
         std::cerr << m_className << "::HoleVelocity:\n";
         std::cerr << "    Interpolation of velocity along Bt failed.\n";
         return false;
@@ -837,9 +993,7 @@ bool Medium::HoleVelocity(const double ex, const double ey, const double ez,
     // Calculate the velocity along E.
     double ve = 0.;
     if (m_map2d) {
-      if (!Numerics::Boxin3(tabHoleVelocityE, m_bAngles, m_bFields, m_eFields,
-                            m_bAngles.size(), m_bFields.size(), m_eFields.size(), ebang, b, e0, ve,
-                            m_intpVelocity)) {
+      if (!Interpolate3D(tabHoleVelocityE, ebang, b, e0, ve, m_intpVelocity)) {
         std::cerr << m_className << "::HoleVelocity:\n";
         std::cerr << "    Interpolation of velocity along E failed.\n";
         return false;
@@ -879,16 +1033,12 @@ bool Medium::HoleDiffusion(const double ex, const double ey, const double ez,
 
     // Interpolate.
     if (m_hasHoleDiffLong) {
-      if (!Numerics::Boxin3(tabHoleDiffLong, m_bAngles, m_bFields, m_eFields, m_bAngles.size(),
-                            m_bFields.size(), m_eFields.size(), ebang, b, e0, dl,
-                            m_intpDiffusion)) {
+      if (!Interpolate3D(tabHoleDiffLong, ebang, b, e0, dl, m_intpDiffusion)) {
         dl = 0.;
       }
     }
     if (m_hasHoleDiffTrans) {
-      if (!Numerics::Boxin3(tabHoleDiffTrans, m_bAngles, m_bFields, m_eFields,
-                            m_bAngles.size(), m_bFields.size(), m_eFields.size(), ebang, b, e0, dt,
-                            m_intpDiffusion)) {
+      if (!Interpolate3D(tabHoleDiffTrans, ebang, b, e0, dt, m_intpDiffusion)) {
         dt = 0.;
       }
     }
@@ -946,9 +1096,8 @@ bool Medium::HoleDiffusion(const double ex, const double ey, const double ez,
     // Interpolate.
     double diff = 0.;
     for (int l = 0; l < 6; ++l) {
-      if (!Numerics::Boxin3(tabHoleDiffTens[l], m_bAngles, m_bFields, m_eFields,
-                            m_bAngles.size(), m_bFields.size(), m_eFields.size(), ebang, b, e0, diff,
-                            m_intpDiffusion)) {
+      if (!Interpolate3D(tabHoleDiffTens[l], ebang, b, e0, diff,
+                         m_intpDiffusion)) {
         diff = 0.;
       }
       // Apply scaling.
@@ -1005,14 +1154,12 @@ bool Medium::HoleTownsend(const double ex, const double ey, const double ez,
 
     // Interpolate.
     if (e0 < m_eFields[thrHoleTownsend]) {
-      if (!Numerics::Boxin3(tabHoleTownsend, m_bAngles, m_bFields, m_eFields, m_bAngles.size(),
-                            m_bFields.size(), m_eFields.size(), ebang, b, e0, alpha, 1)) {
+      if (!Interpolate3D(tabHoleTownsend, ebang, b, e0, alpha, 1)) {
         alpha = -30.;
       }
     } else {
-      if (!Numerics::Boxin3(tabHoleTownsend, m_bAngles, m_bFields, m_eFields, m_bAngles.size(),
-                            m_bFields.size(), m_eFields.size(), ebang, b, e0, alpha,
-                            m_intpTownsend)) {
+      if (!Interpolate3D(tabHoleTownsend, ebang, b, e0, alpha,
+                         m_intpTownsend)) {
         alpha = -30.;
       }
     }
@@ -1057,15 +1204,12 @@ bool Medium::HoleAttachment(const double ex, const double ey, const double ez,
 
     // Interpolate.
     if (e0 < m_eFields[thrHoleAttachment]) {
-      if (!Numerics::Boxin3(tabHoleAttachment, m_bAngles, m_bFields, m_eFields,
-                            m_bAngles.size(), m_bFields.size(), m_eFields.size(), ebang, b, e0, eta,
-                            1)) {
+      if (!Interpolate3D(tabHoleAttachment, ebang, b, e0, eta, 1)) {
         eta = -30.;
       }
     } else {
-      if (!Numerics::Boxin3(tabHoleAttachment, m_bAngles, m_bFields, m_eFields,
-                            m_bAngles.size(), m_bFields.size(), m_eFields.size(), ebang, b, e0, eta,
-                            m_intpAttachment)) {
+      if (!Interpolate3D(tabHoleAttachment, ebang, b, e0, eta,
+                         m_intpAttachment)) {
         eta = -30.;
       }
     }
@@ -1098,6 +1242,7 @@ bool Medium::IonVelocity(const double ex, const double ey, const double ez,
 
   vx = vy = vz = 0.;
   if (!m_hasIonMobility) return false;
+  FetchTables(PendingMobility, true);
   // Compute the magnitude of the electric field.
   const double e = sqrt(ex * ex + ey * ey + ez * ez);
   const double e0 = ScaleElectricField(e);
@@ -1110,14 +1255,15 @@ bool Medium::IonVelocity(const double ex, const double ey, const double ez,
     // Compute the angle between B field and E field.
     const double ebang = GetAngle(ex, ey, ez, bx, by, bz, e, b);
 
-    if (!Numerics::Boxin3(tabIonMobility, m_bAngles, m_bFields, m_eFields, m_bAngles.size(),
-                          m_bFields.size(), m_eFields.size(), ebang, b, e0, mu, 
-                          m_intpMobility)) {
+    if (!Interpolate3D(View(tabIonMobility, GasTable::IonMobility), ebang, b,
+                       e0, mu, m_intpMobility)) {
       mu = 0.;
     }
   } else {
-    mu = Interpolate1D(e0, tabIonMobility[0][0], m_eFields, m_intpMobility,
-                       m_extrLowMobility, m_extrHighMobility);
+    mu = Interpolate1D(e0,
+                       View(tabIonMobility, GasTable::IonMobility).Row(0, 0),
+                       m_eFields, m_intpMobility, m_extrLowMobility,
+                       m_extrHighMobility);
   }
 
   const double q = 1.;
@@ -1155,16 +1301,12 @@ bool Medium::IonDiffusion(const double ex, const double ey, const double ez,
 
     // Interpolate.
     if (m_hasIonDiffLong) {
-      if (!Numerics::Boxin3(tabIonDiffLong, m_bAngles, m_bFields, m_eFields, m_bAngles.size(),
-                            m_bFields.size(), m_eFields.size(), ebang, b, e0, dl,
-                            m_intpDiffusion)) {
+      if (!Interpolate3D(tabIonDiffLong, ebang, b, e0, dl, m_intpDiffusion)) {
         dl = 0.;
       }
     }
     if (m_hasIonDiffTrans) {
-      if (!Numerics::Boxin3(tabIonDiffTrans, m_bAngles, m_bFields, m_eFields, m_bAngles.size(),
-                            m_bFields.size(), m_eFields.size(), ebang, b, e0, dt,
-                            m_intpDiffusion)) {
+      if (!Interpolate3D(tabIonDiffTrans, ebang, b, e0, dt, m_intpDiffusion)) {
         dt = 0.;
       }
     }
@@ -1197,6 +1339,7 @@ bool Medium::IonDissociation(const double ex, const double ey, const double ez,
 
   diss = 0.;
   if (!m_hasIonDissociation) return false;
+  FetchTables(PendingDissociation, true);
   // Compute the magnitude of the electric field.
   const double e = sqrt(ex * ex + ey * ey + ez * ez);
   const double e0 = ScaleElectricField(e);
@@ -1209,27 +1352,29 @@ bool Medium::IonDissociation(const double ex, const double ey, const double ez,
     const double ebang = GetAngle(ex, ey, ez, bx, by, bz, e, b);
     // Interpolate.
     if (e0 < m_eFields[thrIonDissociation]) {
-      if (!Numerics::Boxin3(tabIonDissociation, m_bAngles, m_bFields, m_eFields,
-                            m_bAngles.size(), m_bFields.size(), m_eFields.size(), ebang, b, e0, diss,
-                            1)) {
+      if (!Interpolate3D(View(tabIonDissociation, GasTable::IonDissociation),
+                         ebang, b, e0, diss, 1)) {
         diss = -30.;
       }
     } else {
-      if (!Numerics::Boxin3(tabIonDissociation, m_bAngles, m_bFields, m_eFields,
-                            m_bAngles.size(), m_bFields.size(), m_eFields.size(), ebang, b, e0, diss,
-                            m_intpDissociation)) {
+      if (!Interpolate3D(View(tabIonDissociation, GasTable::IonDissociation),
+                         ebang, b, e0, diss, m_intpDissociation)) {
         diss = -30.;
       }
     }
   } else {
     // Interpolate.
     if (e0 < m_eFields[thrIonDissociation]) {
-      diss = Interpolate1D(e0, tabIonDissociation[0][0], m_eFields, 1,
-                           m_extrLowDissociation, m_extrHighDissociation);
+      diss = Interpolate1D(
+                 e0,
+                 View(tabIonDissociation, GasTable::IonDissociation).Row(0, 0),
+                 m_eFields, 1, m_extrLowDissociation, m_extrHighDissociation);
     } else {
-      diss = Interpolate1D(e0, tabHoleTownsend[0][0], m_eFields, 
-                           m_intpDissociation,
-                           m_extrLowDissociation, m_extrHighDissociation);
+      diss = Interpolate1D(
+                 e0,
+                 View(tabIonDissociation, GasTable::IonDissociation).Row(0, 0),
+                 m_eFields, m_intpDissociation, m_extrLowDissociation,
+                 m_extrHighDissociation);
     }
   }
 
@@ -1330,6 +1475,7 @@ bool Medium::GetPhotonCollision(const double e, int& type, int& level,
 
 void Medium::ResetElectronVelocity() {
 
+  DetachGasTable();
   tabElectronVelocityE.clear();
   tabElectronVelocityB.clear();
   tabElectronVelocityExB.clear();
@@ -1340,6 +1486,7 @@ void Medium::ResetElectronVelocity() {
 
 void Medium::ResetElectronDiffusion() {
 
+  DetachGasTable();
   tabElectronDiffLong.clear();
   tabElectronDiffTrans.clear();
   tabElectronDiffTens.clear();
@@ -1350,17 +1497,20 @@ void Medium::ResetElectronDiffusion() {
 
 void Medium::ResetElectronTownsend() {
 
+  DetachGasTable();
   tabElectronTownsend.clear();
 }
 
 void Medium::ResetElectronAttachment() {
 
+  DetachGasTable();
   tabElectronAttachment.clear();
   m_hasElectronAttachment = false;
 }
 
 void Medium::ResetElectronLorentzAngle() {
 
+  DetachGasTable();
   tabElectronLorentzAngle.clear();
   m_hasElectronLorentzAngle = false;
 }
@@ -1399,12 +1549,14 @@ void Medium::ResetHoleAttachment() {
 
 void Medium::ResetIonMobility() {
 
+  DetachGasTable();
   tabIonMobility.clear();
   m_hasIonMobility = false;
 }
 
 void Medium::ResetIonDiffusion() {
 
+  DetachGasTable();
   tabIonDiffLong.clear();
   tabIonDiffTrans.clear();
   m_hasIonDiffLong = false;
@@ -1413,6 +1565,7 @@ void Medium::ResetIonDiffusion() {
 
 void Medium::ResetIonDissociation() {
 
+  DetachGasTable();
   tabIonDissociation.clear();
   m_hasIonDissociation = false;
 }
@@ -1611,6 +1764,7 @@ void Medium::SetFieldGrid(const std::vector<double>& efields,
   }
 
   // Clone the existing tables.
+  DetachGasTable();
   // Electrons
   CloneTable(tabElectronVelocityE, efields, bfields, angles, m_intpVelocity,
              m_extrLowVelocity, m_extrHighVelocity, 0.,
@@ -1702,6 +1856,561 @@ void Medium::GetFieldGrid(std::vector<double>& efields,
   angles = m_bAngles;
 }
 
+bool Medium::LoadGasTable(const std::string& filename) {
+
+  GasTable* table = new GasTable();
+  if (m_useLazyLoading) table->EnableLazyLoading();
+  if (!table->Load(filename)) {
+    std::cerr << m_className << "::LoadGasTable:\n"
+              << "    Could not read " << filename << ".\n";
+    delete table;
+    return false;
+  }
+  return AdoptGasTable(table);
+}
+
+bool Medium::LoadGasTable(const GasLibrary& library, const double emin,
+                          const double emax) {
+
+  // Only the composition of the exported table is used.
+  GasTable table;
+  if (!ExportGasTable(table)) return false;
+  const int i = library.Find(table.GetMixture(), m_pressure, m_temperature,
+                             emin, emax);
+  if (i < 0) {
+    std::cerr << m_className << "::LoadGasTable:\n"
+              << "    No matching gas table in " << library.GetDirectory()
+              << ".\n";
+    return false;
+  }
+  if (m_debug) {
+    std::cout << m_className << "::LoadGasTable:\n"
+              << "    Loading " << library.GetPath(i) << ".\n";
+  }
+  return LoadGasTable(library.GetPath(i));
+}
+
+bool Medium::MergeGasTable(const std::string& filename) {
+
+  GasTable other;
+  if (!other.Load(filename)) {
+    std::cerr << m_className << "::MergeGasTable:\n"
+              << "    Could not read " << filename << ".\n";
+    return false;
+  }
+  // Merge at the level of the loaded table, which (unlike the exported
+  // one) has the composition and the excitation and ionisation rates.
+  if (m_gasTable) {
+    ExportSettings(*m_gasTable);
+    if (!m_gasTable->Merge(other)) return false;
+    if (ImportGasTable(*m_gasTable)) return true;
+    ReleaseGasTable();
+    return false;
+  }
+  GasTable table;
+  if (!ExportGasTable(table)) return false;
+  if (!table.Merge(other)) return false;
+  return ImportGasTable(table);
+}
+
+bool Medium::RescaleGasTable(const double pressure,
+                             const double temperature) {
+
+  if (m_gasTable) {
+    ExportSettings(*m_gasTable);
+    if (!m_gasTable->Rescale(pressure, temperature)) return false;
+    if (ImportGasTable(*m_gasTable)) return true;
+    ReleaseGasTable();
+    return false;
+  }
+  GasTable table;
+  if (!ExportGasTable(table)) return false;
+  if (!table.Rescale(pressure, temperature)) return false;
+  return ImportGasTable(table);
+}
+
+bool Medium::ShareGasTable(const std::string& name) {
+
+  if (m_gasTable) {
+    ExportSettings(*m_gasTable);
+    return m_gasTable->WriteShared(name);
+  }
+  GasTable table;
+  if (!ExportGasTable(table)) return false;
+  return table.WriteShared(name);
+}
+
+bool Medium::AttachGasTable(const std::string& name) {
+
+  GasTable* table = new GasTable();
+  if (!table->LoadShared(name)) {
+    delete table;
+    return false;
+  }
+  return AdoptGasTable(table);
+}
+
+bool Medium::AdoptGasTable(GasTable* table) {
+
+  ReleaseGasTable();
+  // Keep the table as long as the transport tables are not changed.
+  m_gasTable = table;
+  const bool ok = ImportGasTable(*table);
+  if (!ok) ReleaseGasTable();
+  return ok;
+}
+
+bool Medium::WriteGasTable(const std::string& filename, const bool binary) {
+
+  if (m_gasTable) {
+    ExportSettings(*m_gasTable);
+    return binary ? m_gasTable->WriteBinary(filename)
+                  : m_gasTable->WriteText(filename);
+  }
+  GasTable table;
+  if (!ExportGasTable(table)) return false;
+  return binary ? table.WriteBinary(filename) : table.WriteText(filename);
+}
+
+bool Medium::ImportGasTable(const GasTable& table) {
+
+  const double p = table.GetPressure();
+  if (table.IsEmpty() || p <= 0.) {
+    std::cerr << m_className << "::ImportGasTable:\n"
+              << "    Table is empty or has no valid pressure.\n";
+    return false;
+  }
+  // Columns are only converted on demand if the table is owned by this
+  // medium (i. e. read by LoadGasTable with lazy loading enabled).
+  // The columns of a mapped table (binary file or shared memory segment)
+  // are not copied at all, but read in place.
+  const bool owned = &table == m_gasTable;
+  const bool lazy = m_useLazyLoading && owned;
+  const bool mapped = owned && table.IsMapped();
+  if (!owned) ReleaseGasTable();
+  m_pendingTables = 0;
+  m_mappedTables = 0;
+  const unsigned int nE = table.GetNumberOfElectricFields();
+  const unsigned int nA = table.GetNumberOfAngles();
+  const unsigned int nB = table.GetNumberOfMagneticFields();
+
+  // The gas file stores E/p and B in units of 0.01 T.
+  m_eFields.resize(nE);
+  for (unsigned int i = 0; i < nE; ++i) {
+    m_eFields[i] = table.GetElectricFields()[i] * p;
+  }
+  m_bAngles.assign(table.GetAngles(), table.GetAngles() + nA);
+  m_bFields.resize(nB);
+  for (unsigned int i = 0; i < nB; ++i) {
+    m_bFields[i] = table.GetMagneticFields()[i] * 0.01;
+  }
+  m_map2d = table.Is3d();
+  m_pressure = p;
+  m_temperature = table.GetTemperature();
+  m_isChanged = true;
+
+  m_hasElectronVelocityE = table.HasQuantity(GasTable::VelocityE);
+  m_hasElectronVelocityB = table.HasQuantity(GasTable::VelocityB);
+  m_hasElectronVelocityExB = table.HasQuantity(GasTable::VelocityExB);
+  m_hasElectronDiffLong = table.HasQuantity(GasTable::DiffLong);
+  m_hasElectronDiffTrans = table.HasQuantity(GasTable::DiffTrans);
+  m_hasElectronDiffTens = table.HasQuantity(GasTable::DiffTensor);
+  m_hasElectronAttachment = table.HasQuantity(GasTable::Attachment);
+  m_hasElectronLorentzAngle = table.HasQuantity(GasTable::LorentzAngle);
+  m_hasIonMobility = table.HasQuantity(GasTable::IonMobility);
+  m_hasIonDissociation = table.HasQuantity(GasTable::IonDissociation);
+  const unsigned int quantities[] = {
+      GasTable::VelocityE, GasTable::VelocityB, GasTable::VelocityExB,
+      GasTable::DiffLong, GasTable::DiffTrans, GasTable::DiffTensor,
+      GasTable::Townsend, GasTable::Attachment, GasTable::LorentzAngle,
+      GasTable::IonMobility, GasTable::IonDissociation};
+  const unsigned int nQuantities = sizeof(quantities) / sizeof(quantities[0]);
+  for (unsigned int i = 0; i < nQuantities; ++i) {
+    const unsigned int q = quantities[i];
+    if (!table.HasQuantity(q)) continue;
+    if (mapped) {
+      m_mappedTables |= 1u << q;
+    } else if (lazy) {
+      m_pendingTables |= 1u << q;
+    }
+  }
+  // Convert the other quantities now (this also clears the tables
+  // of the pending and mapped ones).
+  for (unsigned int i = 0; i < nQuantities; ++i) {
+    ImportGasTableColumn(table, quantities[i]);
+  }
+  // Ion diffusion coefficients are given as constants.
+  const double sqrp = sqrt(p);
+  const double ionDiffL = table.GetParameter(GasTable::IonDiffLong);
+  const double ionDiffT = table.GetParameter(GasTable::IonDiffTrans);
+  m_hasIonDiffLong = ionDiffL > 0.;
+  m_hasIonDiffTrans = ionDiffT > 0.;
+  tabIonDiffLong.clear();
+  tabIonDiffTrans.clear();
+  if (m_hasIonDiffLong) {
+    InitParamArrays(nE, nB, nA, tabIonDiffLong, ionDiffL / sqrp);
+  }
+  if (m_hasIonDiffTrans) {
+    InitParamArrays(nE, nB, nA, tabIonDiffTrans, ionDiffT / sqrp);
+  }
+
+  // Extrapolation and interpolation methods (indexed like the GASOK bits).
+  m_extrLowVelocity = table.GetExtrapolationLow(0);
+  m_extrHighVelocity = table.GetExtrapolationHigh(0);
+  m_extrLowMobility = table.GetExtrapolationLow(1);
+  m_extrHighMobility = table.GetExtrapolationHigh(1);
+  m_extrLowDiffusion = table.GetExtrapolationLow(2);
+  m_extrHighDiffusion = table.GetExtrapolationHigh(2);
+  m_extrLowTownsend = table.GetExtrapolationLow(3);
+  m_extrHighTownsend = table.GetExtrapolationHigh(3);
+  m_extrLowAttachment = table.GetExtrapolationLow(5);
+  m_extrHighAttachment = table.GetExtrapolationHigh(5);
+  m_extrLowLorentzAngle = table.GetExtrapolationLow(6);
+  m_extrHighLorentzAngle = table.GetExtrapolationHigh(6);
+  m_extrLowDissociation = table.GetExtrapolationLow(11);
+  m_extrHighDissociation = table.GetExtrapolationHigh(11);
+  m_intpVelocity = table.GetInterpolation(0);
+  m_intpMobility = table.GetInterpolation(1);
+  m_intpDiffusion = table.GetInterpolation(2);
+  m_intpTownsend = table.GetInterpolation(3);
+  m_intpAttachment = table.GetInterpolation(5);
+  m_intpLorentzAngle = table.GetInterpolation(6);
+  m_intpDissociation = table.GetInterpolation(11);
+  const int nMax = nE - 1;
+  thrElectronTownsend = std::min(std::max(table.GetThreshold(0), 0), nMax);
+  thrElectronAttachment = std::min(std::max(table.GetThreshold(1), 0), nMax);
+  thrIonDissociation = std::min(std::max(table.GetThreshold(2), 0), nMax);
+  return true;
+}
+
+bool Medium::ExportGasTable(GasTable& table) const {
+
+  return ExportTables(table, m_pressure, m_temperature);
+}
+
+bool Medium::ExportTables(GasTable& table, const double p,
+                          const double t) const {
+
+  // Converting the pending columns of a lazily loaded table does not
+  // change the transport parameters, mapped columns are read in place.
+  const_cast<Medium*>(this)->FetchTables(PendingAll, true);
+  if (m_eFields.empty() || p <= 0.) {
+    std::cerr << m_className << "::ExportGasTable:\n"
+              << "    No field grid or invalid pressure.\n";
+    return false;
+  }
+  const unsigned int nE = m_eFields.size();
+  std::vector<double> efields(nE, 0.);
+  for (unsigned int i = 0; i < nE; ++i) efields[i] = m_eFields[i] / p;
+  std::vector<double> bfields(m_bFields.size(), 0.);
+  for (unsigned int i = 0; i < m_bFields.size(); ++i) {
+    bfields[i] = m_bFields[i] * 100.;
+  }
+  if (!table.Initialise(m_map2d, efields, m_bAngles, bfields)) return false;
+  table.SetParameter(GasTable::Pressure, p);
+  table.SetParameter(GasTable::Temperature, t);
+
+  const double sqrp = sqrt(p);
+  const double logp = log(p);
+  if (m_hasElectronVelocityE) {
+    SetGasTableColumn(table, GasTable::VelocityE,
+                      View(tabElectronVelocityE, GasTable::VelocityE), 1.e3,
+                      0.);
+  }
+  if (m_hasElectronVelocityB) {
+    SetGasTableColumn(table, GasTable::VelocityB,
+                      View(tabElectronVelocityB, GasTable::VelocityB), 1.e3,
+                      0.);
+  }
+  if (m_hasElectronVelocityExB) {
+    SetGasTableColumn(table, GasTable::VelocityExB,
+                      View(tabElectronVelocityExB, GasTable::VelocityExB),
+                      1.e3, 0.);
+  }
+  if (m_hasElectronDiffLong) {
+    SetGasTableColumn(table, GasTable::DiffLong,
+                      View(tabElectronDiffLong, GasTable::DiffLong), sqrp,
+                      0.);
+  }
+  if (m_hasElectronDiffTrans) {
+    SetGasTableColumn(table, GasTable::DiffTrans,
+                      View(tabElectronDiffTrans, GasTable::DiffTrans), sqrp,
+                      0.);
+  }
+  if (m_hasElectronDiffTens && !DiffTensorView(5).IsEmpty()) {
+    for (unsigned int l = 0; l < 6; ++l) {
+      SetGasTableColumn(table, GasTable::DiffTensor + l, DiffTensorView(l), p,
+                        0.);
+    }
+  }
+  const TableView townsend = View(tabElectronTownsend, GasTable::Townsend);
+  if (!townsend.IsEmpty()) {
+    SetGasTableColumn(table, GasTable::Townsend, townsend, 1., -logp);
+    SetGasTableColumn(table, GasTable::TownsendNoPenning, townsend, 1., -logp);
+  }
+  if (m_hasElectronAttachment) {
+    SetGasTableColumn(table, GasTable::Attachment,
+                      View(tabElectronAttachment, GasTable::Attachment), 1.,
+                      -logp);
+  }
+  if (m_hasElectronLorentzAngle) {
+    SetGasTableColumn(table, GasTable::LorentzAngle,
+                      View(tabElectronLorentzAngle, GasTable::LorentzAngle),
+                      1., 0.);
+  }
+  if (m_hasIonMobility) {
+    SetGasTableColumn(table, GasTable::IonMobility,
+                      View(tabIonMobility, GasTable::IonMobility), 1.e3, 0.);
+  }
+  if (m_hasIonDissociation) {
+    SetGasTableColumn(table, GasTable::IonDissociation,
+                      View(tabIonDissociation, GasTable::IonDissociation), 1.,
+                      -logp);
+  }
+  if (m_hasIonDiffLong && !tabIonDiffLong.empty()) {
+    table.SetParameter(GasTable::IonDiffLong, tabIonDiffLong[0][0][0] * sqrp);
+  }
+  if (m_hasIonDiffTrans && !tabIonDiffTrans.empty()) {
+    table.SetParameter(GasTable::IonDiffTrans,
+                       tabIonDiffTrans[0][0][0] * sqrp);
+  }
+
+  ExportSettings(table);
+  return true;
+}
+
+void Medium::ExportSettings(GasTable& table) const {
+
+  table.SetExtrapolation(0, m_extrLowVelocity, m_extrHighVelocity);
+  table.SetExtrapolation(1, m_extrLowMobility, m_extrHighMobility);
+  table.SetExtrapolation(2, m_extrLowDiffusion, m_extrHighDiffusion);
+  table.SetExtrapolation(3, m_extrLowTownsend, m_extrHighTownsend);
+  table.SetExtrapolation(5, m_extrLowAttachment, m_extrHighAttachment);
+  table.SetExtrapolation(6, m_extrLowLorentzAngle, m_extrHighLorentzAngle);
+  table.SetExtrapolation(11, m_extrLowDissociation, m_extrHighDissociation);
+  table.SetInterpolation(0, m_intpVelocity);
+  table.SetInterpolation(1, m_intpMobility);
+  table.SetInterpolation(2, m_intpDiffusion);
+  table.SetInterpolation(3, m_intpTownsend);
+  table.SetInterpolation(5, m_intpAttachment);
+  table.SetInterpolation(6, m_intpLorentzAngle);
+  table.SetInterpolation(11, m_intpDissociation);
+  table.SetThreshold(0, thrElectronTownsend);
+  table.SetThreshold(1, thrElectronAttachment);
+  table.SetThreshold(2, thrIonDissociation);
+}
+
+void Medium::ImportGasTableColumn(const GasTable& table,
+                                  const unsigned int q) {
+
+  // Columns still to be converted, or read in place, are not copied.
+  const bool pending = ((m_pendingTables | m_mappedTables) & (1u << q)) != 0;
+  const double p = table.GetPressure();
+  double scale = 1.;
+  double shift = 0.;
+  GetColumnScale(q, p, scale, shift);
+  std::vector<std::vector<std::vector<double> > >* tab = NULL;
+  switch (q) {
+    case GasTable::VelocityE:
+      tab = &tabElectronVelocityE;
+      break;
+    case GasTable::VelocityB:
+      tab = &tabElectronVelocityB;
+      break;
+    case GasTable::VelocityExB:
+      tab = &tabElectronVelocityExB;
+      break;
+    case GasTable::DiffLong:
+      tab = &tabElectronDiffLong;
+      break;
+    case GasTable::DiffTrans:
+      tab = &tabElectronDiffTrans;
+      break;
+    case GasTable::Townsend:
+      tab = &tabElectronTownsend;
+      break;
+    case GasTable::Attachment:
+      tab = &tabElectronAttachment;
+      break;
+    case GasTable::LorentzAngle:
+      tab = &tabElectronLorentzAngle;
+      break;
+    case GasTable::IonMobility:
+      tab = &tabIonMobility;
+      break;
+    case GasTable::IonDissociation:
+      tab = &tabIonDissociation;
+      break;
+    case GasTable::DiffTensor:
+      tabElectronDiffTens.clear();
+      if (pending || !table.HasQuantity(q)) return;
+      tabElectronDiffTens.resize(6);
+      for (unsigned int l = 0; l < 6; ++l) {
+        GetColumnScale(q + l, p, scale, shift);
+        GetGasTableColumn(table, q + l, tabElectronDiffTens[l], scale, shift);
+      }
+      return;
+    default:
+      return;
+  }
+  if (pending) {
+    tab->clear();
+    return;
+  }
+  GetGasTableColumn(table, q, *tab, scale, shift);
+}
+
+void Medium::GetColumnScale(const unsigned int q, const double p,
+                            double& scale, double& shift) {
+
+  // Convert from reduced values, and from cm / us to cm / ns.
+  scale = 1.;
+  shift = 0.;
+  switch (q) {
+    case GasTable::VelocityE:
+    case GasTable::VelocityB:
+    case GasTable::VelocityExB:
+    case GasTable::IonMobility:
+      scale = 1.e-3;
+      break;
+    case GasTable::DiffLong:
+    case GasTable::DiffTrans:
+      scale = 1. / sqrt(p);
+      break;
+    case GasTable::Townsend:
+    case GasTable::TownsendNoPenning:
+    case GasTable::Attachment:
+    case GasTable::IonDissociation:
+      shift = log(p);
+      break;
+    default:
+      // Components of the diffusion tensor
+      if (q >= GasTable::DiffTensor && q < GasTable::ExcitationRates) {
+        scale = 1. / p;
+      }
+      break;
+  }
+}
+
+void Medium::ImportPendingTables(const unsigned int mask) {
+
+  if (!m_gasTable) {
+    m_pendingTables = 0;
+    m_mappedTables = 0;
+    return;
+  }
+  if (m_debug) {
+    std::cout << m_className << "::ImportPendingTables:\n"
+              << "    Converting columns " << std::hex
+              << (m_pendingTables & mask) << std::dec << ".\n";
+  }
+  for (unsigned int q = 0; q <= GasTable::DiffTensor; ++q) {
+    const unsigned int bit = 1u << q;
+    if (!(m_pendingTables & mask & bit)) continue;
+    m_pendingTables &= ~bit;
+    ImportGasTableColumn(*m_gasTable, q);
+  }
+}
+
+void Medium::ReleaseGasTable() {
+
+  delete m_gasTable;
+  m_gasTable = NULL;
+  m_pendingTables = 0;
+  m_mappedTables = 0;
+}
+
+void Medium::DetachGasTable() {
+
+  FetchTables(PendingAll);
+  ReleaseGasTable();
+}
+
+Medium::TableView Medium::View(
+    const std::vector<std::vector<std::vector<double> > >& tab,
+    const unsigned int q) const {
+
+  // The components of the diffusion tensor share one bit.
+  const unsigned int bit =
+      1u << std::min(q, (unsigned int)GasTable::DiffTensor);
+  if (!m_gasTable || !(m_mappedTables & bit)) return TableView(tab);
+  const double* col = m_gasTable->GetQuantity(q);
+  if (!col) return TableView(tab);
+  double scale = 1.;
+  double shift = 0.;
+  GetColumnScale(q, m_gasTable->GetPressure(), scale, shift);
+  return TableView(col, m_gasTable->GetNumberOfAngles(),
+                   m_gasTable->GetNumberOfMagneticFields(),
+                   m_gasTable->GetNumberOfElectricFields(), scale, shift);
+}
+
+Medium::TableView Medium::DiffTensorView(const unsigned int l) const {
+
+  static const std::vector<std::vector<std::vector<double> > > noTable;
+  return View(l < tabElectronDiffTens.size() ? tabElectronDiffTens[l]
+                                             : noTable,
+              GasTable::DiffTensor + l);
+}
+
+bool Medium::TableView::HasGrid(const unsigned int nA, const unsigned int nB,
+                                const unsigned int nE) const {
+
+  if (m_col) return nA == m_nA && nB == m_nB && nE == m_nE;
+  if (m_tab->size() < nA) return false;
+  for (unsigned int j = 0; j < nA; ++j) {
+    if ((*m_tab)[j].size() < nB) return false;
+    for (unsigned int k = 0; k < nB; ++k) {
+      if ((*m_tab)[j][k].size() < nE) return false;
+    }
+  }
+  return true;
+}
+
+void Medium::GetGasTableColumn(
+    const GasTable& table, const unsigned int q,
+    std::vector<std::vector<std::vector<double> > >& tab, const double scale,
+    const double shift) const {
+
+  tab.clear();
+  if (!table.HasQuantity(q)) return;
+  const double* col = table.GetQuantity(q);
+  if (!col) return;
+  const unsigned int nE = table.GetNumberOfElectricFields();
+  const unsigned int nA = table.GetNumberOfAngles();
+  const unsigned int nB = table.GetNumberOfMagneticFields();
+  tab.assign(nA, std::vector<std::vector<double> >(nB));
+  for (unsigned int j = 0; j < nA; ++j) {
+    for (unsigned int k = 0; k < nB; ++k) {
+      const double* row = col + table.GetIndex(0, j, k);
+      std::vector<double>& v = tab[j][k];
+      v.resize(nE);
+      for (unsigned int i = 0; i < nE; ++i) v[i] = row[i] * scale + shift;
+    }
+  }
+}
+
+void Medium::SetGasTableColumn(GasTable& table, const unsigned int q,
+                               const TableView& tab, const double scale,
+                               const double shift) const {
+
+  double* col = table.GetWritableQuantity(q);
+  if (!col) return;
+  const unsigned int nE = table.GetNumberOfElectricFields();
+  const unsigned int nA = table.GetNumberOfAngles();
+  const unsigned int nB = table.GetNumberOfMagneticFields();
+  if (tab.IsEmpty() || !tab.HasGrid(nA, nB, nE)) return;
+  for (unsigned int j = 0; j < nA; ++j) {
+    for (unsigned int k = 0; k < nB; ++k) {
+      const TableRow values = tab.Row(j, k);
+      double* row = col + table.GetIndex(0, j, k);
+      for (unsigned int i = 0; i < nE; ++i) {
+        row[i] = values[i] * scale + shift;
+      }
+    }
+  }
+  table.SetQuantity(q, true);
+}
+
 bool Medium::GetElectronVelocityE(const unsigned int ie, 
                                   const unsigned int ib, 
                                   const unsigned int ia, double& v) {
@@ -1722,7 +2431,8 @@ bool Medium::GetElectronVelocityE(const unsigned int ie,
     return false;
   }
 
-  v = tabElectronVelocityE[ia][ib][ie];
+  FetchTables(PendingVelocity, true);
+  v = View(tabElectronVelocityE, GasTable::VelocityE)(ia, ib, ie);
   return true;
 }
 
@@ -1746,7 +2456,8 @@ bool Medium::GetElectronVelocityExB(const unsigned int ie,
     return false;
   }
 
-  v = tabElectronVelocityExB[ia][ib][ie];
+  FetchTables(PendingVelocity, true);
+  v = View(tabElectronVelocityExB, GasTable::VelocityExB)(ia, ib, ie);
   return true;
 }
 
@@ -1770,7 +2481,8 @@ bool Medium::GetElectronVelocityB(const unsigned int ie,
     return false;
   }
 
-  v = tabElectronVelocityB[ia][ib][ie];
+  FetchTables(PendingVelocity, true);
+  v = View(tabElectronVelocityB, GasTable::VelocityB)(ia, ib, ie);
   return true;
 }
 
@@ -1795,7 +2507,8 @@ bool Medium::GetElectronLongitudinalDiffusion(const unsigned int ie,
     return false;
   }
 
-  dl = tabElectronDiffLong[ia][ib][ie];
+  FetchTables(PendingDiffusion, true);
+  dl = View(tabElectronDiffLong, GasTable::DiffLong)(ia, ib, ie);
   return true;
 }
 
@@ -1820,7 +2533,8 @@ bool Medium::GetElectronTransverseDiffusion(const unsigned int ie,
     return false;
   }
 
-  dt = tabElectronDiffTrans[ia][ib][ie];
+  FetchTables(PendingDiffusion, true);
+  dt = View(tabElectronDiffTrans, GasTable::DiffTrans)(ia, ib, ie);
   return true;
 }
 
@@ -1835,7 +2549,8 @@ bool Medium::GetElectronTownsend(const unsigned int ie,
     alpha = 0.;
     return false;
   }
-  if (tabElectronTownsend.empty()) {
+  FetchTables(PendingTownsend, true);
+  if (View(tabElectronTownsend, GasTable::Townsend).IsEmpty()) {
     if (m_debug) {
       std::cerr << m_className << "::GetElectronTownsend:\n";
       std::cerr << "    Data not available.\n";
@@ -1844,7 +2559,7 @@ bool Medium::GetElectronTownsend(const unsigned int ie,
     return false;
   }
 
-  alpha = tabElectronTownsend[ia][ib][ie];
+  alpha = View(tabElectronTownsend, GasTable::Townsend)(ia, ib, ie);
   return true;
 }
 
@@ -1868,7 +2583,8 @@ bool Medium::GetElectronAttachment(const unsigned int ie,
     return false;
   }
 
-  eta = tabElectronAttachment[ia][ib][ie];
+  FetchTables(PendingAttachment, true);
+  eta = View(tabElectronAttachment, GasTable::Attachment)(ia, ib, ie);
   return true;
 }
 
@@ -1892,7 +2608,8 @@ bool Medium::GetElectronLorentzAngle(const unsigned int ie,
     return false;
   }
 
-  lor = tabElectronLorentzAngle[ia][ib][ie];
+  FetchTables(PendingLorentzAngle, true);
+  lor = View(tabElectronLorentzAngle, GasTable::LorentzAngle)(ia, ib, ie);
   return true;
 }
 
@@ -2083,7 +2800,8 @@ bool Medium::GetIonMobility(const unsigned int ie, const unsigned int ib,
     return false;
   }
 
-  mu = tabIonMobility[ia][ib][ie];
+  FetchTables(PendingMobility, true);
+  mu = View(tabIonMobility, GasTable::IonMobility)(ia, ib, ie);
   return true;
 }
 
@@ -2155,7 +2873,8 @@ bool Medium::GetIonDissociation(const unsigned int ie,
     return false;
   }
 
-  diss = tabIonDissociation[ia][ib][ie];
+  FetchTables(PendingDissociation, true);
+  diss = View(tabIonDissociation, GasTable::IonDissociation)(ia, ib, ie);
   return true;
 }
 
@@ -2192,9 +2911,8 @@ void Medium::CloneTable(std::vector<std::vector<std::vector<double> > >& tab,
       for (int k = 0; k < nAnglesNew; ++k) {
         double val = 0.;
         if (m_map2d) {
-          if (!Numerics::Boxin3(tab, m_bAngles, m_bFields, m_eFields, m_bAngles.size(),
-                                m_bFields.size(), m_eFields.size(), angles[k], bfields[j],
-                                efields[i], val, intp)) {
+          if (!Interpolate3D(tab, angles[k], bfields[j], efields[i], val,
+                             intp)) {
             std::cerr << m_className << "::SetFieldGrid:\n";
             std::cerr << "    Interpolation of " << label << " failed.\n";
             std::cerr << "    Cannot copy value to new grid at: \n";
@@ -2255,9 +2973,8 @@ void Medium::CloneTensor(
         for (unsigned int k = 0; k < nAnglesNew; ++k) {
           double val = 0.;
           if (m_map2d) {
-            if (!Numerics::Boxin3(tab[l], m_bAngles, m_bFields, m_eFields, m_bAngles.size(),
-                                  m_bFields.size(), m_eFields.size(), angles[k], bfields[j],
-                                  efields[i], val, intp)) {
+            if (!Interpolate3D(tab[l], angles[k], bfields[j], efields[i], val,
+                               intp)) {
               std::cerr << m_className << "::SetFieldGrid:\n";
               std::cerr << "    Interpolation of " << label << " failed.\n";
               std::cerr << "    Cannot copy value to new grid at: \n";
@@ -2315,6 +3032,7 @@ bool Medium::SetIonMobility(const unsigned int ie, const unsigned int ib,
     return false;
   }
 
+  DetachGasTable();
   tabIonMobility[ia][ib][ie] = mu;
   if (m_debug) {
     std::cout << m_className << "::SetIonMobility:\n";
@@ -2587,7 +3305,7 @@ double Medium::GetAngle(const double ex, const double ey, const double ez,
   return acos(std::min(1., eb / (e * b)));
 } 
 
-double Medium::Interpolate1D(const double e, const std::vector<double>& table,
+double Medium::Interpolate1D(const double e, const TableRow& table,
                              const std::vector<double>& fields,
                              const unsigned int intpMeth, const int extrLow,
                              const int extrHigh) {
@@ -2656,12 +3374,48 @@ double Medium::Interpolate1D(const double e, const std::vector<double>& table,
   } else {
     // Intermediate points, spline interpolation (not implemented).
     // Intermediate points, Newtonian interpolation
-    result = Numerics::Divdif(table, fields, nSizeTable, e, intpMeth);
+    result = Divdif(table, fields, nSizeTable, e, intpMeth);
   }
 
   return result;
 }
 
+bool Medium::Interpolate3D(const TableView& tab, const double ebang,
+                           const double b, const double e, double& f,
+                           const unsigned int order) const {
+
+  // This function follows BOXIN3, but reads the table through a view
+  // (so mapped tables need not be copied).
+  f = 0.;
+  if (order > 2 || tab.IsEmpty()) {
+    if (m_debug) {
+      std::cerr << m_className << "::Interpolate3D:\n";
+      std::cerr << "    Incorrect order or empty table.\n";
+    }
+    return false;
+  }
+  unsigned int ia0 = 0, ia1 = 0, ib0 = 0, ib1 = 0, ie0 = 0, ie1 = 0;
+  double wa[4], wb[4], we[4];
+  if (!BoxinWeights(m_bAngles, ebang, order, ia0, ia1, wa) ||
+      !BoxinWeights(m_bFields, b, order, ib0, ib1, wb) ||
+      !BoxinWeights(m_eFields, e, order, ie0, ie1, we)) {
+    if (m_debug) {
+      std::cerr << m_className << "::Interpolate3D:\n";
+      std::cerr << "    Empty grid or coinciding grid points.\n";
+    }
+    return false;
+  }
+  for (unsigned int ia = ia0; ia <= ia1; ++ia) {
+    for (unsigned int ib = ib0; ib <= ib1; ++ib) {
+      const TableRow row = tab.Row(ia, ib);
+      for (unsigned int ie = ie0; ie <= ie1; ++ie) {
+        f += row[ie] * wa[ia - ia0] * wb[ib - ib0] * we[ie - ie0];
+      }
+    }
+  }
+  return true;
+}
+
 void Medium::InitParamArrays(
     const unsigned int eRes, const unsigned int bRes, 
     const unsigned int aRes,
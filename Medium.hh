@@ -6,6 +6,9 @@
 
 namespace Garfield {
 
+class GasTable;
+class GasLibrary;
+
 /// Abstract base class for media.
 
 class Medium {
@@ -164,6 +167,39 @@ class Medium {
   void GetFieldGrid(std::vector<double>& efields, std::vector<double>& bfields,
                     std::vector<double>& angles);
 
+  // Read/write the transport tables from/to a gas table file
+  // (text or memory-mapped binary format). The table read is kept until
+  // the transport tables are changed, and written, merged, rescaled and
+  // shared instead of the exported one (so the composition and the
+  // excitation and ionisation rates are kept).
+  bool LoadGasTable(const std::string& filename);
+  // Load the table of a gas library matching the composition (as set by
+  // ExportGasTable), pressure and temperature of the medium and covering
+  // the electric field range [emin, emax] [V/cm].
+  bool LoadGasTable(const GasLibrary& library, const double emin = 0.,
+                    const double emax = 0.);
+  bool WriteGasTable(const std::string& filename, const bool binary = true);
+  // Add the grid points of a gas table of the same gas (e.g. computed
+  // in a separate job for another E range or B field/angle slice).
+  bool MergeGasTable(const std::string& filename);
+  // Reuse the transport tables at another pressure [Torr] and
+  // temperature [K] by scaling with the gas density (constant E/N).
+  bool RescaleGasTable(const double pressure, const double temperature);
+  // Publish the transport tables in a named POSIX shared-memory segment,
+  // or attach to a segment published by another process (read-only).
+  // Attaching saves reading and parsing a file, and the tables are read
+  // in place (like those of a binary file loaded by LoadGasTable), so
+  // processes attached to the same segment share one copy of the table.
+  bool ShareGasTable(const std::string& name);
+  bool AttachGasTable(const std::string& name);
+  // Copy the transport tables from/to a gas table.
+  virtual bool ImportGasTable(const GasTable& table);
+  virtual bool ExportGasTable(GasTable& table) const;
+  // Convert the columns of a table read by LoadGasTable only when the
+  // corresponding transport parameter is used for the first time.
+  void EnableLazyLoading() { m_useLazyLoading = true; }
+  void DisableLazyLoading() { m_useLazyLoading = false; }
+
   bool GetElectronVelocityE(const unsigned int ie, 
                             const unsigned int ib, 
                             const unsigned int ia, double& v);
@@ -401,14 +437,112 @@ class Medium {
   unsigned int m_intpMobility;
   unsigned int m_intpDissociation;
 
+  // Lazy loading of gas tables
+  bool m_useLazyLoading;
+  // Table read by LoadGasTable or AttachGasTable, kept as long as it
+  // describes the transport tables (some columns may not yet be converted
+  // or are read in place)
+  GasTable* m_gasTable;
+  // Quantities (bits indexed by GasTable::Quantity) still to be converted
+  unsigned int m_pendingTables;
+  // Quantities read in place from a mapped table (binary file or
+  // shared memory segment)
+  unsigned int m_mappedTables;
+
+  // Row of a transport table along E (value * scale + shift).
+  struct TableRow {
+    const double* values;
+    double scale, shift;
+    TableRow(const double* v, const double s, const double c)
+        : values(v), scale(s), shift(c) {}
+    TableRow(const std::vector<double>& v)
+        : values(v.empty() ? NULL : &v[0]), scale(1.), shift(0.) {}
+    double operator[](const unsigned int i) const {
+      return values[i] * scale + shift;
+    }
+  };
+  // Transport table indexed [angle][B][E], either the nested vectors
+  // or a column of a mapped gas table (which is not copied).
+  class TableView {
+   public:
+    TableView(const std::vector<std::vector<std::vector<double> > >& tab)
+        : m_tab(&tab), m_col(NULL), m_nA(0), m_nB(0), m_nE(0), m_scale(1.),
+          m_shift(0.) {}
+    TableView(const double* col, const unsigned int nA, const unsigned int nB,
+              const unsigned int nE, const double scale, const double shift)
+        : m_tab(NULL), m_col(col), m_nA(nA), m_nB(nB), m_nE(nE),
+          m_scale(scale), m_shift(shift) {}
+    bool IsEmpty() const { return m_col ? false : m_tab->empty(); }
+    // Check that the table covers a grid of nA x nB x nE points.
+    bool HasGrid(const unsigned int nA, const unsigned int nB,
+                 const unsigned int nE) const;
+    TableRow Row(const unsigned int ia, const unsigned int ib) const {
+      if (m_col) {
+        return TableRow(m_col + (ia * m_nB + ib) * m_nE, m_scale, m_shift);
+      }
+      return TableRow((*m_tab)[ia][ib]);
+    }
+    double operator()(const unsigned int ia, const unsigned int ib,
+                      const unsigned int ie) const {
+      return Row(ia, ib)[ie];
+    }
+
+   private:
+    const std::vector<std::vector<std::vector<double> > >* m_tab;
+    const double* m_col;
+    unsigned int m_nA, m_nB, m_nE;
+    double m_scale, m_shift;
+  };
+  // Table of a quantity, read in place if it is mapped.
+  TableView View(const std::vector<std::vector<std::vector<double> > >& tab,
+                 const unsigned int q) const;
+  TableView DiffTensorView(const unsigned int l) const;
+
   double GetAngle(const double ex, const double ey, const double ez,
                   const double bx, const double by, const double bz,
                   const double e, const double b) const;
-  double Interpolate1D(const double e, const std::vector<double>& table,
+  double Interpolate1D(const double e, const TableRow& table,
                        const std::vector<double>& fields, 
                        const unsigned int intpMeth,
                        const int jExtr, const int iExtr);
+  // Interpolation (order 0 - 2) in the (angle, B, E) grid.
+  bool Interpolate3D(const TableView& tab, const double ebang, const double b,
+                     const double e, double& f, const unsigned int order) const;
   bool GetExtrapolationIndex(std::string extrStr, unsigned int& extrNb);
+  // Fill the tables of a gas table in reduced units (pressure p).
+  bool ExportTables(GasTable& table, const double p, const double t) const;
+  // Copy the extrapolation and interpolation methods and thresholds.
+  void ExportSettings(GasTable& table) const;
+  // Copy a quantity (value * scale + shift) from/to a gas table.
+  void GetGasTableColumn(const GasTable& table, const unsigned int q,
+                         std::vector<std::vector<std::vector<double> > >& tab,
+                         const double scale, const double shift) const;
+  void SetGasTableColumn(GasTable& table, const unsigned int q,
+                         const TableView& tab, const double scale,
+                         const double shift) const;
+  // Conversion (value * scale + shift) of a quantity from a gas table
+  // at pressure p.
+  static void GetColumnScale(const unsigned int q, const double p,
+                             double& scale, double& shift);
+  // Convert a quantity of a gas table to the transport tables.
+  virtual void ImportGasTableColumn(const GasTable& table,
+                                    const unsigned int q);
+  // Make sure the given quantities of a lazily loaded table are converted
+  // (or, if inPlace is set, can be read through View).
+  void FetchTables(const unsigned int mask, const bool inPlace = false) {
+    if (!inPlace && (m_mappedTables & mask)) {
+      m_pendingTables |= m_mappedTables & mask;
+      m_mappedTables &= ~mask;
+    }
+    if (m_pendingTables & mask) ImportPendingTables(mask);
+  }
+  void ImportPendingTables(const unsigned int mask);
+  // Import a table read by LoadGasTable or AttachGasTable (takes ownership).
+  bool AdoptGasTable(GasTable* table);
+  void ReleaseGasTable();
+  // Convert all columns and drop the table read by LoadGasTable
+  // (before the transport tables are changed).
+  void DetachGasTable();
   void CloneTable(std::vector<std::vector<std::vector<double> > >& tab,
                   const std::vector<double>& efields,
                   const std::vector<double>& bfields,
@@ -437,6 +571,11 @@ class Medium {
       const unsigned int aRes, const unsigned int tRes,
       std::vector<std::vector<std::vector<std::vector<double> > > >& tab,
       const double val);
+
+ private:
+  // Copying would share the gas table kept for lazy loading.
+  Medium(const Medium&);
+  Medium& operator=(const Medium&);
 };
 }
 
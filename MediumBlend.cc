@@ -0,0 +1,81 @@
+#include <iostream>
+#include <cmath>
+#include <algorithm>
+
+#include "MediumBlend.hh"
+
+namespace Garfield {
+
+MediumBlend::MediumBlend() : MediumMagboltz(), m_blendFraction(-1.) {
+
+  m_className = "MediumBlend";
+}
+
+MediumBlend::~MediumBlend() { ClearGasTables(); }
+
+bool MediumBlend::AddGasTable(const std::string& filename) {
+
+  GasTable* table = new GasTable();
+  if (!table->Load(filename)) {
+    std::cerr << m_className << "::AddGasTable:\n"
+              << "    Could not read " << filename << ".\n";
+    delete table;
+    return false;
+  }
+  m_tables.push_back(table);
+  return true;
+}
+
+void MediumBlend::ClearGasTables() {
+
+  for (unsigned int i = 0; i < m_tables.size(); ++i) delete m_tables[i];
+  m_tables.clear();
+  m_errors.Clear();
+  m_blendFraction = -1.;
+}
+
+bool MediumBlend::SetFraction(const std::string& gas, const double f) {
+
+  int ng = 0;
+  if (!GetGasNumberGasFile(gas, ng) || ng < 1 ||
+      ng > (int)GasTable::nMixture) {
+    std::cerr << m_className << "::SetFraction:\n"
+              << "    Unknown gas " << gas << ".\n";
+    return false;
+  }
+  if (f < 0. || f > 1.) {
+    std::cerr << m_className << "::SetFraction:\n"
+              << "    Fraction must be between 0 and 1.\n";
+    return false;
+  }
+  std::vector<const GasTable*> tables(m_tables.begin(), m_tables.end());
+  GasTable table;
+  if (!GasTable::Interpolate(tables, ng - 1, 100. * f, table, m_errors)) {
+    return false;
+  }
+  if (!ImportGasTable(table)) return false;
+  m_blendFraction = f;
+  if (m_debug) {
+    std::cout << m_className << "::SetFraction:\n"
+              << "    " << m_name << ", " << 100. * f << "% " << gas
+              << " from " << m_tables.size() << " tables.\n";
+    if (HasErrorEstimate()) {
+      std::cout << "    Max. error estimates: drift velocity "
+                << GetMaxError(GasTable::VelocityE) << " cm/us, Townsend "
+                << 100. * GetMaxError(GasTable::Townsend) << "%.\n";
+    }
+  }
+  return true;
+}
+
+double MediumBlend::GetMaxError(const unsigned int q) const {
+
+  if (!m_errors.HasQuantity(q)) return 0.;
+  const double* e = m_errors.GetQuantity(q);
+  if (!e) return 0.;
+  double emax = 0.;
+  const unsigned int np = m_errors.GetNumberOfPoints();
+  for (unsigned int i = 0; i < np; ++i) emax = std::max(emax, fabs(e[i]));
+  return emax;
+}
+}
@@ -0,0 +1,55 @@
+#ifndef G_MEDIUM_BLEND_H
+#define G_MEDIUM_BLEND_H
+
+#include <string>
+#include <vector>
+
+#include "MediumMagboltz.hh"
+#include "GasTable.hh"
+
+namespace Garfield {
+
+/// Gas with transport tables interpolated in the fraction of one
+/// component between precomputed tables.
+///
+/// The tables (e.g. Ar/iC4H10 99/1, 95/5, 90/10) must have the same
+/// field grid, pressure and temperature and differ only in the fraction
+/// of one gas, the other gases keeping their proportions. SetFraction
+/// blends them into a virtual table (see GasTable::Interpolate), which
+/// is used like a table read by LoadGasTable; the composition of the
+/// gas is set accordingly.
+
+class MediumBlend : public MediumMagboltz {
+
+ public:
+  // Constructor
+  MediumBlend();
+  // Destructor
+  virtual ~MediumBlend();
+
+  // Add a table to the set of tables to interpolate between.
+  bool AddGasTable(const std::string& filename);
+  void ClearGasTables();
+  unsigned int GetNumberOfGasTables() const { return m_tables.size(); }
+
+  // Interpolate the tables at a fraction (0 - 1) of a gas.
+  bool SetFraction(const std::string& gas, const double f);
+  double GetFraction() const { return m_blendFraction; }
+
+  // Error estimate of the interpolated table (same layout and units,
+  // available if there are at least three tables).
+  bool HasErrorEstimate() const { return !m_errors.IsEmpty(); }
+  const GasTable& GetErrorEstimate() const { return m_errors; }
+  // Largest estimated error of a quantity (GasTable::Quantity) over the
+  // grid, in the units of the gas table (relative error for the
+  // logarithmic Townsend and attachment coefficients).
+  double GetMaxError(const unsigned int q) const;
+
+ private:
+  std::vector<GasTable*> m_tables;
+  GasTable m_errors;
+  double m_blendFraction;
+};
+}
+
+#endif
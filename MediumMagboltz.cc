@@ -1,9 +1,15 @@
 #include <iostream>
 #include <iomanip>
 #include <fstream>
+#include <sstream>
 #include <cmath>
+#include <cstring>
+#include <cstdio>
 
 #include <map>
+#include <unistd.h>
+#include <sys/time.h>
+#include <algorithm>
 
 #include <TMath.h>
 
@@ -14,31 +20,226 @@
 #include "GarfieldConstants.hh"
 #include "OpticalData.hh"
 
+// Default size of the collision rate tables (see SetTableSize).
+// Presets: -DMAGBOLTZ_TABLES_COMPACT (drift gases, electron energies up to
+// a few hundred eV, small memory footprint) and -DMAGBOLTZ_TABLES_HIGHRES
+// (finer high-energy and photon tables). Individual sizes can be set by
+// defining the MAGBOLTZ_* macros below directly. Only the library build
+// is affected, the layout of MediumMagboltz does not depend on them.
+#if defined(MAGBOLTZ_TABLES_COMPACT)
+#ifndef MAGBOLTZ_ENERGY_STEPS
+#define MAGBOLTZ_ENERGY_STEPS 4000
+#endif
+#ifndef MAGBOLTZ_ENERGY_STEPS_LOG
+#define MAGBOLTZ_ENERGY_STEPS_LOG 50
+#endif
+#ifndef MAGBOLTZ_ENERGY_STEPS_GAMMA
+#define MAGBOLTZ_ENERGY_STEPS_GAMMA 1000
+#endif
+#elif defined(MAGBOLTZ_TABLES_HIGHRES)
+#ifndef MAGBOLTZ_ENERGY_STEPS_LOG
+#define MAGBOLTZ_ENERGY_STEPS_LOG 1000
+#endif
+#ifndef MAGBOLTZ_ENERGY_STEPS_GAMMA
+#define MAGBOLTZ_ENERGY_STEPS_GAMMA 20000
+#endif
+#endif
+// Standard settings
+#ifndef MAGBOLTZ_ENERGY_STEPS
+#define MAGBOLTZ_ENERGY_STEPS 20000
+#endif
+#ifndef MAGBOLTZ_ENERGY_STEPS_LOG
+#define MAGBOLTZ_ENERGY_STEPS_LOG 200
+#endif
+#ifndef MAGBOLTZ_ENERGY_STEPS_GAMMA
+#define MAGBOLTZ_ENERGY_STEPS_GAMMA 5000
+#endif
+// The linear table is filled by Magboltz, whose arrays hold 20000 steps.
+#if MAGBOLTZ_ENERGY_STEPS < 1 || MAGBOLTZ_ENERGY_STEPS > 20000
+#error "MAGBOLTZ_ENERGY_STEPS must be between 1 and 20000."
+#endif
+#if MAGBOLTZ_ENERGY_STEPS_LOG < 2 || MAGBOLTZ_ENERGY_STEPS_LOG % 2 != 0
+#error "MAGBOLTZ_ENERGY_STEPS_LOG must be an even number."
+#endif
+
+namespace {
+
+// Adaptor forwarding to the global random number generator.
+struct GlobalRandom {
+  double Uniform() { return Garfield::RndmUniform(); }
+  double UniformPos() { return Garfield::RndmUniformPos(); }
+  double Voigt(const double mu, const double sigma, const double gamma) {
+    return Garfield::RndmVoigt(mu, sigma, gamma);
+  }
+};
+
+// Wall-clock time [s].
+double WallTime() {
+  timeval t;
+  gettimeofday(&t, NULL);
+  return t.tv_sec + 1.e-6 * t.tv_usec;
+}
+
+// Quantities of a gas table point stored as gas table diagnostics.
+const char* DiagnosticNames[] = {
+    "requestedCollisions", "efinal", "efinalIterations", "estart", "sst",
+    "time", "vx", "vy", "vz", "vxerr", "vyerr", "vzerr", "dl", "dt", "dlerr",
+    "dterr", "alpha", "eta", "alphaerr", "etaerr", "alphatof", "lor",
+    "lorerr", "difxx", "difyy", "difzz", "difxy", "difxz", "difyz",
+    "tofene", "tofwv", "tofwr", "tofdl", "tofdt", "rion", "ratt", "ralpha",
+    "rattof"};
+const unsigned int nDiagnostics =
+    sizeof(DiagnosticNames) / sizeof(DiagnosticNames[0]);
+
+void GetDiagnostics(const Garfield::MediumMagboltz::GasTablePoint& p,
+                    double* values) {
+  const double x[nDiagnostics] = {
+      p.requestedCollisions, p.efinal, double(p.efinalIterations), p.estart,
+      p.sst ? 1. : 0., p.time, p.vx, p.vy, p.vz, p.vxerr, p.vyerr, p.vzerr,
+      p.dl, p.dt, p.dlerr, p.dterr, p.alpha, p.eta, p.alphaerr, p.etaerr,
+      p.alphatof, p.lor, p.lorerr, p.difxx, p.difyy, p.difzz, p.difxy,
+      p.difxz, p.difyz, p.tofene, p.tofwv, p.tofwr, p.tofdl, p.tofdt,
+      p.rion, p.ratt, p.ralpha, p.rattof};
+  for (unsigned int i = 0; i < nDiagnostics; ++i) values[i] = x[i];
+}
+
+// Heap-allocated scratch space, released when going out of scope.
+template <class T>
+class ScratchBuffer {
+ public:
+  ScratchBuffer() : m_p(new T) {}
+  ~ScratchBuffer() { delete m_p; }
+  T& operator*() { return *m_p; }
+
+ private:
+  T* m_p;
+  ScratchBuffer(const ScratchBuffer&);
+  ScratchBuffer& operator=(const ScratchBuffer&);
+};
+
+// Raw binary I/O of values and arrays (for the table cache).
+template <class T>
+void WriteRaw(std::ofstream& out, const T* p, const unsigned int n) {
+  out.write(reinterpret_cast<const char*>(p), n * sizeof(T));
+}
+
+template <class T>
+bool ReadRaw(std::ifstream& in, T* p, const unsigned int n) {
+  in.read(reinterpret_cast<char*>(p), n * sizeof(T));
+  return in.good();
+}
+
+void WriteString(std::ofstream& out, const std::string& s) {
+  const unsigned int n = s.size();
+  WriteRaw(out, &n, 1);
+  WriteRaw(out, s.data(), n);
+}
+
+bool ReadString(std::ifstream& in, std::string& s) {
+  unsigned int n = 0;
+  if (!ReadRaw(in, &n, 1) || n > (1u << 20)) return false;
+  s.assign(n, ' ');
+  return n == 0 || ReadRaw(in, &s[0], n);
+}
+
+template <class T>
+void WriteVector(std::ofstream& out, const std::vector<T>& v) {
+  const unsigned int n = v.size();
+  WriteRaw(out, &n, 1);
+  if (n > 0) WriteRaw(out, &v[0], n);
+}
+
+template <class T>
+bool ReadVector(std::ifstream& in, std::vector<T>& v) {
+  unsigned int n = 0;
+  if (!ReadRaw(in, &n, 1) || n > (1u << 20)) return false;
+  v.resize(n);
+  return n == 0 || ReadRaw(in, &v[0], n);
+}
+
+// Build an alias table (Walker/Vose) from a list of n cumulative
+// probabilities, such that a channel can be drawn with one random number.
+void ComputeAliasTable(const std::vector<double>& pCum, const int n,
+                       std::vector<double>& cut, std::vector<int>& alias) {
+
+  cut.assign(n, 1.);
+  alias.resize(n);
+  if (n <= 0) return;
+  std::vector<int> small, large;
+  double pLast = 0.;
+  for (int j = 0; j < n; ++j) {
+    alias[j] = j;
+    cut[j] = (pCum[j] - pLast) * n;
+    pLast = pCum[j];
+    if (cut[j] < 1.) {
+      small.push_back(j);
+    } else {
+      large.push_back(j);
+    }
+  }
+  while (!small.empty() && !large.empty()) {
+    const int l = small.back();
+    small.pop_back();
+    const int g = large.back();
+    alias[l] = g;
+    cut[g] -= 1. - cut[l];
+    if (cut[g] < 1.) {
+      large.pop_back();
+      small.push_back(g);
+    }
+  }
+  // Remaining entries (rounding errors) are accepted with probability one.
+  for (unsigned int j = 0; j < small.size(); ++j) cut[small[j]] = 1.;
+  for (unsigned int j = 0; j < large.size(); ++j) cut[large[j]] = 1.;
+}
+}
+
 namespace Garfield {
 
 const int MediumMagboltz::DxcTypeRad = 0;
 const int MediumMagboltz::DxcTypeCollIon = 1;
 const int MediumMagboltz::DxcTypeCollNonIon = -1;
+const double MediumMagboltz::secMinExcess = 0.0625;
 
 MediumMagboltz::MediumMagboltz()
     : MediumGas(),
+      m_nEnergySteps(MAGBOLTZ_ENERGY_STEPS),
+      m_nEnergyStepsLog(MAGBOLTZ_ENERGY_STEPS_LOG),
+      m_nEnergyStepsGamma(MAGBOLTZ_ENERGY_STEPS_GAMMA),
       m_eFinal(40.),
-      m_eStep(m_eFinal / nEnergySteps),
+      m_eStep(m_eFinal / m_nEnergySteps),
       m_eHigh(1.e4),
       m_eHighLog(log(m_eHigh)),
       m_lnStep(1.),
       m_useAutoAdjust(true),
+      m_eRangeGrowth(1.5),
       m_useCsOutput(false),
+      m_tableDensity(0.),
       m_nTerms(0),
       m_useAnisotropic(true),
+      m_useFastKinematics(false),
+      m_logKeyOffset(0),
+      m_logKeyShift(0),
+      m_nColumns(0),
       m_nPenning(0),
+      m_nTruncatedCascades(0),
       m_useDeexcitation(false),
       m_useRadTrap(true),
       m_useOpalBeaty(true),
       m_useGreenSawada(false),
+      m_useSecondaryEnergyTable(false),
+      m_secKeyOffset(0),
+      m_nSecRows(0),
       m_eFinalGamma(20.),
-      m_eStepGamma(m_eFinalGamma / nEnergyStepsGamma) {
- 
+      m_eStepGamma(m_eFinalGamma / m_nEnergyStepsGamma),
+      m_lineWidthMax(0.),
+      m_magboltzRun(),
+      m_gasTableCallback(NULL),
+      m_gasTableCallbackData(NULL),
+      m_storeDiagnostics(false) {
+
+  m_cfTot.assign(m_nEnergySteps, 0.);
+  m_cfTotLog.assign(m_nEnergyStepsLog, 0.);
   fit3d4p = fitHigh4p = 1.;
   fit3dQCO2 = fit3dQCH4 = fit3dQC2H6 = 1.;
   fit3dEtaCO2 = fit3dEtaCH4 = fit3dEtaC2H6 = 0.5;
@@ -57,7 +258,7 @@ MediumMagboltz::MediumMagboltz()
 
   // Set parameters in Magboltz common blocks.
   Magboltz::inpt_.nGas = m_nComponents;
-  Magboltz::inpt_.nStep = nEnergySteps;
+  Magboltz::inpt_.nStep = m_nEnergySteps;
   // Select the scattering model.
   Magboltz::inpt_.nAniso = 2;
   // Max. energy [eV]
@@ -92,6 +293,7 @@ MediumMagboltz::MediumMagboltz()
   m_dxcProducts.clear();
 
   for (unsigned int i = 0; i < m_nMaxGases; ++i) m_scaleExc[i] = 1.;
+  for (int i = nMaxLevels; i--;) m_iSecTable[i] = -1;
 }
 
 bool MediumMagboltz::SetMaxElectronEnergy(const double e) {
@@ -106,9 +308,9 @@ bool MediumMagboltz::SetMaxElectronEnergy(const double e) {
 
   // Determine the energy interval size.
   if (m_eFinal <= m_eHigh) {
-    m_eStep = m_eFinal / nEnergySteps;
+    m_eStep = m_eFinal / m_nEnergySteps;
   } else {
-    m_eStep = m_eHigh / nEnergySteps;
+    m_eStep = m_eHigh / m_nEnergySteps;
   }
 
   // Set max. energy and step size also in Magboltz common block.
@@ -121,6 +323,145 @@ bool MediumMagboltz::SetMaxElectronEnergy(const double e) {
   return true;
 }
 
+bool MediumMagboltz::SetTableSize(const int nSteps, const int nStepsLog,
+                                  const int nStepsGamma) {
+
+  if (nSteps < 1 || nSteps > nMaxEnergySteps) {
+    std::cerr << m_className << "::SetTableSize:\n";
+    std::cerr << "    Number of linear energy steps must be between 1 and "
+              << nMaxEnergySteps << ".\n";
+    return false;
+  }
+  // The extension of the logarithmic table relies on an even number.
+  if (nStepsLog < 2 || nStepsLog % 2 != 0) {
+    std::cerr << m_className << "::SetTableSize:\n";
+    std::cerr << "    Number of logarithmic energy steps must be even.\n";
+    return false;
+  }
+  if (nStepsGamma < 1) {
+    std::cerr << m_className << "::SetTableSize:\n";
+    std::cerr << "    Number of photon energy steps must be positive.\n";
+    return false;
+  }
+  m_nEnergySteps = nSteps;
+  m_nEnergyStepsLog = nStepsLog;
+  m_nEnergyStepsGamma = nStepsGamma;
+  m_cfTot.assign(m_nEnergySteps, 0.);
+  m_cfTotLog.assign(m_nEnergyStepsLog, 0.);
+  m_collisionTable.clear();
+  m_nColumns = 0;
+  m_tableDensity = 0.;
+
+  // Update the energy interval sizes.
+  m_eStep = std::min(m_eFinal, m_eHigh) / m_nEnergySteps;
+  m_eStepGamma = m_eFinalGamma / m_nEnergyStepsGamma;
+  Magboltz::inpt_.estep = m_eStep;
+
+  // Force recalculation of the scattering rates table.
+  m_isChanged = true;
+  return true;
+}
+
+bool MediumMagboltz::SetEnergyRangeGrowthFactor(const double f) {
+
+  if (f < 1.) {
+    std::cerr << m_className << "::SetEnergyRangeGrowthFactor:\n";
+    std::cerr << "    Growth factor must be at least 1.\n";
+    return false;
+  }
+  m_eRangeGrowth = f;
+  return true;
+}
+
+bool MediumMagboltz::IncreaseEnergyRange(const double e) {
+
+  // If the tables are up to date and the new energy is within reach,
+  // keep the present tables and only add the new high-energy bins.
+  if (!m_isChanged && m_eFinal > m_eHigh && e <= m_eFinal * m_eFinal / m_eHigh) {
+    if (ExtendLogTable()) return true;
+  }
+  // Otherwise, increase the range by at least the growth factor
+  // (such that the tables need to be recomputed only a few times).
+  return SetMaxElectronEnergy(std::max(1.05 * e, m_eRangeGrowth * m_eFinal));
+}
+
+bool MediumMagboltz::EstimateMaxElectronEnergy(const double emax,
+                                               const unsigned int nCollisions,
+                                               const double margin) {
+
+  if (emax <= 0. || nCollisions == 0 || margin < 1.) {
+    std::cerr << m_className << "::EstimateMaxElectronEnergy:\n";
+    std::cerr << "    Invalid field, number of collisions or margin.\n";
+    return false;
+  }
+
+  // Track a single electron in a uniform field along -z (no magnetic field),
+  // keeping track of the highest energy reached between two collisions.
+  const double c1 = SpeedOfLight * sqrt(2. / ElectronMass);
+  const bool useAutoAdjust = m_useAutoAdjust;
+  m_useAutoAdjust = false;
+  const double e0 = 0.1;
+  double e = e0;
+  double dx = 0., dy = 0., dz = 1.;
+  double eMax = e;
+  unsigned int nColl = 0;
+  bool ok = true;
+  while (nColl < nCollisions) {
+    const double fLim = GetElectronNullCollisionRate();
+    if (fLim <= 0.) {
+      ok = false;
+      break;
+    }
+    // Free flight (momentum in units of sqrt(eV))
+    const double dt = -log(RndmUniformPos()) / fLim;
+    const double p = sqrt(e);
+    const double px = p * dx;
+    const double py = p * dy;
+    const double pz = p * dz + 0.5 * c1 * emax * dt;
+    e = px * px + py * py + pz * pz;
+    if (e <= Small) {
+      e = e0;
+      continue;
+    }
+    const double pnew = sqrt(e);
+    dx = px / pnew;
+    dy = py / pnew;
+    dz = pz / pnew;
+    if (e > eMax) eMax = e;
+    if (e > m_eFinal) {
+      if (!IncreaseEnergyRange(e)) {
+        ok = false;
+        break;
+      }
+      continue;
+    }
+    // Real or null collision?
+    if (RndmUniform() * fLim > GetElectronCollisionRate(e)) continue;
+    ++nColl;
+    int type = 0, level = 0, nion = 0, ndxc = 0, band = 0;
+    double e1 = e;
+    if (!GetElectronCollision(e, type, level, e1, dx, dy, dz, nion, ndxc,
+                              band)) {
+      ok = false;
+      break;
+    }
+    e = type == ElectronCollisionTypeAttachment ? e0 : std::max(e1, Small);
+  }
+  m_useAutoAdjust = useAutoAdjust;
+  if (!ok) {
+    std::cerr << m_className << "::EstimateMaxElectronEnergy:\n";
+    std::cerr << "    Simulation failed.\n";
+    return false;
+  }
+
+  if (m_debug) {
+    std::cout << m_className << "::EstimateMaxElectronEnergy:\n";
+    std::cout << "    Highest energy after " << nCollisions
+              << " collisions: " << eMax << " eV.\n";
+  }
+  return SetMaxElectronEnergy(margin * eMax);
+}
+
 bool MediumMagboltz::SetMaxPhotonEnergy(const double e) {
 
   if (e <= Small) {
@@ -132,7 +473,7 @@ bool MediumMagboltz::SetMaxPhotonEnergy(const double e) {
   m_eFinalGamma = e;
 
   // Determine the energy interval size.
-  m_eStepGamma = m_eFinalGamma / nEnergyStepsGamma;
+  m_eStepGamma = m_eFinalGamma / m_nEnergyStepsGamma;
 
   // Force recalculation of the scattering rates table.
   m_isChanged = true;
@@ -144,6 +485,9 @@ void MediumMagboltz::SetSplittingFunctionOpalBeaty() {
 
   m_useOpalBeaty = true;
   m_useGreenSawada = false;
+  if (m_useSecondaryEnergyTable && !m_isChanged) {
+    ComputeSecondaryEnergyTable();
+  }
 }
 
 void MediumMagboltz::SetSplittingFunctionGreenSawada() {
@@ -151,6 +495,7 @@ void MediumMagboltz::SetSplittingFunctionGreenSawada() {
   m_useOpalBeaty = false;
   m_useGreenSawada = true;
   if (m_isChanged) return;
+  if (m_useSecondaryEnergyTable) ComputeSecondaryEnergyTable();
 
   bool allset = true;
   for (unsigned int i = 0; i < m_nComponents; ++i) {
@@ -169,6 +514,15 @@ void MediumMagboltz::SetSplittingFunctionFlat() {
 
   m_useOpalBeaty = false;
   m_useGreenSawada = false;
+  if (m_useSecondaryEnergyTable && !m_isChanged) {
+    ComputeSecondaryEnergyTable();
+  }
+}
+
+void MediumMagboltz::EnableSecondaryEnergyTable() {
+
+  m_useSecondaryEnergyTable = true;
+  if (!m_isChanged) ComputeSecondaryEnergyTable();
 }
 
 void MediumMagboltz::EnableDeexcitation() {
@@ -523,6 +877,20 @@ void MediumMagboltz::PrintGas() {
   }
 }
 
+inline int MediumMagboltz::GetLogBin(const double e) const {
+
+  // Look up the bin at the lower edge of the key interval,
+  // then check if the next bin edge has been crossed.
+  uint64_t bits = 0;
+  memcpy(&bits, &e, sizeof(double));
+  uint64_t key = bits >> m_logKeyShift;
+  key = key > m_logKeyOffset ? key - m_logKeyOffset : 0;
+  if (key >= m_logKeyIndex.size()) key = m_logKeyIndex.size() - 1;
+  int iE = m_logKeyIndex[key];
+  while (iE < m_nEnergyStepsLog - 1 && e >= m_eLogEdges[iE + 1]) ++iE;
+  return iE;
+}
+
 double MediumMagboltz::GetElectronNullCollisionRate(const int band) {
 
   // If necessary, update the collision rates table.
@@ -553,11 +921,11 @@ double MediumMagboltz::GetElectronCollisionRate(const double e,
     return m_cfTot[0];
   }
   if (e > m_eFinal && m_useAutoAdjust) {
+    IncreaseEnergyRange(e);
     std::cerr << m_className << "::GetElectronCollisionRate:\n";
     std::cerr << "    Collision rate at " << e
               << " eV is not included in the current table.\n";
-    std::cerr << "    Increasing energy range to " << 1.05 * e << " eV.\n";
-    SetMaxElectronEnergy(1.05 * e);
+    std::cerr << "    Increased energy range to " << m_eFinal << " eV.\n";
   }
 
   // If necessary, update the collision rates table.
@@ -580,20 +948,17 @@ double MediumMagboltz::GetElectronCollisionRate(const double e,
   if (e <= m_eHigh) {
     // Linear binning
     iE = int(e / m_eStep);
-    if (iE >= nEnergySteps) return m_cfTot[nEnergySteps - 1];
+    if (iE >= m_nEnergySteps) return m_cfTot[m_nEnergySteps - 1];
     if (iE < 0) return m_cfTot[0];
     return m_cfTot[iE];
   }
 
+  if (m_eFinal <= m_eHigh) return m_cfTot[m_nEnergySteps - 1];
   // Logarithmic binning
-  const double eLog = log(e);
-  iE = int((eLog - m_eHighLog) / m_lnStep);
-  // Calculate the collision rate by log-log interpolation.
-  const double fmax = m_cfTotLog[iE];
-  const double fmin = iE == 0 ? log(m_cfTot[nEnergySteps - 1]) : m_cfTotLog[iE - 1];
-  const double emin = m_eHighLog + iE * m_lnStep;
-  const double f = fmin + (eLog - emin) * (fmax - fmin) / m_lnStep;
-  return exp(f);
+  iE = GetLogBin(e);
+  // Interpolate linearly between the rates at the bin edges.
+  const double de = std::min(e, m_eLogEdges[iE + 1]) - m_eLogEdges[iE];
+  return m_cfTotLogRate[iE] + de * m_cfTotLogSlope[iE];
 }
 
 double MediumMagboltz::GetElectronCollisionRate(const double e, 
@@ -620,22 +985,22 @@ double MediumMagboltz::GetElectronCollisionRate(const double e,
   double rate = GetElectronCollisionRate(e, band);
   // Get the energy interval.
   int iE = 0;
-  if (e <= m_eHigh) {
+  if (e <= m_eHigh || m_eFinal <= m_eHigh) {
     // Linear binning
     iE = int(e / m_eStep);
-    if (iE >= nEnergySteps) return m_cfTot[nEnergySteps - 1];
+    if (iE >= m_nEnergySteps) return m_cfTot[m_nEnergySteps - 1];
     if (level == 0) {
-      rate *= m_cf[iE][0];
+      rate *= Term(iE, 0).cf;
     } else {
-      rate *= m_cf[iE][level] - m_cf[iE][level - 1];
+      rate *= Term(iE, level).cf - Term(iE, level - 1).cf;
     }
   } else {
     // Logarithmic binning
-    iE = int((log(e) - m_eHighLog) / m_lnStep);
+    iE = GetLogBin(e);
     if (level == 0) {
-      rate *= m_cfLog[iE][0];
+      rate *= TermLog(iE, 0).cf;
     } else {
-      rate *= m_cfLog[iE][level] - m_cfLog[iE][level - 1];
+      rate *= TermLog(iE, level).cf - TermLog(iE, level - 1).cf;
     }
   }
   return rate;
@@ -646,13 +1011,34 @@ bool MediumMagboltz::GetElectronCollision(const double e, int& type, int& level,
                                           double& dz, int& nion, int& ndxc,
                                           int& band) {
 
+  GlobalRandom rndm;
+  return SampleElectronCollision(e, type, level, e1, dx, dy, dz, nion, ndxc,
+                                 band, rndm);
+}
+
+bool MediumMagboltz::GetElectronCollision(const double e, int& type, int& level,
+                                          double& e1, double& dx, double& dy,
+                                          double& dz, int& nion, int& ndxc,
+                                          int& band, RandomStream& rng) {
+
+  return SampleElectronCollision(e, type, level, e1, dx, dy, dz, nion, ndxc,
+                                 band, rng);
+}
+
+template <class R>
+bool MediumMagboltz::SampleElectronCollision(const double e, int& type,
+                                             int& level, double& e1,
+                                             double& dx, double& dy,
+                                             double& dz, int& nion, int& ndxc,
+                                             int& band, R& rndm) {
+
   // Check if the electron energy is within the currently set range.
   if (e > m_eFinal && m_useAutoAdjust) {
     std::cerr << m_className << "::GetElectronCollision:\n";
     std::cerr << "    Provided electron energy  (" << e
               << " eV) exceeds current energy range  (" << m_eFinal << " eV).\n";
-    std::cerr << "    Increasing energy range to " << 1.05 * e << " eV.\n";
-    SetMaxElectronEnergy(1.05 * e);
+    IncreaseEnergyRange(e);
+    std::cerr << "    Increased energy range to " << m_eFinal << " eV.\n";
   } else if (e <= 0.) {
     std::cerr << m_className << "::GetElectronCollision:\n";
     std::cerr << "    Electron energy must be greater than zero.\n";
@@ -674,100 +1060,74 @@ bool MediumMagboltz::GetElectronCollision(const double e, int& type, int& level,
     std::cerr << "    Warning: unexpected band index.\n";
   }
 
-  double angCut = 1.;
-  double angPar = 0.5;
-
-  if (e <= m_eHigh) {
+  // Get the energy interval.
+  int iE = 0;
+  if (e <= m_eHigh || m_eFinal <= m_eHigh) {
     // Linear binning
-    // Get the energy interval.
-    int iE = int(e / m_eStep);
-    if (iE >= nEnergySteps) iE = nEnergySteps - 1;
+    iE = int(e / m_eStep);
+    if (iE >= m_nEnergySteps) iE = m_nEnergySteps - 1;
     if (iE < 0) iE = 0;
-
-    // Sample the scattering process.
-    const double r = RndmUniform();
-    int iLow = 0;
-    int iUp = m_nTerms - 1;
-    if (r <= m_cf[iE][iLow]) {
-      level = iLow;
-    } else if (r >= m_cf[iE][iUp]) {
-      level = iUp;
-    } else {
-      int iMid;
-      while (iUp - iLow > 1) {
-        iMid = (iLow + iUp) >> 1;
-        if (r < m_cf[iE][iMid]) {
-          iUp = iMid;
-        } else {
-          iLow = iMid;
-        }
-      }
-      level = iUp;
-    }
-    // Get the angular distribution parameters.
-    angCut = m_scatCut[iE][level];
-    angPar = m_scatParameter[iE][level];
   } else {
     // Logarithmic binning
-    // Get the energy interval.
-    int iE = int(log(e / m_eHigh) / m_lnStep);
-    if (iE < 0) iE = 0;
-    if (iE >= nEnergyStepsLog) iE = nEnergyStepsLog - 1;
-    // Sample the scattering process.
-    const double r = RndmUniform();
-    int iLow = 0;
-    int iUp = m_nTerms - 1;
-    if (r <= m_cfLog[iE][iLow]) {
-      level = iLow;
-    } else if (r >= m_cfLog[iE][iUp]) {
-      level = iUp;
-    } else {
-      int iMid;
-      while (iUp - iLow > 1) {
-        iMid = (iLow + iUp) >> 1;
-        if (r < m_cfLog[iE][iMid]) {
-          iUp = iMid;
-        } else {
-          iLow = iMid;
-        }
+    iE = GetLogBin(e) + m_nEnergySteps;
+  }
+  const collisionTerm* row = &m_collisionTable[iE * m_nColumns];
+
+  // Sample the scattering process.
+  const double r = rndm.Uniform();
+  int iLow = 0;
+  int iUp = m_nTerms - 1;
+  if (r <= row[iLow].cf) {
+    level = iLow;
+  } else if (r >= row[iUp].cf) {
+    level = iUp;
+  } else {
+    int iMid;
+    while (iUp - iLow > 1) {
+      iMid = (iLow + iUp) >> 1;
+      if (r < row[iMid].cf) {
+        iUp = iMid;
+      } else {
+        iLow = iMid;
       }
-      level = iUp;
     }
-    // Get the angular distribution parameters.
-    angCut = m_scatCutLog[iE][level];
-    angPar = m_scatParameterLog[iE][level];
+    level = iUp;
   }
+  const collisionTerm& term = row[level];
 
   // Extract the collision type.
-  type = m_csType[level] % nCsTypes;
-  const int igas = int(m_csType[level] / nCsTypes);
+  type = term.csType % nCsTypes;
+  const int igas = int(term.csType / nCsTypes);
   // Increase the collision counters.
   ++m_nCollisions[type];
   ++m_nCollisionsDetailed[level];
 
   // Get the energy loss for this process.
-  double loss = m_energyLoss[level];
+  double loss = term.energyLoss;
   nion = ndxc = 0;
 
   if (type == ElectronCollisionTypeIonisation) {
     // Sample the secondary electron energy according to
     // the Opal-Beaty-Peterson parameterisation.
     double esec = 0.;
-    if (m_useOpalBeaty) {
+    if (m_iSecTable[level] >= 0) {
+      // Look up the tabulated distribution.
+      esec = SampleSecondaryEnergy(level, e, rndm.Uniform());
+    } else if (m_useOpalBeaty) {
       // Get the splitting parameter.
       const double w = m_wOpalBeaty[level];
-      esec = w * tan(RndmUniform() * atan(0.5 * (e - loss) / w));
+      esec = w * tan(rndm.Uniform() * atan(0.5 * (e - loss) / w));
       // Rescaling (SST)
       // esec = w * pow(esec / w, 0.9524);
     } else if (m_useGreenSawada) {
       const double w = m_gsGreenSawada[igas] * e / (e + m_gbGreenSawada[igas]);
       const double esec0 =
           m_tsGreenSawada[igas] - m_taGreenSawada[igas] / (e + m_tbGreenSawada[igas]);
-      const double r = RndmUniform();
+      const double r = rndm.Uniform();
       esec = esec0 + w * tan((r - 1.) * atan(esec0 / w) +
                              r * atan((0.5 * (e - loss) - esec0) / w));
     } else {
-      esec = RndmUniform() * (e - loss);
+      esec = rndm.Uniform() * (e - loss);
     }
     if (esec <= 0) esec = Small;
     loss += esec;
@@ -795,7 +1155,7 @@ bool MediumMagboltz::GetElectronCollision(const double e, int& type, int& level,
     // Follow the de-excitation cascade (if switched on).
     if (m_useDeexcitation && m_iDeexcitation[level] >= 0) {
       int fLevel = 0;
-      ComputeDeexcitationInternal(m_iDeexcitation[level], fLevel);
+      SampleDeexcitation(m_iDeexcitation[level], fLevel, rndm);
       ndxc = m_dxcProducts.size();
     } else if (m_usePenning) {
       m_dxcProducts.clear();
@@ -804,7 +1164,7 @@ bool MediumMagboltz::GetElectronCollision(const double e, int& type, int& level,
       // ionisation potential of one of the gases,
       // create a new electron (with probability m_rPenning).
       if (m_energyLoss[level] * m_rgas[igas] > m_minIonPot &&
-          RndmUniform() < m_rPenning[level]) {
+          rndm.Uniform() < m_rPenning[level]) {
         // The energy of the secondary electron is assumed to be given by
         // the difference of excitation and ionisation threshold.
         double esec = m_energyLoss[level] * m_rgas[igas] - m_minIonPot;
@@ -815,7 +1175,7 @@ bool MediumMagboltz::GetElectronCollision(const double e, int& type, int& level,
         newDxcProd.s = 0.;
         if (m_lambdaPenning[level] > Small) {
           // Uniform distribution within a sphere of radius lambda
-          newDxcProd.s = m_lambdaPenning[level] * pow(RndmUniformPos(), 1. / 3.);
+          newDxcProd.s = m_lambdaPenning[level] * pow(rndm.UniformPos(), 1. / 3.);
         }
         newDxcProd.energy = esec;
         newDxcProd.type = DxcProdTypeElectron;
@@ -830,17 +1190,18 @@ bool MediumMagboltz::GetElectronCollision(const double e, int& type, int& level,
   if (e < loss) loss = e - 0.0001;
 
   // Determine the scattering angle.
-  double ctheta0 = 1. - 2. * RndmUniform();
+  double ctheta0 = 1. - 2. * rndm.Uniform();
   if (m_useAnisotropic) {
-    switch (m_scatModel[level]) {
+    switch (term.scatModel) {
       case 0:
         break;
       case 1:
-        ctheta0 = 1. - RndmUniform() * angCut;
-        if (RndmUniform() > angPar) ctheta0 = -ctheta0;
+        ctheta0 = 1. - rndm.Uniform() * term.scatCut;
+        if (rndm.Uniform() > term.scatParameter) ctheta0 = -ctheta0;
         break;
       case 2:
-        ctheta0 = (ctheta0 + angPar) / (1. + angPar * ctheta0);
+        ctheta0 = (ctheta0 + term.scatParameter) /
+                  (1. + term.scatParameter * ctheta0);
         break;
       default:
         std::cerr << m_className << "::GetElectronCollision:\n";
@@ -852,28 +1213,50 @@ bool MediumMagboltz::GetElectronCollision(const double e, int& type, int& level,
 
   const double s1 = m_rgas[igas];
   const double s2 = (s1 * s1) / (s1 - 1.);
-  const double theta0 = acos(ctheta0);
   const double arg = std::max(1. - s1 * loss / e, Small);
   const double d = 1. - ctheta0 * sqrt(arg);
 
   // Update the energy.
   e1 = std::max(e * (1. - loss / (s1 * e) - 2. * d / s2), Small);
   double q = std::min(sqrt((e / e1) * arg) / s1, 1.);
-  const double theta = asin(q * sin(theta0));
-  double ctheta = cos(theta);
+  double ctheta = 1., stheta = 0.;
+  if (m_useFastKinematics) {
+    // theta = asin(q * sin(theta0)) lies in [0, pi / 2],
+    // so its sine and cosine follow without trigonometric calls.
+    stheta = q * sqrt(std::max(1. - ctheta0 * ctheta0, 0.));
+    ctheta = sqrt(std::max(1. - stheta * stheta, 0.));
+  } else {
+    const double theta0 = acos(ctheta0);
+    const double theta = asin(q * sin(theta0));
+    ctheta = cos(theta);
+    stheta = sin(theta);
+  }
   if (ctheta0 < 0.) {
     const double u = (s1 - 1.) * (s1 - 1.) / arg;
     if (ctheta0 * ctheta0 > u) ctheta = -ctheta;
   }
-  const double stheta = sin(theta);
   // Calculate the direction after the collision.
   dz = std::min(dz, 1.);
   const double argZ = sqrt(dx * dx + dy * dy);
 
   // Azimuth is chosen at random.
-  const double phi = TwoPi * RndmUniform();
-  const double cphi = cos(phi);
-  const double sphi = sin(phi);
+  double cphi = 1., sphi = 0.;
+  if (m_useFastKinematics) {
+    // Sample a point in the unit disk and use the
+    // double-angle formulae (von Neumann).
+    double x = 0., y = 0., r2 = 0.;
+    do {
+      x = 2. * rndm.Uniform() - 1.;
+      y = 2. * rndm.Uniform() - 1.;
+      r2 = x * x + y * y;
+    } while (r2 > 1. || r2 < Small);
+    cphi = (x * x - y * y) / r2;
+    sphi = 2. * x * y / r2;
+  } else {
+    const double phi = TwoPi * rndm.Uniform();
+    cphi = cos(phi);
+    sphi = sin(phi);
+  }
 
   if (argZ == 0.) {
     dz = ctheta;
@@ -944,31 +1327,56 @@ double MediumMagboltz::GetPhotonCollisionRate(const double e) {
   }
 
   int iE = int(e / m_eStepGamma);
-  if (iE >= nEnergyStepsGamma) iE = nEnergyStepsGamma - 1;
+  if (iE >= m_nEnergyStepsGamma) iE = m_nEnergyStepsGamma - 1;
   if (iE < 0) iE = 0;
 
   double cfSum = m_cfTotGamma[iE];
-  if (m_useDeexcitation && m_useRadTrap && !m_deexcitations.empty()) {
-    // Loop over the excitations.
-    const unsigned int nDeexcitations = m_deexcitations.size();
-    for (unsigned int i = 0; i < nDeexcitations; ++i) {
-      if (m_deexcitations[i].cf > 0. &&
-          fabs(e - m_deexcitations[i].energy) <= m_deexcitations[i].width) {
-        cfSum +=
-            m_deexcitations[i].cf * TMath::Voigt(e - m_deexcitations[i].energy,
-                                               m_deexcitations[i].sDoppler,
-                                               2 * m_deexcitations[i].gPressure);
-      }
+  if (m_useDeexcitation && m_useRadTrap && !m_lines.empty()) {
+    // Loop over the lines close enough to the photon energy.
+    const unsigned int nLines = m_lines.size();
+    for (unsigned int i = std::lower_bound(m_lineEnergies.begin(),
+                                           m_lineEnergies.end(),
+                                           e - m_lineWidthMax) -
+                          m_lineEnergies.begin();
+         i < nLines && m_lineEnergies[i] <= e + m_lineWidthMax; ++i) {
+      cfSum += GetLineRate(m_lines[i], e);
     }
   }
 
   return cfSum;
 }
 
+inline double MediumMagboltz::GetLineRate(const lineProfile& line,
+                                          const double e) const {
+
+  const double x = fabs(e - line.energy);
+  if (x > line.width) return 0.;
+  const double u = sqrt(x / line.width) * nLineProfileSteps;
+  const int j = std::min(int(u), nLineProfileSteps - 1);
+  return line.f[j] + (u - j) * (line.f[j + 1] - line.f[j]);
+}
+
 bool MediumMagboltz::GetPhotonCollision(const double e, int& type, int& level,
                                         double& e1, double& ctheta, int& nsec,
                                         double& esec) {
 
+  GlobalRandom rndm;
+  return SamplePhotonCollision(e, type, level, e1, ctheta, nsec, esec, rndm);
+}
+
+bool MediumMagboltz::GetPhotonCollision(const double e, int& type, int& level,
+                                        double& e1, double& ctheta, int& nsec,
+                                        double& esec, RandomStream& rng) {
+
+  return SamplePhotonCollision(e, type, level, e1, ctheta, nsec, esec, rng);
+}
+
+template <class R>
+bool MediumMagboltz::SamplePhotonCollision(const double e, int& type,
+                                           int& level, double& e1,
+                                           double& ctheta, int& nsec,
+                                           double& esec, R& rndm) {
+
   if (e > m_eFinalGamma && m_useAutoAdjust) {
     std::cerr << m_className << "::GetPhotonCollision:\n";
     std::cerr << "    Provided electron energy  (" << e
@@ -993,47 +1401,49 @@ bool MediumMagboltz::GetPhotonCollision(const double e, int& type, int& level,
 
   // Energy interval
   int iE = int(e / m_eStepGamma);
-  if (iE >= nEnergyStepsGamma) iE = nEnergyStepsGamma - 1;
+  if (iE >= m_nEnergyStepsGamma) iE = m_nEnergyStepsGamma - 1;
   if (iE < 0) iE = 0;
 
   double r = m_cfTotGamma[iE];
-  if (m_useDeexcitation && m_useRadTrap && !m_deexcitations.empty()) {
-    int nLines = 0;
-    std::vector<double> pLine(0);
-    std::vector<int> iLine(0);
-    // Loop over the excitations.
-    const unsigned int nDeexcitations = m_deexcitations.size();
-    for (unsigned int i = 0; i < nDeexcitations; ++i) {
-      if (m_deexcitations[i].cf > 0. &&
-          fabs(e - m_deexcitations[i].energy) <= m_deexcitations[i].width) {
-        r += m_deexcitations[i].cf * TMath::Voigt(e - m_deexcitations[i].energy,
-                                                m_deexcitations[i].sDoppler,
-                                                2 * m_deexcitations[i].gPressure);
-        pLine.push_back(r);
-        iLine.push_back(i);
-        ++nLines;
-      }
+  if (m_useDeexcitation && m_useRadTrap && !m_lines.empty()) {
+    // Range of lines close enough to the photon energy
+    const unsigned int nLines = m_lines.size();
+    const unsigned int i0 =
+        std::lower_bound(m_lineEnergies.begin(), m_lineEnergies.end(),
+                         e - m_lineWidthMax) - m_lineEnergies.begin();
+    unsigned int i1 = i0;
+    while (i1 < nLines && m_lineEnergies[i1] <= e + m_lineWidthMax) {
+      r += GetLineRate(m_lines[i1], e);
+      ++i1;
     }
-    r *= RndmUniform();
-    if (nLines > 0 && r >= m_cfTotGamma[iE]) {
+    r *= rndm.Uniform();
+    if (i1 > i0 && r >= m_cfTotGamma[iE]) {
       // Photon is absorbed by a discrete line.
-      for (int i = 0; i < nLines; ++i) {
-        if (r <= pLine[i]) {
-          ++m_nPhotonCollisions[PhotonCollisionTypeExcitation];
-          int fLevel = 0;
-          ComputeDeexcitationInternal(iLine[i], fLevel);
-          type = PhotonCollisionTypeExcitation;
-          nsec = nDeexcitationProducts;
-          return true;
-        }
+      // Retrace the cumulative rates to find it.
+      double sum = m_cfTotGamma[iE];
+      int dxc = -1;
+      for (unsigned int i = i0; i < i1; ++i) {
+        const double f = GetLineRate(m_lines[i], e);
+        if (f <= 0.) continue;
+        dxc = m_lines[i].dxc;
+        sum += f;
+        if (r <= sum) break;
       }
-      std::cerr << m_className << "::GetPhotonCollision:\n";
-      std::cerr << "    Random sampling of deexcitation line failed.\n";
-      std::cerr << "    Program bug!\n";
-      return false;
+      if (dxc < 0) {
+        std::cerr << m_className << "::GetPhotonCollision:\n";
+        std::cerr << "    Random sampling of deexcitation line failed.\n";
+        std::cerr << "    Program bug!\n";
+        return false;
+      }
+      ++m_nPhotonCollisions[PhotonCollisionTypeExcitation];
+      int fLevel = 0;
+      SampleDeexcitation(dxc, fLevel, rndm);
+      type = PhotonCollisionTypeExcitation;
+      nsec = nDeexcitationProducts;
+      return true;
     }
   } else {
-    r *= RndmUniform();
+    r *= rndm.Uniform();
   }
 
   int iLow = 0;
@@ -1070,7 +1480,7 @@ bool MediumMagboltz::GetPhotonCollision(const double e, int& type, int& level,
   }
 
   // Determine the scattering angle
-  ctheta = 2 * RndmUniform() - 1.;
+  ctheta = 2 * rndm.Uniform() - 1.;
 
   return true;
 }
@@ -1081,6 +1491,7 @@ void MediumMagboltz::ResetCollisionCounters() {
   m_nCollisionsDetailed.resize(m_nTerms);
   for (unsigned int j = 0; j < m_nTerms; ++j) m_nCollisionsDetailed[j] = 0;
   m_nPenning = 0;
+  m_nTruncatedCascades = 0;
   for (int j = nCsTypesGamma; j--;) m_nPhotonCollisions[j] = 0;
 }
 
@@ -1531,7 +1942,7 @@ bool MediumMagboltz::Mixer(const bool verbose) {
   Magboltz::inpt_.torr = m_pressure;
 
   Magboltz::inpt_.nGas = m_nComponents;
-  Magboltz::inpt_.nStep = nEnergySteps;
+  Magboltz::inpt_.nStep = m_nEnergySteps;
   if (m_useAnisotropic) {
     Magboltz::inpt_.nAniso = 2;
   } else {
@@ -1543,23 +1954,29 @@ bool MediumMagboltz::Mixer(const bool verbose) {
   // Prefactor for calculation of scattering rate from cross-section.
   const double prefactor = dens * SpeedOfLight * sqrt(2. / ElectronMass);
 
-  // Fill the electron energy array, reset the collision rates.
-  for (int i = nEnergySteps; i--;) {
-    m_cfTot[i] = 0.;
-    for (int j = nMaxLevels; j--;) {
-      m_cf[i][j] = 0.;
-      m_scatParameter[i][j] = 0.5;
-      m_scatCut[i][j] = 1.;
-    }
+  // If only the pressure has changed since the tables were computed,
+  // the collision rates simply scale with the number density. This does
+  // not hold for three-body attachment (rate proportional to N^2).
+  bool rescale = m_tableDensity > 0. && dens > 0. &&
+                 m_tableKey == GetTableCacheKey(false);
+  for (unsigned int i = 0; rescale && i < m_nComponents; ++i) {
+    if (GasTable::IsThreeBodyAttacher(m_gas[i])) rescale = false;
   }
-  for (int i = nEnergyStepsLog; i--;) {
-    m_cfTotLog[i] = 0.;
-    for (int j = nMaxLevels; j--;) {
-      m_cfLog[i][j] = 0.;
-      m_scatParameter[i][j] = 0.5;
-      m_scatCut[i][j] = 1.;
+  if (rescale) {
+    if (m_debug || verbose) {
+      std::cout << m_className << "::Mixer:\n";
+      std::cout << "    Rescaling collision rates to new pressure.\n";
     }
+    RescaleCollisionRates(dens / m_tableDensity);
+    return FinishMixer(verbose, false);
   }
+  m_tableDensity = 0.;
+
+  // Fill the electron energy array, reset the collision rates.
+  for (int i = m_nEnergySteps; i--;) m_cfTot[i] = 0.;
+  for (int i = m_nEnergyStepsLog; i--;) m_cfTotLog[i] = 0.;
+  m_collisionTable.clear();
+  m_nColumns = 0;
 
   m_deexcitations.clear();
   for (int i = nMaxLevels; i--;) {
@@ -1569,6 +1986,7 @@ bool MediumMagboltz::Mixer(const bool verbose) {
   }
 
   m_minIonPot = -1.;
+  m_eNextIonPot = -1.;
   for (unsigned int i = 0; i < m_nMaxGases; ++i) {
     m_ionPot[i] = -1.;
     m_gsGreenSawada[i] = 1.;
@@ -1578,27 +1996,24 @@ bool MediumMagboltz::Mixer(const bool verbose) {
     m_tbGreenSawada[i] = 0.;
     m_hasGreenSawada[i] = false;
   }
-  // Cross-sections
-  // 0: total, 1: elastic,
-  // 2: ionisation, 3: attachment,
-  // 4, 5: unused
-  static double q[nEnergySteps][6];
-  // Parameters for scattering angular distribution
-  static double pEqEl[nEnergySteps][6];
-  // Inelastic cross-sections
-  static double qIn[nEnergySteps][nMaxInelasticTerms];
-  // Ionisation cross-sections
-  static double qIon[nEnergySteps][8];
-  // Parameters for angular distribution in inelastic collisions
-  static double pEqIn[nEnergySteps][nMaxInelasticTerms];
-  // Parameters for angular distribution in ionising collisions
-  static double pEqIon[nEnergySteps][8];
-  // Opal-Beaty parameter
-  static double eoby[nEnergySteps];
-  // Penning transfer parameters
-  static double penFra[nMaxInelasticTerms][3];
-  // Description of cross-section terms
-  static char scrpt[260][50];
+  // Try to restore the tables from the cache.
+  if (!m_cacheDir.empty() && ReadTableCache(verbose)) {
+    return FinishMixer(verbose, true);
+  }
+
+  // Tables filled by Magboltz (allocated per call, so that
+  // no state is shared between media)
+  ScratchBuffer<gasmixTables> scratch;
+  gasmixTables& tab = *scratch;
+  double (*q)[6] = tab.q;
+  double (*pEqEl)[6] = tab.pEqEl;
+  double (*qIn)[nMaxInelasticTerms] = tab.qIn;
+  double (*qIon)[8] = tab.qIon;
+  double (*pEqIn)[nMaxInelasticTerms] = tab.pEqIn;
+  double (*pEqIon)[8] = tab.pEqIon;
+  double* eoby = tab.eoby;
+  double (*penFra)[3] = tab.penFra;
+  char (*scrpt)[50] = tab.scrpt;
 
   // Check the gas composition and establish the gas numbers.
   int gasNumber[m_nMaxGases];
@@ -1614,22 +2029,17 @@ bool MediumMagboltz::Mixer(const bool verbose) {
   if (m_debug || verbose) {
     std::cout << m_className << "::Mixer:\n";
     std::cout << "    Creating table of collision rates with\n";
-    std::cout << "    " << nEnergySteps << " linear energy steps between 0 and "
+    std::cout << "    " << m_nEnergySteps
+              << " linear energy steps between 0 and "
               << std::min(m_eFinal, m_eHigh) << " eV\n";
     if (m_eFinal > m_eHigh) {
-      std::cout << "    " << nEnergyStepsLog
+      std::cout << "    " << m_nEnergyStepsLog
                 << " logarithmic energy steps between " << m_eHigh << " and "
                 << m_eFinal << " eV\n";
     }
   }
   m_nTerms = 0;
 
-  std::ofstream outfile;
-  if (m_useCsOutput) {
-    outfile.open("cs.txt", std::ios::out);
-    outfile << "# energy [eV] vs. cross-section [cm2]\n";
-  }
-
   // Loop over the gases in the mixture.
   for (unsigned int iGas = 0; iGas < m_nComponents; ++iGas) {
     if (m_eFinal <= m_eHigh) {
@@ -1687,11 +2097,6 @@ bool MediumMagboltz::Mixer(const bool verbose) {
     double van = m_fraction[iGas] * prefactor;
 
     int np = np0;
-    if (m_useCsOutput) {
-      outfile << "# cross-sections for " << name << "\n";
-      outfile << "# cross-section types:\n";
-      outfile << "# elastic\n";
-    }
     // Elastic scattering
     ++m_nTerms;
     m_scatModel[np] = kEl[1];
@@ -1706,7 +2111,12 @@ bool MediumMagboltz::Mixer(const bool verbose) {
     // Ionisation
     if (nIon > 1) {
       for (int j = 0; j < nIon; ++j) {
-        if (m_eFinal < eIon[j]) continue;
+        if (m_eFinal < eIon[j]) {
+          if (m_eNextIonPot < 0. || eIon[j] < m_eNextIonPot) {
+            m_eNextIonPot = eIon[j];
+          }
+          continue;
+        }
         withIon = true;
         ++m_nTerms;
         ++np;
@@ -1725,9 +2135,6 @@ bool MediumMagboltz::Mixer(const bool verbose) {
           m_description[np][k] = scrpt[2 + j][k];
         }
         m_csType[np] = nCsTypes * iGas + ElectronCollisionTypeIonisation;
-        if (m_useCsOutput) {
-          outfile << "# " << m_description[np] << "\n";
-        }
       }
       m_gsGreenSawada[iGas] = eoby[0];
       m_tbGreenSawada[iGas] = 2 * eIon[0];
@@ -1747,9 +2154,8 @@ bool MediumMagboltz::Mixer(const bool verbose) {
           m_description[np][j] = scrpt[2][j];
         }
         m_csType[np] = nCsTypes * iGas + ElectronCollisionTypeIonisation;
-        if (m_useCsOutput) {
-          outfile << "# ionisation (gross)\n";
-        }
+      } else if (m_eNextIonPot < 0. || e[2] < m_eNextIonPot) {
+        m_eNextIonPot = e[2];
       }
     }
     // Attachment
@@ -1761,9 +2167,6 @@ bool MediumMagboltz::Mixer(const bool verbose) {
       m_description[np][j] = scrpt[2 + nIon][j];
     }
     m_csType[np] = nCsTypes * iGas + ElectronCollisionTypeAttachment;
-    if (m_useCsOutput) {
-      outfile << "# attachment\n";
-    }
     // Inelastic terms
     int nExc = 0, nSuperEl = 0;
     for (int j = 0; j < nIn; ++j) {
@@ -1787,23 +2190,26 @@ bool MediumMagboltz::Mixer(const bool verbose) {
         // Inelastic collision
         m_csType[np] = nCsTypes * iGas + ElectronCollisionTypeInelastic;
       }
-      if (m_useCsOutput) {
-        outfile << "# " << m_description[np] << "\n";
-      }
     }
     m_nTerms += nIn;
+    // Make room for the terms of this gas in the collision table.
+    SetCollisionTableColumns(m_nTerms);
+    // Energy bins with negative inelastic cross-sections (reported after
+    // the loop, which may run in parallel)
+    std::vector<char> negative(m_nEnergySteps, 0);
     // Loop over the energy table.
-    for (int iE = 0; iE < nEnergySteps; ++iE) {
-      np = np0;
-      if (m_useCsOutput) {
-        outfile << (iE + 0.5) * m_eStep << "  " << q[iE][1] << "  ";
-      }
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int iE = 0; iE < m_nEnergySteps; ++iE) {
+      int np = np0;
       // Elastic scattering
-      m_cf[iE][np] = q[iE][1] * van;
+      Term(iE, np).cf = q[iE][1] * van;
       if (m_scatModel[np] == 1) {
-        ComputeAngularCut(pEqEl[iE][1], m_scatCut[iE][np], m_scatParameter[iE][np]);
+        ComputeAngularCut(pEqEl[iE][1], Term(iE, np).scatCut,
+                          Term(iE, np).scatParameter);
       } else if (m_scatModel[np] == 2) {
-        m_scatParameter[iE][np] = pEqEl[iE][1];
+        Term(iE, np).scatParameter = pEqEl[iE][1];
       }
       // Ionisation
       if (withIon) {
@@ -1811,166 +2217,82 @@ bool MediumMagboltz::Mixer(const bool verbose) {
           for (int j = 0; j < nIon; ++j) {
             if (m_eFinal < eIon[j]) continue;
             ++np;
-            m_cf[iE][np] = qIon[iE][j] * van;
+            Term(iE, np).cf = qIon[iE][j] * van;
             if (m_scatModel[np] == 1) {
-              ComputeAngularCut(pEqIon[iE][j], m_scatCut[iE][np],
-                                m_scatParameter[iE][np]);
+              ComputeAngularCut(pEqIon[iE][j], Term(iE, np).scatCut,
+                                Term(iE, np).scatParameter);
             } else if (m_scatModel[np] == 2) {
-              m_scatParameter[iE][np] = pEqIon[iE][j];
-            }
-            if (m_useCsOutput) {
-              outfile << qIon[iE][j] << "  ";
+              Term(iE, np).scatParameter = pEqIon[iE][j];
             }
           }
         } else {
           ++np;
-          m_cf[iE][np] = q[iE][2] * van;
+          Term(iE, np).cf = q[iE][2] * van;
           if (m_scatModel[np] == 1) {
-            ComputeAngularCut(pEqEl[iE][2], m_scatCut[iE][np],
-                              m_scatParameter[iE][np]);
+            ComputeAngularCut(pEqEl[iE][2], Term(iE, np).scatCut,
+                              Term(iE, np).scatParameter);
           } else if (m_scatModel[np] == 2) {
-            m_scatParameter[iE][np] = pEqEl[iE][2];
-          }
-          if (m_useCsOutput) {
-            outfile << q[iE][2] << "  ";
+            Term(iE, np).scatParameter = pEqEl[iE][2];
           }
         }
       }
       // Attachment
       ++np;
-      m_cf[iE][np] = q[iE][3] * van;
-      m_scatParameter[iE][np] = 0.5;
-      if (m_useCsOutput) {
-        outfile << q[iE][3] << "  ";
-      }
+      Term(iE, np).cf = q[iE][3] * van;
+      Term(iE, np).scatParameter = 0.5;
       // Inelastic terms
       for (int j = 0; j < nIn; ++j) {
         ++np;
-        if (m_useCsOutput) outfile << qIn[iE][j] << "  ";
-        m_cf[iE][np] = qIn[iE][j] * van;
+        Term(iE, np).cf = qIn[iE][j] * van;
         // Scale the excitation cross-sections (for error estimates).
-        m_cf[iE][np] *= m_scaleExc[iGas];
+        Term(iE, np).cf *= m_scaleExc[iGas];
         // Temporary hack for methane dissociative excitations:
         if (m_description[np][5] == 'D' && m_description[np][6] == 'I' &&
             m_description[np][7] == 'S') {
           // if ((iE + 0.5) * m_eStep > 40.) {
-          //   m_cf[iE][np] *= 0.8;
+          //   Term(iE, np).cf *= 0.8;
           // } else if ((iE + 0.5) * m_eStep > 30.) {
-          //   m_cf[iE][np] *= (1. - ((iE + 0.5) * m_eStep - 30.) * 0.02);
+          //   Term(iE, np).cf *= (1. - ((iE + 0.5) * m_eStep - 30.) * 0.02);
           // }
         }
-        if (m_cf[iE][np] < 0.) {
-          std::cerr << m_className << "::Mixer:\n";
-          std::cerr << "    Negative inelastic cross-section at "
-                    << (iE + 0.5) * m_eStep << " eV.\n";
-          std::cerr << "    Set to zero.\n";
-          m_cf[iE][np] = 0.;
+        if (Term(iE, np).cf < 0.) {
+          negative[iE] = 1;
+          Term(iE, np).cf = 0.;
         }
         if (m_scatModel[np] == 1) {
-          ComputeAngularCut(pEqIn[iE][j], m_scatCut[iE][np],
-                            m_scatParameter[iE][np]);
+          ComputeAngularCut(pEqIn[iE][j], Term(iE, np).scatCut,
+                            Term(iE, np).scatParameter);
         } else if (m_scatModel[np] == 2) {
-          m_scatParameter[iE][np] = pEqIn[iE][j];
+          Term(iE, np).scatParameter = pEqIn[iE][j];
         }
       }
-      if ((m_debug || verbose) && nIn > 0 && iE == nEnergySteps - 1) {
-        std::cout << "      " << nIn << " inelastic terms (" << nExc
-                  << " excitations, " << nSuperEl << " superelastic, "
-                  << nIn - nExc - nSuperEl << " other)\n";
-      }
-      if (m_useCsOutput) outfile << "\n";
+    }
+    for (int iE = 0; iE < m_nEnergySteps; ++iE) {
+      if (!negative[iE]) continue;
+      std::cerr << m_className << "::Mixer:\n";
+      std::cerr << "    Negative inelastic cross-section at "
+                << (iE + 0.5) * m_eStep << " eV.\n";
+      std::cerr << "    Set to zero.\n";
+    }
+    if ((m_debug || verbose) && nIn > 0) {
+      std::cout << "      " << nIn << " inelastic terms (" << nExc
+                << " excitations, " << nSuperEl << " superelastic, "
+                << nIn - nExc - nSuperEl << " other)\n";
     }
 
     if (m_eFinal <= m_eHigh) continue;
     // Fill the high-energy part (logarithmic binning).
     // Calculate the growth factor.
-    const double rLog = pow(m_eFinal / m_eHigh, 1. / nEnergyStepsLog);
+    const double rLog = pow(m_eFinal / m_eHigh, 1. / m_nEnergyStepsLog);
     m_lnStep = log(rLog);
     // Set the upper limit of the first bin.
     double emax = m_eHigh * rLog;
-    int imax = nEnergySteps - 1;
-    for (int iE = 0; iE < nEnergyStepsLog; ++iE) {
-      Magboltz::inpt_.estep = emax / (nEnergySteps - 0.5);
-      Magboltz::inpt_.efinal = emax + 0.5 * Magboltz::inpt_.estep;
-      Magboltz::gasmix_(&ngs, q[0], qIn[0], &nIn, e, eIn, name, &virial, eoby,
-                        pEqEl[0], pEqIn[0], penFra[0], kEl, kIn, qIon[0],
-                        pEqIon[0], eIon, &nIon, scrpt);
-      np = np0;
-      if (m_useCsOutput) {
-        outfile << emax << "  " << q[imax][1] << "  ";
-      }
-      // Elastic scattering
-      m_cfLog[iE][np] = q[imax][1] * van;
-      if (m_scatModel[np] == 1) {
-        ComputeAngularCut(pEqEl[imax][1], m_scatCutLog[iE][np],
-                          m_scatParameterLog[iE][np]);
-      } else if (m_scatModel[np] == 2) {
-        m_scatParameterLog[iE][np] = pEqEl[imax][1];
-      }
-      // Ionisation
-      if (withIon) {
-        if (nIon > 1) {
-          for (int j = 0; j < nIon; ++j) {
-            if (m_eFinal < eIon[j]) continue;
-            ++np;
-            m_cfLog[iE][np] = qIon[imax][j] * van;
-            if (m_scatModel[np] == 1) {
-              ComputeAngularCut(pEqIon[imax][j], m_scatCutLog[iE][np],
-                                m_scatParameterLog[iE][np]);
-            } else if (m_scatModel[np] == 2) {
-              m_scatParameterLog[iE][np] = pEqIon[imax][j];
-            }
-            if (m_useCsOutput) {
-              outfile << qIon[imax][j] << "  ";
-            }
-          }
-        } else {
-          ++np;
-          // Gross cross-section
-          m_cfLog[iE][np] = q[imax][2] * van;
-          // Counting cross-section
-          // m_cfLog[iE][np] = q[imax][4] * van;
-          if (m_scatModel[np] == 1) {
-            ComputeAngularCut(pEqEl[imax][2], m_scatCutLog[iE][np],
-                              m_scatParameterLog[iE][np]);
-          } else if (m_scatModel[np] == 2) {
-            m_scatParameterLog[iE][np] = pEqEl[imax][2];
-          }
-        }
-      }
-      // Attachment
-      ++np;
-      m_cfLog[iE][np] = q[imax][3] * van;
-      if (m_useCsOutput) {
-        outfile << q[imax][3] << "  ";
-      }
-      // Inelastic terms
-      for (int j = 0; j < nIn; ++j) {
-        ++np;
-        if (m_useCsOutput) outfile << qIn[imax][j] << "  ";
-        m_cfLog[iE][np] = qIn[imax][j] * van;
-        // Scale the excitation cross-sections (for error estimates).
-        m_cfLog[iE][np] *= m_scaleExc[iGas];
-        if (m_cfLog[iE][np] < 0.) {
-          std::cerr << m_className << "::Mixer:\n";
-          std::cerr << "    Negative inelastic cross-section at " << emax
-                    << " eV.\n";
-          std::cerr << "    Set to zero.\n";
-          m_cfLog[iE][np] = 0.;
-        }
-        if (m_scatModel[np] == 1) {
-          ComputeAngularCut(pEqIn[imax][j], m_scatCutLog[iE][np],
-                            m_scatParameterLog[iE][np]);
-        } else if (m_scatModel[np] == 2) {
-          m_scatParameterLog[iE][np] = pEqIn[imax][j];
-        }
-      }
-      if (m_useCsOutput) outfile << "\n";
+    for (int iE = 0; iE < m_nEnergyStepsLog; ++iE) {
+      FillLogTableRow(iGas, gasNumber[iGas], np0, iE, emax, tab);
       // Increase the energy.
       emax *= rLog;
     }
   }
-  if (m_useCsOutput) outfile.close();
 
   // Find the smallest ionisation threshold.
   std::string minIonPotGas = "";
@@ -1991,23 +2313,28 @@ bool MediumMagboltz::Mixer(const bool verbose) {
     std::cout << "      " << m_minIonPot << " eV (" << minIonPotGas << ")\n";
   }
 
-  for (int iE = nEnergySteps; iE--;) {
+  // Energy bins with negative collision rates (reported after the loop)
+  std::vector<char> negative(m_nEnergySteps, 0);
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+  for (int iE = 0; iE < m_nEnergySteps; ++iE) {
     // Calculate the total collision frequency.
     for (unsigned int k = 0; k < m_nTerms; ++k) {
-      if (m_cf[iE][k] < 0.) {
-        std::cerr << m_className << "::Mixer:\n";
-        std::cerr << "    Negative collision rate at " << (iE + 0.5) * m_eStep
-                  << " eV. Set to zero.\n";
-        m_cf[iE][k] = 0.;
+      if (Term(iE, k).cf < 0.) {
+        negative[iE] = 1;
+        Term(iE, k).cf = 0.;
       }
-      m_cfTot[iE] += m_cf[iE][k];
+      m_cfTot[iE] += Term(iE, k).cf;
     }
     // Normalise the collision probabilities.
     if (m_cfTot[iE] > 0.) {
-      for (unsigned int k = 0; k < m_nTerms; ++k) m_cf[iE][k] /= m_cfTot[iE];
+      for (unsigned int k = 0; k < m_nTerms; ++k) {
+        Term(iE, k).cf /= m_cfTot[iE];
+      }
     }
     for (unsigned int k = 1; k < m_nTerms; ++k) {
-      m_cf[iE][k] += m_cf[iE][k - 1];
+      Term(iE, k).cf += Term(iE, k - 1).cf;
     }
     const double ekin = m_eStep * (iE + 0.5);
     m_cfTot[iE] *= sqrt(ekin);
@@ -2017,42 +2344,28 @@ bool MediumMagboltz::Mixer(const bool verbose) {
           sqrt(1. + 0.5 * ekin / ElectronMass) / (1. + ekin / ElectronMass);
     }
   }
-
-  if (m_eFinal > m_eHigh) {
-    const double rLog = pow(m_eFinal / m_eHigh, 1. / nEnergyStepsLog);
-    for (int iE = nEnergyStepsLog; iE--;) {
-      // Calculate the total collision frequency.
-      for (unsigned int k = 0; k < m_nTerms; ++k) {
-        if (m_cfLog[iE][k] < 0.) m_cfLog[iE][k] = 0.;
-        m_cfTotLog[iE] += m_cfLog[iE][k];
-      }
-      // Normalise the collision probabilities.
-      if (m_cfTotLog[iE] > 0.) {
-        for (int k = m_nTerms; k--;) m_cfLog[iE][k] /= m_cfTotLog[iE];
-      }
-      for (unsigned int k = 1; k < m_nTerms; ++k) {
-        m_cfLog[iE][k] += m_cfLog[iE][k - 1];
-      }
-      const double ekin = m_eHigh * pow(rLog, iE + 1);
-      m_cfTotLog[iE] *= sqrt(ekin) * sqrt(1. + 0.5 * ekin / ElectronMass) /
-                      (1. + ekin / ElectronMass);
-      // Store the logarithm (for log-log interpolation)
-      m_cfTotLog[iE] = log(m_cfTotLog[iE]);
-    }
+  for (int iE = 0; iE < m_nEnergySteps; ++iE) {
+    if (!negative[iE]) continue;
+    std::cerr << m_className << "::Mixer:\n";
+    std::cerr << "    Negative collision rate at " << (iE + 0.5) * m_eStep
+              << " eV. Set to zero.\n";
   }
 
-  // Determine the null collision frequency.
-  m_cfNull = 0.;
-  for (int j = 0; j < nEnergySteps; ++j) {
-    if (m_cfTot[j] > m_cfNull) m_cfNull = m_cfTot[j];
-  }
   if (m_eFinal > m_eHigh) {
-    for (int j = 0; j < nEnergyStepsLog; ++j) {
-      const double r = exp(m_cfTotLog[j]);
-      if (r > m_cfNull) m_cfNull = r;
-    }
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int iE = 0; iE < m_nEnergyStepsLog; ++iE) NormaliseLogTableRow(iE);
   }
 
+  return FinishMixer(verbose, false);
+}
+
+bool MediumMagboltz::FinishMixer(const bool verbose, const bool cached) {
+
+  // Determine the null collision frequency and set up the sampling tables.
+  UpdateCollisionTables();
+
   // Reset the collision counters.
   m_nCollisionsDetailed.resize(m_nTerms);
   for (int j = nCsTypes; j--;) m_nCollisions[j] = 0;
@@ -2065,14 +2378,20 @@ bool MediumMagboltz::Mixer(const bool verbose) {
       const double emax = std::min(m_eHigh, m_eFinal);
       std::cout << "    " << std::fixed << std::setw(10) << std::setprecision(2)
                 << (2 * i + 1) * emax / 16 << "    " << std::setw(18)
-                << std::setprecision(2) << m_cfTot[(i + 1) * nEnergySteps / 16]
-                << "\n";
+                << std::setprecision(2)
+                << m_cfTot[(i + 1) * m_nEnergySteps / 16] << "\n";
     }
     std::cout << std::resetiosflags(std::ios_base::floatfield);
   }
 
-  // Set up the de-excitation channels.
-  if (m_useDeexcitation) {
+  // Set up the de-excitation channels (unless restored from the cache).
+  if (m_useDeexcitation && cached) {
+    const unsigned int nDeexcitations = m_deexcitations.size();
+    for (unsigned int j = 0; j < nDeexcitations; ++j) {
+      ComputeAliasTable(m_deexcitations[j].p, m_deexcitations[j].nChannels,
+                        m_deexcitations[j].aliasCut, m_deexcitations[j].alias);
+    }
+  } else if (m_useDeexcitation) {
     ComputeDeexcitationTable(verbose);
     const unsigned int nDeexcitations = m_deexcitations.size();
     for (unsigned int j = 0; j < nDeexcitations; ++j) {
@@ -2113,9 +2432,614 @@ bool MediumMagboltz::Mixer(const bool verbose) {
   // Set the Green-Sawada splitting function parameters.
   SetupGreenSawada();
 
+  // Tabulate the secondary electron energy distributions.
+  if (m_useSecondaryEnergyTable) ComputeSecondaryEnergyTable();
+
+  // Store the tables for later use.
+  if (!cached && !m_cacheDir.empty()) WriteTableCache();
+  if (m_useCsOutput) WriteCrossSectionFile(m_csOutputFile);
+  m_tableKey = GetTableCacheKey(false);
+  m_tableDensity = GetNumberDensity();
+
+  return true;
+}
+
+bool MediumMagboltz::WriteCrossSections(const std::string& filename) {
+
+  if (m_isChanged) {
+    if (!Mixer()) {
+      std::cerr << m_className << "::WriteCrossSections:\n";
+      std::cerr << "    Error calculating the collision rates table.\n";
+      return false;
+    }
+    m_isChanged = false;
+  }
+  return WriteCrossSectionFile(filename);
+}
+
+bool MediumMagboltz::WriteCrossSectionFile(const std::string& filename) const {
+
+  std::ofstream out(filename.c_str(), std::ios::out | std::ios::binary);
+  if (!out) {
+    std::cerr << m_className << "::WriteCrossSections:\n";
+    std::cerr << "    Could not open file " << filename << ".\n";
+    return false;
+  }
+  const unsigned int nLog = m_eFinal > m_eHigh ? m_nEnergyStepsLog : 0;
+  const unsigned int nRows = m_nEnergySteps + nLog;
+  const uint32_t header[4] = {1, m_nTerms, uint32_t(m_nEnergySteps), nLog};
+  out.write("GMBZCS\0", 8);
+  WriteRaw(out, header, 4);
+  // Term metadata
+  for (unsigned int k = 0; k < m_nTerms; ++k) {
+    const int iGas = m_csType[k] / nCsTypes;
+    const int32_t ids[3] = {m_csType[k], iGas, m_csType[k] % nCsTypes};
+    const double threshold = m_energyLoss[k] * m_rgas[iGas];
+    WriteRaw(out, ids, 3);
+    WriteRaw(out, &threshold, 1);
+    WriteRaw(out, m_description[k], 50);
+  }
+  // Energies and velocity factors (collision rate per cross-section
+  // and number density)
+  std::vector<double> energy(nRows);
+  std::vector<double> vel(nRows);
+  const double c1 = SpeedOfLight * sqrt(2. / ElectronMass);
+  for (unsigned int i = 0; i < nRows; ++i) {
+    double ekin = 0.;
+    if (i < (unsigned int)m_nEnergySteps) {
+      ekin = m_eStep * (i + 0.5);
+    } else {
+      ekin = m_eHigh * exp((i - m_nEnergySteps + 1) * m_lnStep);
+    }
+    energy[i] = ekin;
+    vel[i] = c1 * sqrt(ekin);
+    if (i >= (unsigned int)m_nEnergySteps || ekin > 1.e3) {
+      vel[i] *=
+          sqrt(1. + 0.5 * ekin / ElectronMass) / (1. + ekin / ElectronMass);
+    }
+  }
+  WriteRaw(out, &energy[0], nRows);
+  // Cross-sections, recovered from the cumulative collision probabilities
+  const double dens = GetNumberDensity();
+  std::vector<double> cs(nRows);
+  for (unsigned int k = 0; k < m_nTerms; ++k) {
+    const double nk = dens * m_fraction[m_csType[k] / nCsTypes];
+    for (unsigned int i = 0; i < nRows; ++i) {
+      const bool logBin = i >= (unsigned int)m_nEnergySteps;
+      const int iE = logBin ? i - m_nEnergySteps : i;
+      const collisionTerm* row = &m_collisionTable[i * m_nColumns];
+      const double rate = logBin ? exp(m_cfTotLog[iE]) : m_cfTot[iE];
+      const double p = k > 0 ? row[k].cf - row[k - 1].cf : row[k].cf;
+      cs[i] = nk > 0. ? std::max(p, 0.) * rate / (nk * vel[i]) : 0.;
+    }
+    WriteRaw(out, &cs[0], nRows);
+  }
+  out.close();
+  if (!out) {
+    std::cerr << m_className << "::WriteCrossSections:\n";
+    std::cerr << "    Error writing file " << filename << ".\n";
+    return false;
+  }
+  return true;
+}
+
+std::string MediumMagboltz::GetTableCacheKey(const bool withPressure) const {
+
+  // Everything the tables produced by Mixer depend on.
+  std::ostringstream key;
+  key.precision(17);
+  key << "v1 " << m_nEnergySteps << " " << m_nEnergyStepsLog << " "
+      << nMaxLevels;
+  for (unsigned int i = 0; i < m_nComponents; ++i) {
+    key << " " << m_gas[i] << " " << m_fraction[i] << " " << m_scaleExc[i];
+  }
+  key << " T " << m_temperature;
+  if (withPressure) key << " p " << m_pressure;
+  key << " E " << m_eFinal << " " << m_eHigh;
+  key << " aniso " << m_useAnisotropic;
+  key << " dxc " << m_useDeexcitation << " " << m_useRadTrap;
+  key << " penning " << m_usePenning << " " << m_rPenningGlobal << " "
+      << m_lambdaPenningGlobal;
+  for (unsigned int i = 0; i < m_nComponents; ++i) {
+    key << " " << m_rPenningGas[i] << " " << m_lambdaPenningGas[i];
+  }
+  key << " fit " << fit3d4p << " " << fitHigh4p << " " << fit3dQCO2 << " "
+      << fit3dQCH4 << " " << fit3dQC2H6 << " " << fit3dEtaCO2 << " "
+      << fit3dEtaCH4 << " " << fit3dEtaC2H6 << " " << fit4pEtaCH4 << " "
+      << fit4pEtaC2H6 << " " << fit4sEtaC2H6 << " " << fitLineCut;
+  return key.str();
+}
+
+std::string MediumMagboltz::GetTableCacheFile(const std::string& key) const {
+
+  // 64-bit FNV-1a hash of the key.
+  uint64_t h = 14695981039346656037ULL;
+  const unsigned int n = key.size();
+  for (unsigned int i = 0; i < n; ++i) {
+    h ^= (unsigned char)key[i];
+    h *= 1099511628211ULL;
+  }
+  std::ostringstream name;
+  name << m_cacheDir << "/magboltz_" << std::hex << std::setw(16)
+       << std::setfill('0') << h << ".tab";
+  return name.str();
+}
+
+bool MediumMagboltz::WriteTableCache() const {
+
+  const std::string key = GetTableCacheKey();
+  const std::string filename = GetTableCacheFile(key);
+  // Write to a temporary file first, such that concurrent jobs
+  // never see an incomplete table.
+  std::ostringstream tmpname;
+  tmpname << filename << "." << getpid() << ".tmp";
+  std::ofstream out(tmpname.str().c_str(), std::ios::out | std::ios::binary);
+  if (!out) {
+    std::cerr << m_className << "::WriteTableCache:\n";
+    std::cerr << "    Could not open file " << tmpname.str() << ".\n";
+    return false;
+  }
+  out.write("GMBZTAB", 8);
+  WriteString(out, key);
+  WriteRaw(out, &m_nTerms, 1);
+  WriteRaw(out, &m_lnStep, 1);
+  WriteRaw(out, &m_minIonPot, 1);
+  WriteRaw(out, &m_eNextIonPot, 1);
+  WriteRaw(out, m_ionPot, m_nMaxGases);
+  WriteRaw(out, m_rgas, m_nMaxGases);
+  WriteRaw(out, m_gsGreenSawada, m_nMaxGases);
+  WriteRaw(out, m_gbGreenSawada, m_nMaxGases);
+  WriteRaw(out, m_tsGreenSawada, m_nMaxGases);
+  WriteRaw(out, m_taGreenSawada, m_nMaxGases);
+  WriteRaw(out, m_tbGreenSawada, m_nMaxGases);
+  WriteRaw(out, m_hasGreenSawada, m_nMaxGases);
+  WriteRaw(out, m_wOpalBeaty, m_nTerms);
+  WriteRaw(out, m_energyLoss, m_nTerms);
+  WriteRaw(out, m_csType, m_nTerms);
+  WriteRaw(out, m_scatModel, m_nTerms);
+  WriteRaw(out, &m_description[0][0], 50 * m_nTerms);
+  WriteRaw(out, &m_cfTot[0], m_nEnergySteps);
+  WriteRaw(out, &m_cfTotLog[0], m_nEnergyStepsLog);
+  // Tables are written column by column (only the columns in use).
+  std::vector<double> col(m_nEnergySteps);
+  for (unsigned int k = 0; k < m_nTerms; ++k) {
+    for (int i = 0; i < m_nEnergySteps; ++i) col[i] = Term(i, k).cf;
+    WriteRaw(out, &col[0], m_nEnergySteps);
+    for (int i = 0; i < m_nEnergyStepsLog; ++i) col[i] = TermLog(i, k).cf;
+    WriteRaw(out, &col[0], m_nEnergyStepsLog);
+    if (m_scatModel[k] == 1) {
+      for (int i = 0; i < m_nEnergySteps; ++i) col[i] = Term(i, k).scatCut;
+      WriteRaw(out, &col[0], m_nEnergySteps);
+      for (int i = 0; i < m_nEnergyStepsLog; ++i) {
+        col[i] = TermLog(i, k).scatCut;
+      }
+      WriteRaw(out, &col[0], m_nEnergyStepsLog);
+    }
+    if (m_scatModel[k] == 1 || m_scatModel[k] == 2) {
+      for (int i = 0; i < m_nEnergySteps; ++i) {
+        col[i] = Term(i, k).scatParameter;
+      }
+      WriteRaw(out, &col[0], m_nEnergySteps);
+      for (int i = 0; i < m_nEnergyStepsLog; ++i) {
+        col[i] = TermLog(i, k).scatParameter;
+      }
+      WriteRaw(out, &col[0], m_nEnergyStepsLog);
+    }
+  }
+  // De-excitation levels
+  WriteRaw(out, m_iDeexcitation, m_nTerms);
+  const unsigned int nDeexcitations = m_deexcitations.size();
+  WriteRaw(out, &nDeexcitations, 1);
+  for (unsigned int j = 0; j < nDeexcitations; ++j) {
+    const deexcitation& dxc = m_deexcitations[j];
+    WriteRaw(out, &dxc.gas, 1);
+    WriteRaw(out, &dxc.level, 1);
+    WriteString(out, dxc.label);
+    WriteRaw(out, &dxc.energy, 1);
+    WriteRaw(out, &dxc.nChannels, 1);
+    WriteVector(out, dxc.p);
+    WriteVector(out, dxc.final);
+    WriteVector(out, dxc.type);
+    WriteRaw(out, &dxc.osc, 1);
+    WriteRaw(out, &dxc.rate, 1);
+  }
+  out.close();
+  if (!out || rename(tmpname.str().c_str(), filename.c_str()) != 0) {
+    std::cerr << m_className << "::WriteTableCache:\n";
+    std::cerr << "    Error writing file " << filename << ".\n";
+    remove(tmpname.str().c_str());
+    return false;
+  }
+  return true;
+}
+
+bool MediumMagboltz::ReadTableCache(const bool verbose) {
+
+  const std::string key = GetTableCacheKey();
+  const std::string filename = GetTableCacheFile(key);
+  std::ifstream in(filename.c_str(), std::ios::in | std::ios::binary);
+  if (!in) return false;
+  char magic[8];
+  std::string fileKey;
+  if (!ReadRaw(in, magic, 8) || strncmp(magic, "GMBZTAB", 8) != 0 ||
+      !ReadString(in, fileKey) || fileKey != key) {
+    return false;
+  }
+  bool ok = ReadRaw(in, &m_nTerms, 1) && m_nTerms < (unsigned int)nMaxLevels;
+  ok = ok && ReadRaw(in, &m_lnStep, 1) && ReadRaw(in, &m_minIonPot, 1) &&
+       ReadRaw(in, &m_eNextIonPot, 1) && ReadRaw(in, m_ionPot, m_nMaxGases) &&
+       ReadRaw(in, m_rgas, m_nMaxGases) &&
+       ReadRaw(in, m_gsGreenSawada, m_nMaxGases) &&
+       ReadRaw(in, m_gbGreenSawada, m_nMaxGases) &&
+       ReadRaw(in, m_tsGreenSawada, m_nMaxGases) &&
+       ReadRaw(in, m_taGreenSawada, m_nMaxGases) &&
+       ReadRaw(in, m_tbGreenSawada, m_nMaxGases) &&
+       ReadRaw(in, m_hasGreenSawada, m_nMaxGases);
+  ok = ok && ReadRaw(in, m_wOpalBeaty, m_nTerms) &&
+       ReadRaw(in, m_energyLoss, m_nTerms) && ReadRaw(in, m_csType, m_nTerms) &&
+       ReadRaw(in, m_scatModel, m_nTerms) &&
+       ReadRaw(in, &m_description[0][0], 50 * m_nTerms) &&
+       ReadRaw(in, &m_cfTot[0], m_nEnergySteps) &&
+       ReadRaw(in, &m_cfTotLog[0], m_nEnergyStepsLog);
+  m_collisionTable.clear();
+  m_nColumns = 0;
+  if (ok) SetCollisionTableColumns(m_nTerms);
+  std::vector<double> col(m_nEnergySteps);
+  for (unsigned int k = 0; ok && k < m_nTerms; ++k) {
+    ok = ReadRaw(in, &col[0], m_nEnergySteps);
+    for (int i = 0; i < m_nEnergySteps; ++i) Term(i, k).cf = col[i];
+    ok = ok && ReadRaw(in, &col[0], m_nEnergyStepsLog);
+    for (int i = 0; i < m_nEnergyStepsLog; ++i) TermLog(i, k).cf = col[i];
+    if (ok && m_scatModel[k] == 1) {
+      ok = ReadRaw(in, &col[0], m_nEnergySteps);
+      for (int i = 0; i < m_nEnergySteps; ++i) Term(i, k).scatCut = col[i];
+      ok = ok && ReadRaw(in, &col[0], m_nEnergyStepsLog);
+      for (int i = 0; i < m_nEnergyStepsLog; ++i) {
+        TermLog(i, k).scatCut = col[i];
+      }
+    }
+    if (ok && (m_scatModel[k] == 1 || m_scatModel[k] == 2)) {
+      ok = ReadRaw(in, &col[0], m_nEnergySteps);
+      for (int i = 0; i < m_nEnergySteps; ++i) {
+        Term(i, k).scatParameter = col[i];
+      }
+      ok = ok && ReadRaw(in, &col[0], m_nEnergyStepsLog);
+      for (int i = 0; i < m_nEnergyStepsLog; ++i) {
+        TermLog(i, k).scatParameter = col[i];
+      }
+    }
+  }
+  unsigned int nDeexcitations = 0;
+  ok = ok && ReadRaw(in, m_iDeexcitation, m_nTerms) &&
+       ReadRaw(in, &nDeexcitations, 1) && nDeexcitations <= (1u << 20);
+  if (ok) m_deexcitations.resize(nDeexcitations);
+  for (unsigned int j = 0; ok && j < nDeexcitations; ++j) {
+    deexcitation& dxc = m_deexcitations[j];
+    ok = ReadRaw(in, &dxc.gas, 1) && ReadRaw(in, &dxc.level, 1) &&
+         ReadString(in, dxc.label) && ReadRaw(in, &dxc.energy, 1) &&
+         ReadRaw(in, &dxc.nChannels, 1) && ReadVector(in, dxc.p) &&
+         ReadVector(in, dxc.final) && ReadVector(in, dxc.type) &&
+         ReadRaw(in, &dxc.osc, 1) && ReadRaw(in, &dxc.rate, 1);
+    dxc.cf = dxc.sDoppler = dxc.gPressure = dxc.width = 0.;
+  }
+  if (!ok) {
+    std::cerr << m_className << "::ReadTableCache:\n";
+    std::cerr << "    File " << filename << " is corrupt. Ignored.\n";
+    // Start from scratch.
+    m_nTerms = 0;
+    m_deexcitations.clear();
+    for (int i = nMaxLevels; i--;) {
+      m_iDeexcitation[i] = -1;
+      m_scatModel[i] = 0;
+    }
+    for (int i = m_nEnergySteps; i--;) m_cfTot[i] = 0.;
+    for (int i = m_nEnergyStepsLog; i--;) m_cfTotLog[i] = 0.;
+    m_collisionTable.clear();
+    m_nColumns = 0;
+    return false;
+  }
+  if (m_debug || verbose) {
+    std::cout << m_className << "::Mixer:\n";
+    std::cout << "    Collision rate tables read from " << filename << ".\n";
+  }
+  return true;
+}
+
+void MediumMagboltz::FillLogTableRow(const unsigned int iGas, const int ngas,
+                                     const int np0, const int iE,
+                                     const double emax, gasmixTables& tab) {
+
+  // Number of inelastic cross-section terms
+  long long nIn = 0;
+  long long nIon = 0;
+  // Threshold energies
+  double e[6] = {0., 0., 0., 0., 0., 0.};
+  double eIn[nMaxInelasticTerms] = {0.};
+  double eIon[8] = {0.};
+  // Virial coefficient (not used)
+  double virial = 0.;
+  // Scattering algorithms
+  long long kIn[nMaxInelasticTerms] = {0};
+  long long kEl[6] = {0, 0, 0, 0, 0, 0};
+  char name[] = "                         ";
+
+  // Retrieve the cross-sections such that the last bin is centred at emax.
+  long long ngs = ngas;
+  Magboltz::inpt_.nStep = m_nEnergySteps;
+  Magboltz::inpt_.estep = emax / (m_nEnergySteps - 0.5);
+  Magboltz::inpt_.efinal = emax + 0.5 * Magboltz::inpt_.estep;
+  Magboltz::gasmix_(&ngs, tab.q[0], tab.qIn[0], &nIn, e, eIn, name, &virial,
+                    tab.eoby, tab.pEqEl[0], tab.pEqIn[0], tab.penFra[0], kEl,
+                    kIn, tab.qIon[0], tab.pEqIon[0], eIon, &nIon, tab.scrpt);
+  double (*q)[6] = tab.q;
+  double (*pEqEl)[6] = tab.pEqEl;
+  double (*qIn)[nMaxInelasticTerms] = tab.qIn;
+  double (*qIon)[8] = tab.qIon;
+  double (*pEqIn)[nMaxInelasticTerms] = tab.pEqIn;
+  double (*pEqIon)[8] = tab.pEqIon;
+
+  const double van = m_fraction[iGas] * GetNumberDensity() * SpeedOfLight *
+                     sqrt(2. / ElectronMass);
+  // Same selection of ionisation terms as in Mixer.
+  bool withIon = false;
+  if (nIon > 1) {
+    for (int j = 0; j < nIon; ++j) {
+      if (m_eFinal >= eIon[j]) withIon = true;
+    }
+  } else if (m_eFinal >= e[2]) {
+    withIon = true;
+  }
+  const int imax = m_nEnergySteps - 1;
+  int np = np0;
+  // Elastic scattering
+  TermLog(iE, np).cf = q[imax][1] * van;
+  if (m_scatModel[np] == 1) {
+    ComputeAngularCut(pEqEl[imax][1], TermLog(iE, np).scatCut,
+                      TermLog(iE, np).scatParameter);
+  } else if (m_scatModel[np] == 2) {
+    TermLog(iE, np).scatParameter = pEqEl[imax][1];
+  }
+  // Ionisation
+  if (withIon) {
+    if (nIon > 1) {
+      for (int j = 0; j < nIon; ++j) {
+        if (m_eFinal < eIon[j]) continue;
+        ++np;
+        TermLog(iE, np).cf = qIon[imax][j] * van;
+        if (m_scatModel[np] == 1) {
+          ComputeAngularCut(pEqIon[imax][j], TermLog(iE, np).scatCut,
+                            TermLog(iE, np).scatParameter);
+        } else if (m_scatModel[np] == 2) {
+          TermLog(iE, np).scatParameter = pEqIon[imax][j];
+        }
+      }
+    } else {
+      ++np;
+      // Gross cross-section
+      TermLog(iE, np).cf = q[imax][2] * van;
+      // Counting cross-section
+      // TermLog(iE, np).cf = q[imax][4] * van;
+      if (m_scatModel[np] == 1) {
+        ComputeAngularCut(pEqEl[imax][2], TermLog(iE, np).scatCut,
+                          TermLog(iE, np).scatParameter);
+      } else if (m_scatModel[np] == 2) {
+        TermLog(iE, np).scatParameter = pEqEl[imax][2];
+      }
+    }
+  }
+  // Attachment
+  ++np;
+  TermLog(iE, np).cf = q[imax][3] * van;
+  // Inelastic terms
+  for (int j = 0; j < nIn; ++j) {
+    ++np;
+    TermLog(iE, np).cf = qIn[imax][j] * van;
+    // Scale the excitation cross-sections (for error estimates).
+    TermLog(iE, np).cf *= m_scaleExc[iGas];
+    if (TermLog(iE, np).cf < 0.) {
+      std::cerr << m_className << "::Mixer:\n";
+      std::cerr << "    Negative inelastic cross-section at " << emax
+                << " eV.\n";
+      std::cerr << "    Set to zero.\n";
+      TermLog(iE, np).cf = 0.;
+    }
+    if (m_scatModel[np] == 1) {
+      ComputeAngularCut(pEqIn[imax][j], TermLog(iE, np).scatCut,
+                        TermLog(iE, np).scatParameter);
+    } else if (m_scatModel[np] == 2) {
+      TermLog(iE, np).scatParameter = pEqIn[imax][j];
+    }
+  }
+}
+
+void MediumMagboltz::NormaliseLogTableRow(const int iE) {
+
+  // Calculate the total collision frequency.
+  m_cfTotLog[iE] = 0.;
+  for (unsigned int k = 0; k < m_nTerms; ++k) {
+    if (TermLog(iE, k).cf < 0.) TermLog(iE, k).cf = 0.;
+    m_cfTotLog[iE] += TermLog(iE, k).cf;
+  }
+  // Normalise the collision probabilities.
+  if (m_cfTotLog[iE] > 0.) {
+    for (int k = m_nTerms; k--;) TermLog(iE, k).cf /= m_cfTotLog[iE];
+  }
+  for (unsigned int k = 1; k < m_nTerms; ++k) {
+    TermLog(iE, k).cf += TermLog(iE, k - 1).cf;
+  }
+  const double ekin = m_eHigh * exp((iE + 1) * m_lnStep);
+  m_cfTotLog[iE] *= sqrt(ekin) * sqrt(1. + 0.5 * ekin / ElectronMass) /
+                    (1. + ekin / ElectronMass);
+  // Store the logarithm (for log-log interpolation)
+  m_cfTotLog[iE] = log(m_cfTotLog[iE]);
+}
+
+void MediumMagboltz::UpdateCollisionTables() {
+
+  // Determine the null collision frequency.
+  m_cfNull = 0.;
+  for (int j = 0; j < m_nEnergySteps; ++j) {
+    if (m_cfTot[j] > m_cfNull) m_cfNull = m_cfTot[j];
+  }
+  if (m_eFinal > m_eHigh) {
+    for (int j = 0; j < m_nEnergyStepsLog; ++j) {
+      const double r = exp(m_cfTotLog[j]);
+      if (r > m_cfNull) m_cfNull = r;
+    }
+  }
+
+  // Complete the records used for sampling the collisions.
+  FinishCollisionTable();
+  // Prepare the lookup of the logarithmic energy bins.
+  if (m_eFinal > m_eHigh) ComputeLogBinLookup();
+}
+
+bool MediumMagboltz::ExtendLogTable() {
+
+  // The tables can only be extended if they are up to date, the
+  // logarithmic part is in use and no further ionisation channel opens up.
+  if (m_isChanged || m_eFinal <= m_eHigh || m_nEnergyStepsLog % 2 != 0) {
+    return false;
+  }
+  const double eFinal = m_eFinal * m_eFinal / m_eHigh;
+  if (m_eNextIonPot > 0. && m_eNextIonPot <= eFinal) return false;
+
+  // Doubling the logarithmic step, every second bin edge of the present
+  // table is a bin edge of the new one. Keep these rows and compute
+  // only the upper half of the table.
+  const int nKeep = m_nEnergyStepsLog / 2;
+  for (int iE = 0; iE < nKeep; ++iE) {
+    const int jE = 2 * iE + 1;
+    m_cfTotLog[iE] = m_cfTotLog[jE];
+    for (unsigned int k = 0; k < m_nTerms; ++k) {
+      TermLog(iE, k) = TermLog(jE, k);
+    }
+  }
+  m_eFinal = eFinal;
+  m_lnStep *= 2.;
+  for (int iE = nKeep; iE < m_nEnergyStepsLog; ++iE) {
+    for (unsigned int k = 0; k < m_nTerms; ++k) {
+      TermLog(iE, k) = collisionTerm();
+    }
+  }
+
+  ScratchBuffer<gasmixTables> scratch;
+  for (unsigned int iGas = 0; iGas < m_nComponents; ++iGas) {
+    int ngas = 0;
+    GetGasNumberMagboltz(m_gas[iGas], ngas);
+    // First cross-section term of this gas
+    int np0 = 0;
+    while (m_csType[np0] / nCsTypes != int(iGas)) ++np0;
+    for (int iE = nKeep; iE < m_nEnergyStepsLog; ++iE) {
+      const double emax = m_eHigh * exp((iE + 1) * m_lnStep);
+      FillLogTableRow(iGas, ngas, np0, iE, emax, *scratch);
+    }
+  }
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+  for (int iE = nKeep; iE < m_nEnergyStepsLog; ++iE) NormaliseLogTableRow(iE);
+
+  // Restore the energy range in the Magboltz common block.
+  Magboltz::inpt_.efinal = m_eFinal;
+  Magboltz::inpt_.estep = m_eStep;
+  UpdateCollisionTables();
+  if (m_useSecondaryEnergyTable) ComputeSecondaryEnergyTable();
+  if (m_tableDensity > 0.) m_tableKey = GetTableCacheKey(false);
   return true;
 }
 
+void MediumMagboltz::RescaleCollisionRates(const double f) {
+
+  // The branching ratios and angular distributions do not depend on the
+  // density, only the total rates (and everything derived from them) do
+  // (not applicable to mixtures with three-body attachment).
+  for (int iE = 0; iE < m_nEnergySteps; ++iE) m_cfTot[iE] *= f;
+  const double lnf = log(f);
+  for (int iE = 0; iE < m_nEnergyStepsLog; ++iE) m_cfTotLog[iE] += lnf;
+  m_tableDensity *= f;
+}
+
+void MediumMagboltz::SetCollisionTableColumns(const unsigned int n) {
+
+  // Energy-major layout, one record per (energy bin, cross-section term),
+  // linear bins followed by the logarithmic bins. Change the number of
+  // terms per row, keeping the entries of the present terms.
+  const unsigned int nRows = m_nEnergySteps + m_nEnergyStepsLog;
+  std::vector<collisionTerm> table(nRows * n, collisionTerm());
+  const unsigned int nCopy = std::min(n, m_nColumns);
+  for (unsigned int i = 0; i < nRows && nCopy > 0; ++i) {
+    std::copy(m_collisionTable.begin() + i * m_nColumns,
+              m_collisionTable.begin() + i * m_nColumns + nCopy,
+              table.begin() + i * n);
+  }
+  m_collisionTable.swap(table);
+  m_nColumns = n;
+}
+
+void MediumMagboltz::FinishCollisionTable() {
+
+  // Drop unused columns and copy the per-term parameters into each row,
+  // so that sampling a collision reads a single record.
+  if (m_nColumns != m_nTerms) SetCollisionTableColumns(m_nTerms);
+  if (m_nTerms == 0) return;
+  const unsigned int nRows = m_nEnergySteps + m_nEnergyStepsLog;
+  for (unsigned int i = 0; i < nRows; ++i) {
+    collisionTerm* row = &m_collisionTable[i * m_nColumns];
+    for (unsigned int k = 0; k < m_nTerms; ++k) {
+      row[k].energyLoss = m_energyLoss[k];
+      row[k].csType = m_csType[k];
+      row[k].scatModel = m_scatModel[k];
+    }
+  }
+}
+
+void MediumMagboltz::ComputeLogBinLookup() {
+
+  // Bin edges and collision rates at the edges.
+  const double rLog = pow(m_eFinal / m_eHigh, 1. / m_nEnergyStepsLog);
+  m_eLogEdges.resize(m_nEnergyStepsLog + 1);
+  m_cfTotLogRate.resize(m_nEnergyStepsLog);
+  m_cfTotLogSlope.resize(m_nEnergyStepsLog);
+  m_eLogEdges[0] = m_eHigh;
+  for (int i = 1; i <= m_nEnergyStepsLog; ++i) {
+    m_eLogEdges[i] = m_eHigh * pow(rLog, i);
+  }
+  m_eLogEdges[m_nEnergyStepsLog] = m_eFinal;
+  double rate = m_cfTot[m_nEnergySteps - 1];
+  for (int i = 0; i < m_nEnergyStepsLog; ++i) {
+    const double next = exp(m_cfTotLog[i]);
+    m_cfTotLogRate[i] = rate;
+    m_cfTotLogSlope[i] = (next - rate) / (m_eLogEdges[i + 1] - m_eLogEdges[i]);
+    rate = next;
+  }
+
+  // The leading bits of a positive double (exponent and upper mantissa)
+  // increase monotonically with its value and split each octave into
+  // 2^m intervals of equal width in energy. The widest of them in log
+  // energy is the first one, ln(1 + 2^-m). Choose m such that this is
+  // narrower than the logarithmic energy bins, so each key interval
+  // contains at most one bin edge (GetLogBin checks anyway).
+  int m = 0;
+  while (m < 30 && log(1. + 1. / (1 << m)) >= m_lnStep) ++m;
+  m_logKeyShift = 52 - m;
+  uint64_t bits = 0;
+  memcpy(&bits, &m_eHigh, sizeof(double));
+  m_logKeyOffset = bits >> m_logKeyShift;
+  memcpy(&bits, &m_eFinal, sizeof(double));
+  const uint64_t nKeys = (bits >> m_logKeyShift) - m_logKeyOffset + 1;
+  m_logKeyIndex.resize(nKeys);
+  int iE = 0;
+  for (uint64_t k = 0; k < nKeys; ++k) {
+    // Lower edge of the energy interval covered by this key.
+    bits = (m_logKeyOffset + k) << m_logKeyShift;
+    double e = 0.;
+    memcpy(&e, &bits, sizeof(double));
+    while (iE < m_nEnergyStepsLog - 1 && e >= m_eLogEdges[iE + 1]) ++iE;
+    m_logKeyIndex[k] = iE;
+  }
+}
+
 void MediumMagboltz::SetupGreenSawada() {
 
   for (unsigned int i = 0; i < m_nComponents; ++i) {
@@ -2209,6 +3133,92 @@ void MediumMagboltz::ComputeAngularCut(const double parIn, double& cut,
   cut = thetac * rads;
 }
 
+void MediumMagboltz::ComputeSecondaryEnergyTable() {
+
+  // Both splitting functions have the inverse cumulative distribution
+  // esec = e0 + w tan(a + r (b - a)). Tabulate e0, w and the angles a, b
+  // for each ionisation term as a function of the energy above the
+  // threshold, x = e - loss. The angles vary fastest just above the
+  // threshold, so the rows are spaced like the leading bits of x
+  // (nSecKeySteps equal steps per octave, starting at secMinExcess);
+  // the row of a given x is found from its bit pattern without log().
+  // Tabulating the angle keeps the tan() shape of the high-energy tail.
+  m_secTable.clear();
+  for (int i = nMaxLevels; i--;) m_iSecTable[i] = -1;
+  m_nSecRows = 0;
+  if (!m_useOpalBeaty && !m_useGreenSawada) return;
+
+  uint64_t bits = 0;
+  memcpy(&bits, &secMinExcess, sizeof(double));
+  m_secKeyOffset = bits >> nSecKeyShift;
+  memcpy(&bits, &m_eFinal, sizeof(double));
+  m_nSecRows = (bits >> nSecKeyShift) - m_secKeyOffset + 2;
+  for (unsigned int k = 0; k < m_nTerms; ++k) {
+    if (m_csType[k] % nCsTypes != ElectronCollisionTypeIonisation) continue;
+    const int igas = int(m_csType[k] / nCsTypes);
+    const double loss = m_energyLoss[k];
+    m_iSecTable[k] = m_secTable.size();
+    m_secTable.resize(m_secTable.size() + m_nSecRows * nSecParameters, 0.);
+    double* row = &m_secTable[m_iSecTable[k]];
+    for (int i = 0; i < m_nSecRows; ++i) {
+      bits = (m_secKeyOffset + i) << nSecKeyShift;
+      double x = 0.;
+      memcpy(&x, &bits, sizeof(double));
+      const double e = loss + x;
+      const double emax = 0.5 * x;
+      if (m_useOpalBeaty) {
+        const double w = m_wOpalBeaty[k];
+        row[0] = 0.;
+        row[1] = w;
+        row[2] = 0.;
+        row[3] = atan(emax / w);
+      } else {
+        const double w =
+            m_gsGreenSawada[igas] * e / (e + m_gbGreenSawada[igas]);
+        const double esec0 = m_tsGreenSawada[igas] -
+                             m_taGreenSawada[igas] /
+                                 (e + m_tbGreenSawada[igas]);
+        row[0] = esec0;
+        row[1] = w;
+        row[2] = -atan(esec0 / w);
+        row[3] = atan((emax - esec0) / w);
+      }
+      row += nSecParameters;
+    }
+  }
+}
+
+double MediumMagboltz::SampleSecondaryEnergy(const int level, const double e,
+                                             const double r) const {
+
+  // Locate the rows to interpolate between.
+  const double x = e - m_energyLoss[level];
+  int i = 0;
+  double f = 0.;
+  if (x > secMinExcess) {
+    uint64_t bits = 0;
+    memcpy(&bits, &x, sizeof(double));
+    const uint64_t key = bits >> nSecKeyShift;
+    i = std::min(int(key - m_secKeyOffset), m_nSecRows - 2);
+    double x0 = 0., x1 = 0.;
+    bits = (m_secKeyOffset + i) << nSecKeyShift;
+    memcpy(&x0, &bits, sizeof(double));
+    bits += uint64_t(1) << nSecKeyShift;
+    memcpy(&x1, &bits, sizeof(double));
+    f = std::min((x - x0) / (x1 - x0), 1.);
+  }
+  // Interpolate the parameters.
+  const double* row0 = &m_secTable[m_iSecTable[level]] + i * nSecParameters;
+  const double* row1 = row0 + nSecParameters;
+  double p[nSecParameters];
+  for (int j = 0; j < nSecParameters; ++j) {
+    p[j] = row0[j] + f * (row1[j] - row0[j]);
+  }
+  const double esec = p[0] + p[1] * tan(p[2] + r * (p[3] - p[2]));
+  // Stay within the kinematic limit at this energy.
+  return std::min(std::max(esec, 0.), 0.5 * x);
+}
+
 void MediumMagboltz::ComputeDeexcitationTable(const bool verbose) {
 
   for (int i = nMaxLevels; i--;) m_iDeexcitation[i] = -1;
@@ -4974,16 +5984,71 @@ void MediumMagboltz::ComputeDeexcitationTable(const bool verbose) {
         m_deexcitations[i].p[j] /= m_deexcitations[i].rate;
         if (j > 0) m_deexcitations[i].p[j] += m_deexcitations[i].p[j - 1];
       }
+      ComputeAliasTable(m_deexcitations[i].p, m_deexcitations[i].nChannels,
+                        m_deexcitations[i].aliasCut, m_deexcitations[i].alias);
     }
   }
 }
 
 void MediumMagboltz::ComputeDeexcitation(int iLevel, int& fLevel) {
 
+  if (!GetDeexcitationIndex(iLevel, iLevel)) return;
+  ComputeDeexcitationInternal(iLevel, fLevel);
+  if (fLevel >= 0 && fLevel < (int)m_deexcitations.size()) {
+    fLevel = m_deexcitations[fLevel].level;
+  }
+}
+
+void MediumMagboltz::ComputeDeexcitation(int iLevel, int& fLevel,
+                                         RandomStream& rng) {
+
+  if (!GetDeexcitationIndex(iLevel, iLevel)) return;
+  ComputeDeexcitationInternal(iLevel, fLevel, rng);
+  if (fLevel >= 0 && fLevel < (int)m_deexcitations.size()) {
+    fLevel = m_deexcitations[fLevel].level;
+  }
+}
+
+unsigned int MediumMagboltz::ComputeDeexcitation(int iLevel, int& fLevel,
+                                                 dxcProd* products,
+                                                 const unsigned int nMax) {
+
+  if (!GetDeexcitationIndex(iLevel, iLevel)) return 0;
+  GlobalRandom rndm;
+  double t = 0.;
+  bool truncated = false;
+  const unsigned int n = SampleDeexcitationCascade(
+      iLevel, fLevel, rndm, products, nMax, t, truncated);
+  if (truncated) ReportTruncatedCascade(n);
+  if (fLevel >= 0 && fLevel < (int)m_deexcitations.size()) {
+    fLevel = m_deexcitations[fLevel].level;
+  }
+  return n;
+}
+
+unsigned int MediumMagboltz::ComputeDeexcitation(int iLevel, int& fLevel,
+                                                 dxcProd* products,
+                                                 const unsigned int nMax,
+                                                 RandomStream& rng) {
+
+  if (!GetDeexcitationIndex(iLevel, iLevel)) return 0;
+  double t = 0.;
+  bool truncated = false;
+  const unsigned int n = SampleDeexcitationCascade(
+      iLevel, fLevel, rng, products, nMax, t, truncated);
+  if (truncated) ReportTruncatedCascade(n);
+  if (fLevel >= 0 && fLevel < (int)m_deexcitations.size()) {
+    fLevel = m_deexcitations[fLevel].level;
+  }
+  return n;
+}
+
+bool MediumMagboltz::GetDeexcitationIndex(const int level, int& index) {
+
   if (!m_useDeexcitation) {
     std::cerr << m_className << "::ComputeDeexcitation:\n";
     std::cerr << "    Deexcitation is disabled.\n";
-    return;
+    return false;
   }
 
   // Make sure that the tables are updated.
@@ -4991,100 +6056,145 @@ void MediumMagboltz::ComputeDeexcitation(int iLevel, int& fLevel) {
     if (!Mixer()) {
       std::cerr << m_className << "::ComputeDeexcitation:\n";
       std::cerr << "    Error calculating the collision rates table.\n";
-      return;
+      return false;
     }
     m_isChanged = false;
   }
 
-  if (iLevel < 0 || iLevel >= (int)m_nTerms) {
+  if (level < 0 || level >= (int)m_nTerms) {
     std::cerr << m_className << "::ComputeDeexcitation:\n";
     std::cerr << "    Level index is out of range.\n";
-    return;
+    return false;
   }
 
-  iLevel = m_iDeexcitation[iLevel];
-  if (iLevel < 0 || iLevel >= (int)m_deexcitations.size()) {
+  index = m_iDeexcitation[level];
+  if (index < 0 || index >= (int)m_deexcitations.size()) {
     std::cerr << m_className << "::ComputeDeexcitation:\n";
     std::cerr << "    Level is not deexcitable.\n";
-    return;
+    return false;
   }
+  return true;
+}
 
-  ComputeDeexcitationInternal(iLevel, fLevel);
-  if (fLevel >= 0 && fLevel < (int)m_deexcitations.size()) {
-    fLevel = m_deexcitations[fLevel].level;
+void MediumMagboltz::ComputeDeexcitationInternal(int iLevel, int& fLevel) {
+
+  GlobalRandom rndm;
+  SampleDeexcitation(iLevel, fLevel, rndm);
+}
+
+void MediumMagboltz::ComputeDeexcitationInternal(int iLevel, int& fLevel,
+                                                 RandomStream& rng) {
+
+  SampleDeexcitation(iLevel, fLevel, rng);
+}
+
+template <class R>
+void MediumMagboltz::SampleDeexcitation(int iLevel, int& fLevel, R& rndm) {
+
+  // Unless the cascade runs in circles, each level emits at most one product.
+  // Otherwise the buffer is enlarged and the cascade continued, up to
+  // a (generous) limit.
+  const unsigned int nLimit = 100 * (m_deexcitations.size() + 1);
+  m_dxcProducts.resize(m_deexcitations.size() + 1);
+  unsigned int n = 0;
+  double t = 0.;
+  bool truncated = false;
+  while (true) {
+    n += SampleDeexcitationCascade(iLevel, fLevel, rndm, &m_dxcProducts[n],
+                                   m_dxcProducts.size() - n, t, truncated);
+    if (!truncated) break;
+    if (m_dxcProducts.size() >= nLimit) {
+      ReportTruncatedCascade(n);
+      break;
+    }
+    iLevel = fLevel;
+    m_dxcProducts.resize(2 * m_dxcProducts.size());
   }
+  nDeexcitationProducts = n;
+  m_dxcProducts.resize(nDeexcitationProducts);
 }
 
-void MediumMagboltz::ComputeDeexcitationInternal(int iLevel, int& fLevel) {
+void MediumMagboltz::ReportTruncatedCascade(const unsigned int n) {
 
-  nDeexcitationProducts = 0;
-  m_dxcProducts.clear();
+  ++m_nTruncatedCascades;
+  if (m_debug) {
+    std::cerr << m_className << "::ComputeDeexcitation:\n"
+              << "    Buffer full, cascade stopped after " << n
+              << " products.\n";
+  }
+}
+
+template <class R>
+unsigned int MediumMagboltz::SampleDeexcitationCascade(
+    int iLevel, int& fLevel, R& rndm, dxcProd* products,
+    const unsigned int nMax, double& t, bool& truncated) {
 
+  // Time t [ns] is the start of the cascade on input and the time of the
+  // last transition on output (for continuing a truncated cascade).
+  unsigned int n = 0;
+  truncated = false;
   dxcProd newDxcProd;
   newDxcProd.s = 0.;
-  newDxcProd.t = 0.;
+  newDxcProd.t = t;
 
   fLevel = iLevel;
   const int nDeexcitations = m_deexcitations.size();
   while (iLevel >= 0 && iLevel < nDeexcitations) {
-    if (m_deexcitations[iLevel].rate <= 0. ||
-        m_deexcitations[iLevel].nChannels <= 0) {
+    const deexcitation& dxc = m_deexcitations[iLevel];
+    if (dxc.rate <= 0. || dxc.nChannels <= 0) {
       // This level is a dead end.
       fLevel = iLevel;
-      return;
+      return n;
+    }
+    if (n >= nMax) {
+      // No space for more products, the cascade is not finished.
+      fLevel = iLevel;
+      truncated = true;
+      return n;
     }
     // Determine the de-excitation time.
-    newDxcProd.t += -log(RndmUniformPos()) / m_deexcitations[iLevel].rate;
+    newDxcProd.t += -log(rndm.UniformPos()) / dxc.rate;
+    t = newDxcProd.t;
     // Select the transition.
-    fLevel = -1;
-    int type = DxcTypeRad;
-    const double r = RndmUniform();
-    for (int j = 0; j < m_deexcitations[iLevel].nChannels; ++j) {
-      if (r <= m_deexcitations[iLevel].p[j]) {
-        fLevel = m_deexcitations[iLevel].final[j];
-        type = m_deexcitations[iLevel].type[j];
-        break;
-      }
-    }
+    const double u = rndm.Uniform() * dxc.nChannels;
+    int j = std::min(int(u), dxc.nChannels - 1);
+    if (u - j >= dxc.aliasCut[j]) j = dxc.alias[j];
+    fLevel = dxc.final[j];
+    const int type = dxc.type[j];
     if (type == DxcTypeRad) {
       // Radiative decay
       newDxcProd.type = DxcProdTypePhoton;
-      newDxcProd.energy = m_deexcitations[iLevel].energy;
+      newDxcProd.energy = dxc.energy;
       if (fLevel >= 0) {
         // Decay to a lower lying excited state.
         newDxcProd.energy -= m_deexcitations[fLevel].energy;
         if (newDxcProd.energy < Small) newDxcProd.energy = Small;
-        m_dxcProducts.push_back(newDxcProd);
-        ++nDeexcitationProducts;
+        products[n++] = newDxcProd;
         // Proceed with the next level in the cascade.
         iLevel = fLevel;
       } else {
         // Decay to ground state.
-        double delta = RndmVoigt(0., m_deexcitations[iLevel].sDoppler,
-                                 m_deexcitations[iLevel].gPressure);
+        double delta = rndm.Voigt(0., dxc.sDoppler, dxc.gPressure);
         while (newDxcProd.energy + delta < Small ||
-               fabs(delta) >= m_deexcitations[iLevel].width) {
-          delta = RndmVoigt(0., m_deexcitations[iLevel].sDoppler,
-                            m_deexcitations[iLevel].gPressure);
+               fabs(delta) >= dxc.width) {
+          delta = rndm.Voigt(0., dxc.sDoppler, dxc.gPressure);
         }
         newDxcProd.energy += delta;
-        m_dxcProducts.push_back(newDxcProd);
-        ++nDeexcitationProducts;
+        products[n++] = newDxcProd;
         // Deexcitation cascade is over.
         fLevel = iLevel;
-        return;
+        return n;
       }
     } else if (type == DxcTypeCollIon) {
       // Ionisation electron
       newDxcProd.type = DxcProdTypeElectron;
-      newDxcProd.energy = m_deexcitations[iLevel].energy;
+      newDxcProd.energy = dxc.energy;
       if (fLevel >= 0) {
         // Associative ionisation
         newDxcProd.energy -= m_deexcitations[fLevel].energy;
         if (newDxcProd.energy < Small) newDxcProd.energy = Small;
         ++m_nPenning;
-        m_dxcProducts.push_back(newDxcProd);
-        ++nDeexcitationProducts;
+        products[n++] = newDxcProd;
         // Proceed with the next level in the cascade.
         iLevel = fLevel;
       } else {
@@ -5092,11 +6202,10 @@ void MediumMagboltz::ComputeDeexcitationInternal(int iLevel, int& fLevel) {
         newDxcProd.energy -= m_minIonPot;
         if (newDxcProd.energy < Small) newDxcProd.energy = Small;
         ++m_nPenning;
-        m_dxcProducts.push_back(newDxcProd);
-        ++nDeexcitationProducts;
+        products[n++] = newDxcProd;
         // Deexcitation cascade is over.
         fLevel = iLevel;
-        return;
+        return n;
       }
     } else if (type == DxcTypeCollNonIon) {
       // Proceed with the next level in the cascade.
@@ -5107,9 +6216,10 @@ void MediumMagboltz::ComputeDeexcitationInternal(int iLevel, int& fLevel) {
       std::cerr << "    Program bug!\n";
       // Abort the deexcitation calculation.
       fLevel = iLevel;
-      return;
+      return n;
     }
   }
+  return n;
 }
 
 bool MediumMagboltz::ComputePhotonCollisionTable(const bool verbose) {
@@ -5123,12 +6233,16 @@ bool MediumMagboltz::ComputePhotonCollisionTable(const bool verbose) {
 
   // Reset the collision rate arrays.
   m_cfTotGamma.clear();
-  m_cfTotGamma.resize(nEnergyStepsGamma, 0.);
+  m_cfTotGamma.resize(m_nEnergyStepsGamma, 0.);
   m_cfGamma.clear();
-  m_cfGamma.resize(nEnergyStepsGamma);
-  for (int j = nEnergyStepsGamma; j--;) m_cfGamma[j].clear();
+  m_cfGamma.resize(m_nEnergyStepsGamma);
+  for (int j = m_nEnergyStepsGamma; j--;) m_cfGamma[j].clear();
   csTypeGamma.clear();
 
+  m_lines.clear();
+  m_lineEnergies.clear();
+  m_lineWidthMax = 0.;
+
   nPhotonTerms = 0;
   for (unsigned int i = 0; i < m_nComponents; ++i) {
     const double prefactor = dens * SpeedOfLight * m_fraction[i];
@@ -5147,7 +6261,7 @@ bool MediumMagboltz::ComputePhotonCollisionTable(const bool verbose) {
     csTypeGamma.push_back(i * nCsTypesGamma + PhotonCollisionTypeIonisation);
     csTypeGamma.push_back(i * nCsTypesGamma + PhotonCollisionTypeInelastic);
     nPhotonTerms += 2;
-    for (int j = 0; j < nEnergyStepsGamma; ++j) {
+    for (int j = 0; j < m_nEnergyStepsGamma; ++j) {
       // Retrieve total photoabsorption cross-section and ionisation yield.
       data.GetPhotoabsorptionCrossSection(gasname, (j + 0.5) * m_eStepGamma, cs,
                                           eta);
@@ -5163,7 +6277,7 @@ bool MediumMagboltz::ComputePhotonCollisionTable(const bool verbose) {
   if (m_useCsOutput) {
     std::ofstream csfile;
     csfile.open("csgamma.txt", std::ios::out);
-    for (int j = 0; j < nEnergyStepsGamma; ++j) {
+    for (int j = 0; j < m_nEnergyStepsGamma; ++j) {
       csfile << (j + 0.5) * m_eStepGamma << "  ";
       for (int i = 0; i < nPhotonTerms; ++i) csfile << m_cfGamma[j][i] << "  ";
       csfile << "\n";
@@ -5172,7 +6286,7 @@ bool MediumMagboltz::ComputePhotonCollisionTable(const bool verbose) {
   }
 
   // Calculate the cumulative rates.
-  for (int j = 0; j < nEnergyStepsGamma; ++j) {
+  for (int j = 0; j < m_nEnergyStepsGamma; ++j) {
     for (int i = 0; i < nPhotonTerms; ++i) {
       if (i > 0) m_cfGamma[j][i] += m_cfGamma[j][i - 1];
     }
@@ -5183,7 +6297,7 @@ bool MediumMagboltz::ComputePhotonCollisionTable(const bool verbose) {
     std::cout << "    Energy [eV]      Mean free path [um]\n";
     for (int i = 0; i < 10; ++i) {
       const double imfp =
-          m_cfTotGamma[(2 * i + 1) * nEnergyStepsGamma / 20] / SpeedOfLight;
+          m_cfTotGamma[(2 * i + 1) * m_nEnergyStepsGamma / 20] / SpeedOfLight;
       std::cout << "    " << std::fixed << std::setw(10) << std::setprecision(2)
                 << (2 * i + 1) * m_eFinalGamma / 20 << "    " << std::setw(18)
                 << std::setprecision(4);
@@ -5242,6 +6356,7 @@ bool MediumMagboltz::ComputePhotonCollisionTable(const bool verbose) {
     std::cerr << "    No resonance lines found.\n";
     return true;
   }
+  ComputeLineProfiles();
 
   if (m_debug || verbose) {
     std::cout << m_className << "::ComputePhotonCollisionTable:\n";
@@ -5275,6 +6390,40 @@ bool MediumMagboltz::ComputePhotonCollisionTable(const bool verbose) {
   return true;
 }
 
+void MediumMagboltz::ComputeLineProfiles() {
+
+  // Order the absorption lines by energy.
+  std::vector<std::pair<double, int> > order;
+  const unsigned int nDeexcitations = m_deexcitations.size();
+  for (unsigned int i = 0; i < nDeexcitations; ++i) {
+    if (m_deexcitations[i].cf <= 0. || m_deexcitations[i].width <= 0.) {
+      continue;
+    }
+    order.push_back(std::make_pair(m_deexcitations[i].energy, int(i)));
+  }
+  std::sort(order.begin(), order.end());
+
+  const unsigned int nLines = order.size();
+  m_lines.resize(nLines);
+  m_lineEnergies.resize(nLines);
+  for (unsigned int k = 0; k < nLines; ++k) {
+    const deexcitation& dxc = m_deexcitations[order[k].second];
+    lineProfile& line = m_lines[k];
+    line.dxc = order[k].second;
+    line.energy = dxc.energy;
+    line.width = dxc.width;
+    // The grid is dense in the core and coarse in the far wings.
+    line.f.resize(nLineProfileSteps + 1);
+    for (int j = 0; j <= nLineProfileSteps; ++j) {
+      const double u = double(j) / nLineProfileSteps;
+      line.f[j] = dxc.cf * TMath::Voigt(u * u * dxc.width, dxc.sDoppler,
+                                        2 * dxc.gPressure);
+    }
+    m_lineEnergies[k] = line.energy;
+    if (line.width > m_lineWidthMax) m_lineWidthMax = line.width;
+  }
+}
+
 void MediumMagboltz::RunMagboltz(const double e, const double bmag,
                                  const double btheta, const int ncoll,
                                  bool verbose, double& vx, double& vy,
@@ -5294,6 +6443,10 @@ void MediumMagboltz::RunMagboltz(const double e, const double bmag,
   dlerr = dterr = 0.;
   alphaerr = etaerr = 0.;
   lorerr = 0.;
+  m_magboltzRun = GasTablePoint();
+  m_magboltzRun.e = e;
+  m_magboltzRun.b = bmag;
+  m_magboltzRun.angle = btheta;
 
   // Set input parameters in Magboltz common blocks.
   Magboltz::inpt_.nGas = m_nComponents;
@@ -5338,6 +6491,7 @@ void MediumMagboltz::RunMagboltz(const double e, const double bmag,
 
   long long ielow = 1;
   while (ielow == 1) {
+    ++m_magboltzRun.efinalIterations;
     Magboltz::mixer_();
     if (bmag == 0. || btheta == 0. || fabs(btheta) == Pi) {
       Magboltz::elimit_(&ielow);
@@ -5353,9 +6507,13 @@ void MediumMagboltz::RunMagboltz(const double e, const double bmag,
     }
   }
 
+  m_magboltzRun.efinal = Magboltz::inpt_.efinal;
+  m_magboltzRun.estart = Magboltz::setp_.estart;
   if (m_debug || verbose) Magboltz::prnter_();
 
   // Run the Monte Carlo calculation.
+  // (Magboltz simulates nmax * 10^7 collisions.)
+  m_magboltzRun.requestedCollisions = 1.e7 * ncoll;
   if (bmag == 0.) {
     Magboltz::monte_();
   } else if (btheta == 0. || btheta == Pi) {
@@ -5393,6 +6551,18 @@ void MediumMagboltz::RunMagboltz(const double e, const double bmag,
     double fc2 = 1.e12 * (alphapt - etapt) / Magboltz::tofout_.tofdl;
     alphatof = fc1 - sqrt(fc1 * fc1 - fc2);
   }
+  m_magboltzRun.sst = useSST;
+  if (useSST) {
+    m_magboltzRun.tofene = Magboltz::tofout_.tofene;
+    m_magboltzRun.tofwv = Magboltz::tofout_.tofwv;
+    m_magboltzRun.tofwr = Magboltz::tofout_.tofwr;
+    m_magboltzRun.tofdl = Magboltz::tofout_.tofdl;
+    m_magboltzRun.tofdt = Magboltz::tofout_.tofdt;
+    m_magboltzRun.rion = Magboltz::tofout_.rion;
+    m_magboltzRun.ratt = Magboltz::tofout_.ratt;
+    m_magboltzRun.ralpha = Magboltz::tofout_.ralpha;
+    m_magboltzRun.rattof = Magboltz::tofout_.rattof;
+  }
   if (m_debug || verbose) Magboltz::output2_();
 
   // Velocities. Convert to cm / ns.
@@ -5434,6 +6604,32 @@ void MediumMagboltz::RunMagboltz(const double e, const double bmag,
   eta = Magboltz::ctowns_.att;
   etaerr = Magboltz::ctwner_.atter;
 
+  // Keep the results with the diagnostics of this run.
+  GasTablePoint& run = m_magboltzRun;
+  run.vx = vx;
+  run.vy = vy;
+  run.vz = vz;
+  run.vxerr = vxerr;
+  run.vyerr = vyerr;
+  run.vzerr = vzerr;
+  run.dl = dl;
+  run.dt = dt;
+  run.dlerr = dlerr;
+  run.dterr = dterr;
+  run.alpha = alpha;
+  run.eta = eta;
+  run.alphaerr = alphaerr;
+  run.etaerr = etaerr;
+  run.alphatof = alphatof;
+  run.lor = lor;
+  run.lorerr = lorerr;
+  run.difxx = Magboltz::diflab_.difxx;
+  run.difyy = Magboltz::diflab_.difyy;
+  run.difzz = Magboltz::diflab_.difzz;
+  run.difxy = Magboltz::diflab_.difxy;
+  run.difxz = Magboltz::diflab_.difxz;
+  run.difyz = Magboltz::diflab_.difyz;
+
   // Print the results.
   if (m_debug) {
     std::cout << m_className << "::RunMagboltz:\n    Results:\n";
@@ -5478,6 +6674,8 @@ void MediumMagboltz::RunMagboltz(const double e, const double bmag,
 
 void MediumMagboltz::GenerateGasTable(const int numColl, const bool verbose) {
 
+  // Drop the columns of a lazily loaded table not yet converted.
+  ReleaseGasTable();
   // Set the reference pressure and temperature.
   m_pressureTable = m_pressure;
   m_temperatureTable = m_temperature;
@@ -5533,10 +6731,15 @@ void MediumMagboltz::GenerateGasTable(const int numColl, const bool verbose) {
   double alphatof = 0.;
   double lorerr = 0.;
 
+  m_gasTablePoints.clear();
+  const unsigned int nPoints = nEfields * nAngles * nBfields;
+  const double start = WallTime();
+
   // Run through the grid of E- and B-fields and angles.
   for (unsigned int i = 0; i < nEfields; ++i) {
     for (unsigned int j = 0; j < nAngles; ++j) {
       for (unsigned int k = 0; k < nBfields; ++k) {
+        const double t0 = WallTime();
         if (m_debug) {
           std::cout << m_className << "::GenerateGasTable:\n"
                     << "    E = " << m_eFields[i] << " V/cm, B = " 
@@ -5563,8 +6766,188 @@ void MediumMagboltz::GenerateGasTable(const int numColl, const bool verbose) {
         } else {
           tabElectronAttachment[j][k][i] = -30.;
         }
+        // Progress and diagnostics.
+        GasTablePoint point = m_magboltzRun;
+        point.index = m_gasTablePoints.size();
+        point.nPoints = nPoints;
+        point.ie = i;
+        point.ib = k;
+        point.ia = j;
+        const double t1 = WallTime();
+        point.time = t1 - t0;
+        point.elapsed = t1 - start;
+        point.remaining =
+            point.elapsed / (point.index + 1) * (nPoints - point.index - 1);
+        m_gasTablePoints.push_back(point);
+        if (m_gasTableCallback) {
+          m_gasTableCallback(point, m_gasTableCallbackData);
+        }
+      }
+    }
+  }
+  if (m_debug && !m_gasTablePoints.empty()) {
+    unsigned int slowest = 0;
+    for (unsigned int i = 1; i < m_gasTablePoints.size(); ++i) {
+      if (m_gasTablePoints[i].time > m_gasTablePoints[slowest].time) {
+        slowest = i;
       }
     }
+    const GasTablePoint& point = m_gasTablePoints[slowest];
+    std::cout << m_className << "::GenerateGasTable:\n"
+              << "    " << nPoints << " points in " << point.elapsed
+              << " s, slowest: E = " << point.e << " V/cm, B = " << point.b
+              << " T, angle " << point.angle << " rad (" << point.time
+              << " s).\n";
+  }
+}
+
+void MediumMagboltz::PrintGasTableProgress(const GasTablePoint& point,
+                                           void* /*data*/) {
+
+  const std::ios::fmtflags flags = std::cout.flags();
+  const std::streamsize precision = std::cout.precision();
+  std::cout << "MediumMagboltz::GenerateGasTable: point " << point.index + 1
+            << "/" << point.nPoints << " (E = " << point.e << " V/cm, B = "
+            << point.b << " T, angle " << point.angle << " rad): "
+            << std::fixed << std::setprecision(1) << point.time << " s, "
+            << "efinal " << std::setprecision(2) << point.efinal << " eV ("
+            << point.efinalIterations << " iterations)"
+            << (point.sst ? ", SST/TOF" : "") << ", elapsed "
+            << std::setprecision(0) << point.elapsed << " s, remaining ~"
+            << point.remaining << " s\n";
+  std::cout.flags(flags);
+  std::cout.precision(precision);
+}
+
+bool MediumMagboltz::ImportGasTable(const GasTable& table) {
+
+  // Decode the composition (percentages indexed by gas number - 1).
+  std::string gases[m_nMaxGases];
+  double fractions[m_nMaxGases];
+  unsigned int nGases = 0;
+  double sum = 0.;
+  const double* mixture = table.GetMixture();
+  for (unsigned int i = 0; i < GasTable::nMixture; ++i) {
+    if (table.IsEmpty() || mixture[i] <= 0.) continue;
+    if (nGases >= m_nMaxGases) {
+      std::cerr << m_className << "::ImportGasTable:\n"
+                << "    Mixture has more than " << m_nMaxGases
+                << " components.\n";
+      return false;
+    }
+    if (!GetGasName(i + 1, table.GetVersion(), gases[nGases])) {
+      std::cerr << m_className << "::ImportGasTable:\n"
+                << "    Unknown gas number " << i + 1 << ".\n";
+      return false;
+    }
+    fractions[nGases] = mixture[i];
+    sum += mixture[i];
+    ++nGases;
+  }
+  if (nGases == 0 || sum <= 0.) {
+    std::cerr << m_className << "::ImportGasTable:\n"
+              << "    Table has no valid gas composition.\n";
+    return false;
+  }
+  if (!Medium::ImportGasTable(table)) return false;
+
+  m_gasTablePoints.clear();
+  m_nComponents = nGases;
+  m_name = "";
+  for (unsigned int i = 0; i < m_nMaxGases; ++i) {
+    if (i >= nGases) {
+      m_gas[i] = "";
+      m_fraction[i] = 0.;
+      continue;
+    }
+    m_gas[i] = gases[i];
+    m_fraction[i] = fractions[i] / sum;
+    GetGasInfo(m_gas[i], m_atWeight[i], m_atNum[i]);
+    if (i > 0) m_name += "/";
+    m_name += m_gas[i];
+  }
+  m_pressureTable = m_pressure;
+  m_temperatureTable = m_temperature;
+  // Read in place, like the other columns of a mapped table.
+  const unsigned int noPenning = GasTable::TownsendNoPenning;
+  if (&table == m_gasTable && table.IsMapped() &&
+      table.HasQuantity(noPenning)) {
+    m_mappedTables |= 1u << noPenning;
+  }
+  ImportGasTableColumn(table, noPenning);
+  // Excitation and ionisation rates are not transferred.
+  m_hasExcRates = false;
+  m_tabExcRates.clear();
+  m_excitationList.clear();
+  m_hasIonRates = false;
+  m_tabIonRates.clear();
+  m_ionisationList.clear();
+  m_isChanged = true;
+  return true;
+}
+
+void MediumMagboltz::ImportGasTableColumn(const GasTable& table,
+                                          const unsigned int q) {
+
+  if (q != GasTable::TownsendNoPenning) {
+    Medium::ImportGasTableColumn(table, q);
+    return;
+  }
+  m_tabTownsendNoPenning.clear();
+  if ((m_pendingTables | m_mappedTables) & (1u << q)) return;
+  GetGasTableColumn(table, q, m_tabTownsendNoPenning, 1.,
+                    log(table.GetPressure()));
+}
+
+bool MediumMagboltz::ExportGasTable(GasTable& table) const {
+
+  const double p = m_pressureTable > 0. ? m_pressureTable : m_pressure;
+  const double t = m_temperatureTable > 0. ? m_temperatureTable
+                                           : m_temperature;
+  if (!ExportTables(table, p, t)) return false;
+
+  std::ostringstream identifier;
+  for (unsigned int i = 0; i < m_nComponents; ++i) {
+    int ng = 0;
+    if (!GetGasNumberGasFile(m_gas[i], ng) || ng < 1 ||
+        ng > (int)GasTable::nMixture) {
+      std::cerr << m_className << "::ExportGasTable:\n"
+                << "    Gas " << m_gas[i] << " has no gas file number.\n";
+      return false;
+    }
+    table.SetMixture(ng - 1, 100. * m_fraction[i]);
+    identifier << m_gas[i] << " " << 100. * m_fraction[i] << "%, ";
+  }
+  identifier << "p = " << p / AtmosphericPressure << " atm, T = " << t
+             << " K";
+  table.SetIdentifier(identifier.str());
+  const TableView noPenning =
+      View(m_tabTownsendNoPenning, GasTable::TownsendNoPenning);
+  if (!noPenning.IsEmpty()) {
+    SetGasTableColumn(table, GasTable::TownsendNoPenning, noPenning, 1.,
+                      -log(p));
+  }
+  if (!m_storeDiagnostics || m_gasTablePoints.empty()) return true;
+  // Only if the points belong to the current field grid.
+  const unsigned int np = table.GetNumberOfPoints();
+  if (m_gasTablePoints.size() != np) return true;
+  std::vector<double> values(nDiagnostics * np, 0.);
+  double x[nDiagnostics];
+  for (unsigned int i = 0; i < np; ++i) {
+    const GasTablePoint& point = m_gasTablePoints[i];
+    if (point.ie >= m_eFields.size() || point.ib >= m_bFields.size() ||
+        point.ia >= m_bAngles.size() || point.e != m_eFields[point.ie] ||
+        point.b != m_bFields[point.ib] || point.angle != m_bAngles[point.ia]) {
+      return true;
+    }
+    GetDiagnostics(point, x);
+    const unsigned int index = table.GetIndex(point.ie, point.ia, point.ib);
+    for (unsigned int j = 0; j < nDiagnostics; ++j) {
+      values[j * np + index] = x[j];
+    }
   }
+  const std::vector<std::string> names(DiagnosticNames,
+                                       DiagnosticNames + nDiagnostics);
+  return table.SetDiagnostics(names, values);
 }
 }
@@ -0,0 +1,625 @@
+#ifndef G_MEDIUM_MAGBOLTZ_9
+#define G_MEDIUM_MAGBOLTZ_9
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <stdint.h>
+
+#include "MediumGas.hh"
+#include "RandomStream.hh"
+#include "GasTable.hh"
+
+namespace Garfield {
+
+/// Interface to %Magboltz (version 9).
+
+class MediumMagboltz : public MediumGas {
+
+ public:
+  // Constructor
+  MediumMagboltz();
+  // Destructor
+  virtual ~MediumMagboltz() {}
+
+  // Set/get the highest electron energy to be included
+  // in the scattering rates table
+  bool SetMaxElectronEnergy(const double e);
+  double GetMaxElectronEnergy() const { return m_eFinal; }
+
+  // Set/get the highest photon energy to be included
+  // in the scattering rates table
+  bool SetMaxPhotonEnergy(const double e);
+  double GetMaxPhotonEnergy() const { return m_eFinalGamma; }
+
+  // Set the number of linear, logarithmic and photon energy steps of the
+  // collision rate tables, e. g. 4000/50/1000 for drift gases with
+  // electron energies up to a few hundred eV (small memory footprint),
+  // 20000/1000/20000 for finer high-energy and photon tables
+  // (default: 20000/200/5000, see MAGBOLTZ_* in MediumMagboltz.cc)
+  bool SetTableSize(const int nSteps, const int nStepsLog,
+                    const int nStepsGamma);
+
+  // Switch on/off automatic adjustment of max. energy when an
+  // energy exceeding the present range is requested
+  void EnableEnergyRangeAdjustment() { m_useAutoAdjust = true; }
+  void DisableEnergyRangeAdjustment() { m_useAutoAdjust = false; }
+  // Set the minimum factor by which the energy range is increased
+  // in case of automatic adjustment
+  bool SetEnergyRangeGrowthFactor(const double f);
+  // Determine the energy range from a short simulation of an electron
+  // drifting in a uniform field emax [V/cm] (e. g. the highest field
+  // in the field map), instead of adjusting it during the simulation
+  bool EstimateMaxElectronEnergy(const double emax,
+                                 const unsigned int nCollisions = 100000,
+                                 const double margin = 1.5);
+
+  // Switch on/off anisotropic scattering (enabled by default)
+  void EnableAnisotropicScattering() {
+    m_useAnisotropic = true;
+    m_isChanged = true;
+  }
+  void DisableAnisotropicScattering() {
+    m_useAnisotropic = false;
+    m_isChanged = true;
+  }
+
+  // Switch on/off the fast calculation of the scattering kinematics
+  // (square roots instead of trigonometric functions, azimuth sampled
+  // by rejection; same distributions, different random number sequence)
+  void EnableFastKinematics() { m_useFastKinematics = true; }
+  void DisableFastKinematics() { m_useFastKinematics = false; }
+
+  // Select secondary electron energy distribution parameterization
+  void SetSplittingFunctionOpalBeaty();
+  void SetSplittingFunctionGreenSawada();
+  void SetSplittingFunctionFlat();
+  // Sample the secondary electron energy from precomputed tables of
+  // the splitting function parameters instead of evaluating them
+  // (saves the arc tangents per ionisation)
+  void EnableSecondaryEnergyTable();
+  void DisableSecondaryEnergyTable() {
+    m_useSecondaryEnergyTable = false;
+    m_secTable.clear();
+    for (int i = nMaxLevels; i--;) m_iSecTable[i] = -1;
+  }
+
+  // Switch on/off de-excitation handling
+  void EnableDeexcitation();
+  void DisableDeexcitation() { m_useDeexcitation = false; }
+  // Switch on/off discrete photoabsorption levels
+  void EnableRadiationTrapping();
+  void DisableRadiationTrapping() { m_useRadTrap = false; }
+
+  // Switch on/off simplified simulation of Penning transfers by means of
+  // transfer probabilities (not compatible with de-excitation handling)
+  void EnablePenningTransfer(const double r, const double lambda);
+  void EnablePenningTransfer(const double r, const double lambda,
+                             std::string gasname);
+  void DisablePenningTransfer();
+  void DisablePenningTransfer(std::string gasname);
+
+  // When enabled, the gas cross-section table is written to file
+  // (binary, see WriteCrossSections) when loaded into memory.
+  void EnableCrossSectionOutput(const std::string& filename = "cs.bin") {
+    m_useCsOutput = true;
+    m_csOutputFile = filename;
+  }
+  void DisableCrossSectionOutput() { m_useCsOutput = false; }
+  // Write the electron cross-sections [cm2] of the present collision
+  // table to a binary file (native byte order):
+  //   char[8] "GMBZCS", uint32 version, nTerms, nLinear, nLog,
+  //   per term: int32 csType, gas, type, double threshold [eV],
+  //             char[50] description,
+  //   double energies [eV] (nLinear + nLog),
+  //   double cross-sections [nTerms][nLinear + nLog].
+  // Excitation cross-sections include the scaling factor (if any).
+  bool WriteCrossSections(const std::string& filename);
+
+  // When enabled, the collision rate tables are stored in (and, if a
+  // matching file exists, loaded from) the given directory, with one
+  // binary file per combination of gas composition, density, energy range
+  // and settings
+  void EnableTableCache(const std::string& dir) { m_cacheDir = dir; }
+  void DisableTableCache() { m_cacheDir = ""; }
+
+  // Multiply excitation cross-sections by a uniform scaling factor
+  void SetExcitationScalingFactor(const double r, std::string gasname);
+
+  bool Initialise(const bool verbose = false);
+  void PrintGas();
+
+  // Get the overall null-collision rate [ns-1]
+  double GetElectronNullCollisionRate(const int band = 0);
+  // Get the (real) collision rate [ns-1] at a given electron energy e [eV]
+  double GetElectronCollisionRate(const double e, const int band = 0);
+  // Get the collision rate [ns-1] for a specific level
+  double GetElectronCollisionRate(const double e, const unsigned int level,
+                                  const int band);
+  // Sample the collision type
+  bool GetElectronCollision(const double e, int& type, int& level, double& e1,
+                            double& dx, double& dy, double& dz, int& nion,
+                            int& ndxc, int& band);
+  // Same as above, but drawing all random numbers from the given stream
+  // instead of the global generator. For reproducible results, the tables
+  // should be set up (Initialise) and the energy range adjustment be
+  // switched off beforehand.
+  // The RandomStream overloads only make the random numbers separable,
+  // they are not re-entrant: the ionisation and de-excitation products,
+  // the collision counters and the energy range adjustment are still
+  // kept in the medium. Concurrent callers (threads) need a medium each
+  // or must serialise the calls.
+  bool GetElectronCollision(const double e, int& type, int& level, double& e1,
+                            double& dx, double& dy, double& dz, int& nion,
+                            int& ndxc, int& band, RandomStream& rng);
+  unsigned int GetNumberOfIonisationProducts() const {
+    return m_ionProducts.size();
+  }
+  bool GetIonisationProduct(const unsigned int i, int& type,
+                            double& energy) const;
+
+  // De-excitation product
+  struct dxcProd {
+    // Radial spread
+    double s;
+    // Time delay
+    double t;
+    // Type of deexcitation product
+    int type;
+    // Energy of the electron or photon
+    double energy;
+  };
+  void ComputeDeexcitation(int iLevel, int& fLevel);
+  void ComputeDeexcitation(int iLevel, int& fLevel, RandomStream& rng);
+  // Sample a de-excitation cascade and write the products to a buffer
+  // of size nMax provided by the caller (the internal list of products
+  // is left untouched). The cascade is stopped when the buffer is full
+  // (see GetNumberOfTruncatedCascades). Returns the number of products.
+  unsigned int ComputeDeexcitation(int iLevel, int& fLevel, dxcProd* products,
+                                   const unsigned int nMax);
+  unsigned int ComputeDeexcitation(int iLevel, int& fLevel, dxcProd* products,
+                                   const unsigned int nMax, RandomStream& rng);
+  unsigned int GetNumberOfDeexcitationProducts() const {
+    return m_dxcProducts.size();
+  }
+  bool GetDeexcitationProduct(const unsigned int i, double& t, double& s,
+                              int& type, double& energy) const;
+
+  double GetPhotonCollisionRate(const double e);
+  bool GetPhotonCollision(const double e, int& type, int& level, double& e1,
+                          double& ctheta, int& nsec, double& esec);
+  bool GetPhotonCollision(const double e, int& type, int& level, double& e1,
+                          double& ctheta, int& nsec, double& esec,
+                          RandomStream& rng);
+
+  // Reset the collision counters
+  void ResetCollisionCounters();
+  // Get total number of electron collisions
+  unsigned int GetNumberOfElectronCollisions() const;
+  // Get number of collisions broken down by cross-section type
+  unsigned int GetNumberOfElectronCollisions(int& nElastic, int& nIonising,
+                                             int& nAttachment, int& nInelastic,
+                                             int& nExcitation,
+                                             int& nSuperelastic) const;
+  // Get number of cross-section terms
+  int GetNumberOfLevels();
+  // Get detailed information about a given cross-section term i
+  bool GetLevel(const unsigned int i, int& ngas, int& type, std::string& descr,
+                double& e);
+  // Get number of collisions for a specific cross-section term
+  unsigned int GetNumberOfElectronCollisions(const unsigned int level) const;
+
+  int GetNumberOfPenningTransfers() const { return m_nPenning; }
+  // Number of de-excitation cascades stopped because the buffer
+  // for the products was full
+  unsigned int GetNumberOfTruncatedCascades() const {
+    return m_nTruncatedCascades;
+  }
+
+  // Get total number of photon collisions
+  int GetNumberOfPhotonCollisions() const;
+  // Get number of photon collisions by collision type
+  int GetNumberOfPhotonCollisions(int& nElastic, int& nIonising,
+                                  int& nInelastic) const;
+
+  void RunMagboltz(const double e, const double b, const double btheta,
+                   const int ncoll, bool verbose, double& vx, double& vy,
+                   double& vz, double& dl, double& dt, double& alpha,
+                   double& eta, double& lor, double& vxerr, double& vyerr,
+                   double& vzerr, double& dlerr, double& dterr,
+                   double& alphaerr, double& etaerr, double& lorerr,
+                   double& alphatof);
+
+  // Generate a new gas table (can later be saved to file)
+  // The Magboltz printout is only produced if verbose (or debugging)
+  // is on; the diagnostics below are collected in any case.
+  void GenerateGasTable(const int numCollisions = 10,
+                        const bool verbose = true);
+
+  // Progress and diagnostics of a point of GenerateGasTable.
+  struct GasTablePoint {
+    // Number of the point (in the order of calculation), number of points
+    unsigned int index, nPoints;
+    // Indices in the field grid and fields (V/cm, T, rad)
+    unsigned int ie, ib, ia;
+    double e, b, angle;
+    // Number of collisions requested from Magboltz (nmax * 10^7; the
+    // number actually simulated is not available from the interface)
+    double requestedCollisions;
+    // Iterations of the search for the upper end of the energy range,
+    // and final value [eV]
+    unsigned int efinalIterations;
+    double efinal;
+    // Start of the energy range [eV]
+    double estart;
+    // Townsend and attachment coefficients from the steady-state (SST)
+    // and time-of-flight (TOF) analysis, used for high alpha or eta
+    bool sst;
+    // Results as returned by RunMagboltz (errors in %)
+    double vx, vy, vz, vxerr, vyerr, vzerr;
+    double dl, dt, dlerr, dterr;
+    double alpha, eta, alphaerr, etaerr, alphatof;
+    double lor, lorerr;
+    // Diffusion tensor [cm2/s] in the lab frame
+    double difxx, difyy, difzz, difxy, difxz, difyz;
+    // SST/TOF results in Magboltz units (only if sst): mean energy [eV],
+    // TOF drift velocities and diffusion, ionisation and attachment rates
+    double tofene, tofwv, tofwr, tofdl, tofdt;
+    double rion, ratt, ralpha, rattof;
+    // Wall time [s] of this point, since the start of the run,
+    // and estimated time to the end of the run
+    double time, elapsed, remaining;
+  };
+  typedef void (*GasTableCallback)(const GasTablePoint& point, void* data);
+  // Function to be called after each point of GenerateGasTable
+  // (data is passed through, NULL switches it off).
+  void SetGasTableCallback(GasTableCallback f, void* data = NULL) {
+    m_gasTableCallback = f;
+    m_gasTableCallbackData = data;
+  }
+  // Callback printing a progress line.
+  static void PrintGasTableProgress(const GasTablePoint& point, void* data);
+  // Diagnostics of the last RunMagboltz call.
+  const GasTablePoint& GetMagboltzRun() const { return m_magboltzRun; }
+  // Diagnostics of the points of the last GenerateGasTable run.
+  const std::vector<GasTablePoint>& GetGasTablePoints() const {
+    return m_gasTablePoints;
+  }
+  // Store the diagnostics of the points in exported gas tables
+  // (see GasTable::SetDiagnostics).
+  void EnableGasTableDiagnostics() { m_storeDiagnostics = true; }
+  void DisableGasTableDiagnostics() { m_storeDiagnostics = false; }
+
+  // Copy the transport tables and the gas composition from/to a gas table.
+  bool ImportGasTable(const GasTable& table);
+  bool ExportGasTable(GasTable& table) const;
+
+ protected:
+  // Also converts the Townsend coefficient without Penning transfer.
+  void ImportGasTableColumn(const GasTable& table, const unsigned int q);
+
+ private:
+  // Size of the Magboltz cross-section arrays
+  static const int nMaxEnergySteps = 20000;
+  static const int nMaxInelasticTerms = 250;
+  static const int nMaxLevels = 512;
+  static const int nCsTypes = 6;
+  static const int nCsTypesGamma = 4;
+  // Rows of the secondary energy table: leading bits of the energy above
+  // the threshold (16 steps per octave), starting at secMinExcess [eV]
+  static const int nSecKeyShift = 48;
+  static const double secMinExcess;
+  // Parameters per row of the secondary energy table
+  static const int nSecParameters = 4;
+  static const int nLineProfileSteps = 2048;
+
+  static const int DxcTypeRad;
+  static const int DxcTypeCollIon;
+  static const int DxcTypeCollNonIon;
+
+  // Number of energy steps of the collision rate tables
+  int m_nEnergySteps;
+  int m_nEnergyStepsLog;
+  int m_nEnergyStepsGamma;
+  // Energy spacing of collision rate tables
+  double m_eFinal, m_eStep;
+  double m_eHigh, m_eHighLog;
+  double m_lnStep;
+  bool m_useAutoAdjust;
+  double m_eRangeGrowth;
+
+  // Flag enabling/disabling output of cross-section table to file
+  bool m_useCsOutput;
+  std::string m_csOutputFile;
+  // Directory for caching the collision rate tables (empty: no caching)
+  std::string m_cacheDir;
+  // Settings (except pressure) and number density of the present tables
+  std::string m_tableKey;
+  double m_tableDensity;
+  // Number of different cross-section types in the current gas mixture
+  unsigned int m_nTerms;
+  // Recoil energy parameter
+  double m_rgas[m_nMaxGases];
+  // Opal-Beaty-Peterson splitting parameter [eV]
+  double m_wOpalBeaty[nMaxLevels];
+  // Green-Sawada splitting parameters [eV]
+  double m_gsGreenSawada[m_nMaxGases];
+  double m_gbGreenSawada[m_nMaxGases];
+  double m_tsGreenSawada[m_nMaxGases];
+  double m_taGreenSawada[m_nMaxGases];
+  double m_tbGreenSawada[m_nMaxGases];
+  bool m_hasGreenSawada[m_nMaxGases];
+  // Energy loss
+  double m_energyLoss[nMaxLevels];
+  // Cross-section type
+  int m_csType[nMaxLevels];
+  // Parameters for calculation of scattering angles
+  bool m_useAnisotropic;
+  bool m_useFastKinematics;
+  int m_scatModel[nMaxLevels];
+
+  // Level description
+  char m_description[nMaxLevels][50];
+
+  // Total collision frequency
+  std::vector<double> m_cfTot;
+  std::vector<double> m_cfTotLog;
+  // Lookup of the logarithmic energy bins without evaluating log(e)
+  std::vector<double> m_eLogEdges;
+  std::vector<int> m_logKeyIndex;
+  uint64_t m_logKeyOffset;
+  unsigned int m_logKeyShift;
+  // Total collision frequency at the lower edge and slope in each bin
+  std::vector<double> m_cfTotLogRate;
+  std::vector<double> m_cfTotLogSlope;
+  // Null-collision frequency
+  double m_cfNull;
+  // Collision frequencies, angular distribution parameters, energy loss
+  // and type of each term, packed together for sampling the collisions
+  struct collisionTerm {
+    collisionTerm()
+        : cf(0.), scatCut(1.), scatParameter(0.5), energyLoss(0.),
+          csType(0), scatModel(0) {}
+    // Cumulative collision probability
+    double cf;
+    double scatCut;
+    double scatParameter;
+    double energyLoss;
+    int csType;
+    int scatModel;
+  };
+  // Rows of m_nColumns terms, linear energy bins followed by the
+  // logarithmic energy bins
+  std::vector<collisionTerm> m_collisionTable;
+  unsigned int m_nColumns;
+
+  // Collision counters
+  // 0: elastic
+  // 1: ionisation
+  // 2: attachment
+  // 3: inelastic
+  // 4: excitation
+  // 5: super-elastic
+  unsigned int m_nCollisions[nCsTypes];
+  // Number of collisions for each cross-section term
+  std::vector<unsigned int> m_nCollisionsDetailed;
+
+  // Penning transfer
+  // Penning transfer probability (by level)
+  double m_rPenning[nMaxLevels];
+  // Mean distance of Penning ionisation (by level)
+  double m_lambdaPenning[nMaxLevels];
+  // Number of Penning ionisations
+  unsigned int m_nPenning;
+  // Number of truncated de-excitation cascades
+  unsigned int m_nTruncatedCascades;
+
+  // Deexcitation
+  // Switch on/off de-excitation handling
+  bool m_useDeexcitation;
+  // Switch on/off discrete photoabsorption levels
+  bool m_useRadTrap;
+
+  struct deexcitation {
+    // Gas component
+    int gas;
+    // Associated cross-section term
+    int level;
+    // Level description
+    std::string label;
+    // Energy
+    double energy;
+    // Number of de-excitation channels
+    int nChannels;
+    // Branching ratios (cumulative)
+    std::vector<double> p;
+    // Alias table of the branching ratios
+    std::vector<double> aliasCut;
+    std::vector<int> alias;
+    // Final levels
+    std::vector<int> final;
+    // Type of transition
+    std::vector<int> type;
+    // Oscillator strength
+    double osc;
+    // Total decay rate
+    double rate;
+    // Doppler broadening
+    double sDoppler;
+    // Pressure broadening
+    double gPressure;
+    // Effective width
+    double width;
+    // Integrated absorption collision rate
+    double cf;
+  };
+  std::vector<deexcitation> m_deexcitations;
+  // Mapping between deexcitations and cross-section terms.
+  int m_iDeexcitation[nMaxLevels];
+
+  // List of ionisation products.
+  struct ionProd {
+    int type;
+    double energy;
+  };
+  std::vector<ionProd> m_ionProducts;
+
+  // List of de-excitation products
+  int nDeexcitationProducts;
+  std::vector<dxcProd> m_dxcProducts;
+
+  // Ionisation potentials
+  double m_ionPot[m_nMaxGases];
+  // Minimum ionisation potential
+  double m_minIonPot;
+  // Lowest ionisation threshold above the present energy range
+  double m_eNextIonPot;
+
+  // Scaling factor for excitation cross-sections
+  double m_scaleExc[m_nMaxGases];
+  // Flag selecting secondary electron energy distribution model
+  bool m_useOpalBeaty;
+  bool m_useGreenSawada;
+  // Tabulated secondary electron energy distributions: for each term and
+  // energy, esec = e0 + w tan(a + r (b - a)) with r uniform in [0, 1]
+  bool m_useSecondaryEnergyTable;
+  uint64_t m_secKeyOffset;
+  int m_nSecRows;
+  std::vector<double> m_secTable;
+  // Offset of the table in m_secTable for each term (-1 if none)
+  int m_iSecTable[nMaxLevels];
+
+  // Energy spacing of photon collision rates table
+  double m_eFinalGamma, m_eStepGamma;
+  // Number of photon collision cross-section terms
+  int nPhotonTerms;
+  // Total photon collision frequencies
+  std::vector<double> m_cfTotGamma;
+  // Photon collision frequencies
+  std::vector<std::vector<double> > m_cfGamma;
+  std::vector<int> csTypeGamma;
+  // Tabulated absorption rates of the discrete lines (sorted by energy),
+  // at distances x from the line centre with sqrt(x / width) equally spaced
+  struct lineProfile {
+    // Index in m_deexcitations
+    int dxc;
+    double energy;
+    double width;
+    std::vector<double> f;
+  };
+  std::vector<lineProfile> m_lines;
+  std::vector<double> m_lineEnergies;
+  double m_lineWidthMax;
+  // Photon collision counters
+  // 0: elastic
+  // 1: ionisation
+  // 2: inelastic
+  // 3: excitation
+  int m_nPhotonCollisions[nCsTypesGamma];
+
+  // Diagnostics of the last RunMagboltz call and of the GenerateGasTable run
+  GasTablePoint m_magboltzRun;
+  std::vector<GasTablePoint> m_gasTablePoints;
+  GasTableCallback m_gasTableCallback;
+  void* m_gasTableCallbackData;
+  bool m_storeDiagnostics;
+
+  // Cross-section tables returned by Magboltz for one gas
+  struct gasmixTables {
+    // Cross-sections
+    // 0: total, 1: elastic,
+    // 2: ionisation, 3: attachment,
+    // 4, 5: unused
+    double q[nMaxEnergySteps][6];
+    // Parameters for scattering angular distribution
+    double pEqEl[nMaxEnergySteps][6];
+    // Inelastic cross-sections
+    double qIn[nMaxEnergySteps][nMaxInelasticTerms];
+    // Ionisation cross-sections
+    double qIon[nMaxEnergySteps][8];
+    // Parameters for angular distribution in inelastic collisions
+    double pEqIn[nMaxEnergySteps][nMaxInelasticTerms];
+    // Parameters for angular distribution in ionising collisions
+    double pEqIon[nMaxEnergySteps][8];
+    // Opal-Beaty parameter
+    double eoby[nMaxEnergySteps];
+    // Penning transfer parameters
+    double penFra[nMaxInelasticTerms][3];
+    // Description of cross-section terms
+    char scrpt[260][50];
+  };
+
+  bool GetGasNumberMagboltz(const std::string& input, int& number) const;
+  bool Mixer(const bool verbose = false);
+  bool FinishMixer(const bool verbose, const bool cached);
+  std::string GetTableCacheKey(const bool withPressure = true) const;
+  void RescaleCollisionRates(const double f);
+  std::string GetTableCacheFile(const std::string& key) const;
+  bool ReadTableCache(const bool verbose);
+  bool WriteTableCache() const;
+  bool WriteCrossSectionFile(const std::string& filename) const;
+  void FillLogTableRow(const unsigned int iGas, const int ngas, const int np0,
+                       const int iE, const double emax, gasmixTables& tab);
+  void NormaliseLogTableRow(const int iE);
+  void UpdateCollisionTables();
+  bool ExtendLogTable();
+  bool IncreaseEnergyRange(const double e);
+  collisionTerm& Term(const int iE, const int k) {
+    return m_collisionTable[iE * m_nColumns + k];
+  }
+  collisionTerm& TermLog(const int iE, const int k) {
+    return m_collisionTable[(m_nEnergySteps + iE) * m_nColumns + k];
+  }
+  const collisionTerm& Term(const int iE, const int k) const {
+    return m_collisionTable[iE * m_nColumns + k];
+  }
+  const collisionTerm& TermLog(const int iE, const int k) const {
+    return m_collisionTable[(m_nEnergySteps + iE) * m_nColumns + k];
+  }
+  void SetCollisionTableColumns(const unsigned int n);
+  void FinishCollisionTable();
+  void ComputeLogBinLookup();
+  int GetLogBin(const double e) const;
+  void SetupGreenSawada();
+  void ComputeAngularCut(const double parIn, double& cut,
+                         double& parOut) const;
+  void ComputeDeexcitationTable(const bool verbose);
+  bool GetDeexcitationIndex(const int level, int& index);
+  void ComputeDeexcitationInternal(int iLevel, int& fLevel);
+  void ComputeDeexcitationInternal(int iLevel, int& fLevel, RandomStream& rng);
+  bool ComputePhotonCollisionTable(const bool verbose);
+  void ComputeLineProfiles();
+  double GetLineRate(const lineProfile& line, const double e) const;
+  void ComputeSecondaryEnergyTable();
+  double SampleSecondaryEnergy(const int level, const double e,
+                               const double r) const;
+
+  // Implementations of the collision sampling, templated on the
+  // source of random numbers (global generator or RandomStream).
+  template <class R>
+  bool SampleElectronCollision(const double e, int& type, int& level,
+                               double& e1, double& dx, double& dy, double& dz,
+                               int& nion, int& ndxc, int& band, R& rndm);
+  template <class R>
+  void SampleDeexcitation(int iLevel, int& fLevel, R& rndm);
+  template <class R>
+  unsigned int SampleDeexcitationCascade(int iLevel, int& fLevel, R& rndm,
+                                         dxcProd* products,
+                                         const unsigned int nMax, double& t,
+                                         bool& truncated);
+  void ReportTruncatedCascade(const unsigned int n);
+  template <class R>
+  bool SamplePhotonCollision(const double e, int& type, int& level,
+                             double& e1, double& ctheta, int& nsec,
+                             double& esec, R& rndm);
+
+  // Fit parameters
+  double fit3d4p, fitHigh4p;
+  double fit3dQCO2, fit3dQCH4, fit3dQC2H6;
+  double fit3dEtaCO2, fit3dEtaCH4, fit3dEtaC2H6;
+  double fit4pEtaCH4, fit4pEtaC2H6;
+  double fit4sEtaC2H6;
+  double fitLineCut;
+};
+}
+#endif
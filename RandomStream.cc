@@ -0,0 +1,100 @@
+#include <cmath>
+
+#include "RandomStream.hh"
+#include "FundamentalConstants.hh"
+
+namespace {
+
+// Philox4x32 multipliers and Weyl key increments
+// (Salmon et al., Proc. SC11, doi:10.1145/2063384.2063405).
+const uint32_t PhiloxM0 = 0xD2511F53;
+const uint32_t PhiloxM1 = 0xCD9E8D57;
+const uint32_t PhiloxW0 = 0x9E3779B9;
+const uint32_t PhiloxW1 = 0xBB67AE85;
+// 2^-53
+const double Inv53 = 1. / 9007199254740992.;
+
+inline void MulHiLo(const uint32_t a, const uint32_t b, uint32_t& hi,
+                    uint32_t& lo) {
+  const uint64_t p = uint64_t(a) * uint64_t(b);
+  hi = uint32_t(p >> 32);
+  lo = uint32_t(p);
+}
+
+inline double ToDouble(const uint32_t hi, const uint32_t lo) {
+  // Use the upper 53 bits of the 64-bit word.
+  const uint64_t u = (uint64_t(hi) << 32) | uint64_t(lo);
+  return (u >> 11) * Inv53;
+}
+}
+
+namespace Garfield {
+
+RandomStream::RandomStream(const uint64_t seed, const uint64_t stream) {
+
+  SetSeed(seed, stream);
+}
+
+void RandomStream::SetSeed(const uint64_t seed, const uint64_t stream) {
+
+  // The seed is used as key, the stream number occupies the upper
+  // half of the counter block, so streams never overlap.
+  m_key[0] = uint32_t(seed);
+  m_key[1] = uint32_t(seed >> 32);
+  m_stream = stream;
+  m_counter = 0;
+  m_buffer[0] = m_buffer[1] = 0.;
+  m_nBuffered = 0;
+}
+
+void RandomStream::Skip(const uint64_t n) {
+
+  m_counter += n;
+  m_nBuffered = 0;
+}
+
+void RandomStream::Refill() {
+
+  uint32_t ctr[4] = {uint32_t(m_counter), uint32_t(m_counter >> 32),
+                     uint32_t(m_stream), uint32_t(m_stream >> 32)};
+  uint32_t key[2] = {m_key[0], m_key[1]};
+  for (unsigned int i = 0; i < 10; ++i) {
+    uint32_t hi0, lo0, hi1, lo1;
+    MulHiLo(PhiloxM0, ctr[0], hi0, lo0);
+    MulHiLo(PhiloxM1, ctr[2], hi1, lo1);
+    const uint32_t c0 = hi1 ^ ctr[1] ^ key[0];
+    const uint32_t c2 = hi0 ^ ctr[3] ^ key[1];
+    ctr[0] = c0;
+    ctr[1] = lo1;
+    ctr[2] = c2;
+    ctr[3] = lo0;
+    key[0] += PhiloxW0;
+    key[1] += PhiloxW1;
+  }
+  ++m_counter;
+  m_buffer[0] = ToDouble(ctr[0], ctr[1]);
+  m_buffer[1] = ToDouble(ctr[2], ctr[3]);
+  m_nBuffered = 2;
+}
+
+double RandomStream::Gaussian(const double mu, const double sigma) {
+
+  // Box-Muller transformation (one of the two variates is discarded,
+  // which keeps the stream position independent of the call history).
+  const double r = sqrt(-2. * log(UniformPos()));
+  return mu + sigma * r * cos(TwoPi * Uniform());
+}
+
+double RandomStream::Lorentz(const double mu, const double gamma) {
+
+  return mu + gamma * tan(Pi * (Uniform() - 0.5));
+}
+
+double RandomStream::Voigt(const double mu, const double sigma,
+                           const double gamma) {
+
+  if (sigma <= 0.) return Lorentz(mu, gamma);
+  if (gamma <= 0.) return Gaussian(mu, sigma);
+  return Gaussian(Lorentz(mu, gamma), sigma);
+}
+}
@@ -0,0 +1,58 @@
+#ifndef G_RANDOM_STREAM_H
+#define G_RANDOM_STREAM_H
+
+#include <stdint.h>
+
+namespace Garfield {
+
+/// Counter-based random number stream (Philox4x32-10).
+/// Each (seed, stream) pair defines an independent, reproducible sequence,
+/// so that e. g. every electron or thread can be given its own stream
+/// keyed by event and electron number. (Passing a stream to a medium
+/// does not make the medium itself thread-safe, see MediumMagboltz.)
+
+class RandomStream {
+
+ public:
+  // Constructor
+  RandomStream(const uint64_t seed = 0, const uint64_t stream = 0);
+  // Destructor
+  ~RandomStream() {}
+
+  // Select the key and rewind the stream to the start of the sequence.
+  void SetSeed(const uint64_t seed, const uint64_t stream = 0);
+  // Skip ahead by n blocks (two random numbers per block).
+  void Skip(const uint64_t n);
+  // Number of blocks generated since the last reset.
+  uint64_t GetPosition() const { return m_counter; }
+
+  // Draw a random number uniformly distributed in [0, 1).
+  double Uniform() {
+    if (m_nBuffered == 0) Refill();
+    return m_buffer[--m_nBuffered];
+  }
+  // Draw a random number uniformly distributed in (0, 1].
+  double UniformPos() { return 1. - Uniform(); }
+  // Draw a Gaussian random number.
+  double Gaussian(const double mu, const double sigma);
+  // Draw a Lorentzian random number.
+  double Lorentz(const double mu, const double gamma);
+  // Draw a random number according to a Voigt profile.
+  double Voigt(const double mu, const double sigma, const double gamma);
+
+ private:
+  // Key
+  uint32_t m_key[2];
+  // Stream number
+  uint64_t m_stream;
+  // Block counter
+  uint64_t m_counter;
+  // Random numbers from the last block not yet handed out
+  double m_buffer[2];
+  unsigned int m_nBuffered;
+
+  void Refill();
+};
+}
+
+#endif